@@ -23,6 +23,8 @@
 #define __USE_ISOC9X    1
 #define __USE_ISOC99    1
 
+#include <config.h>
+
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
@@ -34,6 +36,10 @@
 
 #include "memops.h"
 
+#ifdef USE_DYNSIMD
+#include "intsimd.h"
+#endif
+
 /* Notes about these *_SCALING values.
 
    the MAX_<N>BIT values are floating point. when multiplied by
@@ -159,6 +165,19 @@
 	}
 
 
+#ifdef USE_DYNSIMD
+
+/* The native byte order moves without dither go through the float to
+   int kernels picked for this CPU, SIMD_CHUNK samples at a time, and
+   only pack or unpack the integers here. The kernels clamp, scale and
+   round like float_16() and friends. On capture they multiply by the
+   inverse of the scale where the plain code divides, which can change
+   a sample by one unit in the last place.
+ */
+#define SIMD_CHUNK 256
+
+#endif /* USE_DYNSIMD */
+
 /* Linear Congruential noise generator. From the music-dsp list
  * less random than rand(), but good enough and 10x faster
  */
@@ -245,6 +264,25 @@ void sample_move_d32u24_sSs (char *dst, jack_default_audio_sample_t *src, unsign
 
 void sample_move_d32u24_sS (char *dst, jack_default_audio_sample_t *src, unsigned long nsamples, unsigned long dst_skip, dither_state_t *state)
 {
+#ifdef USE_DYNSIMD
+	int z[SIMD_CHUNK];
+	unsigned long i, n;
+
+	if (jack_simd_funcs.f2i) {
+		while (nsamples) {
+			n = nsamples < SIMD_CHUNK ? nsamples : SIMD_CHUNK;
+			jack_simd_funcs.f2i (z, src, n, SAMPLE_24BIT_SCALING);
+			for (i = 0; i < n; i++) {
+				*((int32_t*)dst) = z[i] << 8;
+				dst += dst_skip;
+			}
+			src += n;
+			nsamples -= n;
+		}
+		return;
+	}
+#endif /* USE_DYNSIMD */
+
 	while (nsamples--) {
 		float_24u32 (*src, *((int32_t*)dst));
 		dst += dst_skip;
@@ -285,6 +323,25 @@ void sample_move_dS_s32u24 (jack_default_audio_sample_t *dst, char *src, unsigne
 {
 	/* ALERT: signed sign-extension portability !!! */
 
+#ifdef USE_DYNSIMD
+	int x[SIMD_CHUNK];
+	unsigned long i, n;
+
+	if (jack_simd_funcs.i2f) {
+		while (nsamples) {
+			n = nsamples < SIMD_CHUNK ? nsamples : SIMD_CHUNK;
+			for (i = 0; i < n; i++) {
+				x[i] = *((int*)src) >> 8;
+				src += src_skip;
+			}
+			jack_simd_funcs.i2f (dst, x, n, 1.0f / SAMPLE_24BIT_SCALING);
+			dst += n;
+			nsamples -= n;
+		}
+		return;
+	}
+#endif /* USE_DYNSIMD */
+
 	while (nsamples--) {
 		*dst = (*((int*)src) >> 8) / SAMPLE_24BIT_SCALING;
 		dst++;
@@ -316,6 +373,30 @@ void sample_move_d24_sS (char *dst, jack_default_audio_sample_t *src, unsigned l
 {
 	int32_t z;
 
+#ifdef USE_DYNSIMD
+	int zs[SIMD_CHUNK];
+	unsigned long i, n;
+
+	if (jack_simd_funcs.f2i) {
+		while (nsamples) {
+			n = nsamples < SIMD_CHUNK ? nsamples : SIMD_CHUNK;
+			jack_simd_funcs.f2i (zs, src, n, SAMPLE_24BIT_SCALING);
+			for (i = 0; i < n; i++) {
+				z = zs[i];
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+				memcpy (dst, &z, 3);
+#elif __BYTE_ORDER == __BIG_ENDIAN
+				memcpy (dst, (char*)&z + 1, 3);
+#endif
+				dst += dst_skip;
+			}
+			src += n;
+			nsamples -= n;
+		}
+		return;
+	}
+#endif /* USE_DYNSIMD */
+
 	while (nsamples--) {
 		float_24 (*src, z);
 #if __BYTE_ORDER == __LITTLE_ENDIAN
@@ -365,6 +446,31 @@ void sample_move_dS_s24 (jack_default_audio_sample_t *dst, char *src, unsigned l
 {
 	/* ALERT: signed sign-extension portability !!! */
 
+#ifdef USE_DYNSIMD
+	int xs[SIMD_CHUNK];
+	unsigned long i, n;
+
+	if (jack_simd_funcs.i2f) {
+		while (nsamples) {
+			n = nsamples < SIMD_CHUNK ? nsamples : SIMD_CHUNK;
+			for (i = 0; i < n; i++) {
+				int x;
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+				memcpy ((char*)&x + 1, src, 3);
+#elif __BYTE_ORDER == __BIG_ENDIAN
+				memcpy (&x, src, 3);
+#endif
+				xs[i] = x >> 8;
+				src += src_skip;
+			}
+			jack_simd_funcs.i2f (dst, xs, n, 1.0f / SAMPLE_24BIT_SCALING);
+			dst += n;
+			nsamples -= n;
+		}
+		return;
+	}
+#endif /* USE_DYNSIMD */
+
 	while (nsamples--) {
 		int x;
 #if __BYTE_ORDER == __LITTLE_ENDIAN
@@ -409,6 +515,25 @@ void sample_move_d16_sSs (char *dst,  jack_default_audio_sample_t *src, unsigned
 
 void sample_move_d16_sS (char *dst,  jack_default_audio_sample_t *src, unsigned long nsamples, unsigned long dst_skip, dither_state_t *state)
 {
+#ifdef USE_DYNSIMD
+	int z[SIMD_CHUNK];
+	unsigned long i, n;
+
+	if (jack_simd_funcs.f2i) {
+		while (nsamples) {
+			n = nsamples < SIMD_CHUNK ? nsamples : SIMD_CHUNK;
+			jack_simd_funcs.f2i (z, src, n, SAMPLE_16BIT_SCALING);
+			for (i = 0; i < n; i++) {
+				*((int16_t*)dst) = z[i];
+				dst += dst_skip;
+			}
+			src += n;
+			nsamples -= n;
+		}
+		return;
+	}
+#endif /* USE_DYNSIMD */
+
 	while (nsamples--) {
 		float_16 (*src, *((int16_t*)dst));
 		dst += dst_skip;
@@ -586,6 +711,25 @@ void sample_move_dS_s16 (jack_default_audio_sample_t *dst, char *src, unsigned l
 
 {
 	/* ALERT: signed sign-extension portability !!! */
+#ifdef USE_DYNSIMD
+	int x[SIMD_CHUNK];
+	unsigned long i, n;
+
+	if (jack_simd_funcs.i2f) {
+		while (nsamples) {
+			n = nsamples < SIMD_CHUNK ? nsamples : SIMD_CHUNK;
+			for (i = 0; i < n; i++) {
+				x[i] = *((short*)src);
+				src += src_skip;
+			}
+			jack_simd_funcs.i2f (dst, x, n, 1.0f / SAMPLE_16BIT_SCALING);
+			dst += n;
+			nsamples -= n;
+		}
+		return;
+	}
+#endif /* USE_DYNSIMD */
+
 	while (nsamples--) {
 		*dst = (*((short*)src)) / SAMPLE_16BIT_SCALING;
 		dst++;
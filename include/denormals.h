@@ -0,0 +1,128 @@
+/*
+    Copyright (C) 2026 the JACK developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ */
+
+#ifndef __jack_denormals_h__
+#define __jack_denormals_h__
+
+/* Denormal handling for the threads that run process cycles.
+ *
+ * jack_denormals_begin() is called at the start of a cycle. If asked
+ * to, it makes the FPU flush denormal results to zero (FTZ) and,
+ * where the CPU can, treat denormal operands as zero (DAZ). It never
+ * turns either off, so a client that sets them itself keeps them. It
+ * also clears the sticky flags that jack_denormals_end() reads at the
+ * end of the cycle, which says whether any denormal came up in
+ * between, flushed or not.
+ *
+ * The FPU mode is per thread, so this has to run in the thread doing
+ * the work; doing it every cycle also undoes a plugin that changed it.
+ */
+
+#include <stdint.h>
+
+#if defined(__SSE__) && (defined(__i386__) || defined(__x86_64__))
+
+#include <xmmintrin.h>
+
+#define JACK_MXCSR_DE  0x0002           /* denormal operand seen */
+#define JACK_MXCSR_UE  0x0010           /* result underflowed */
+#define JACK_MXCSR_DAZ 0x0040
+#define JACK_MXCSR_FTZ 0x8000
+
+/* Every x86-64 CPU has DAZ; some early 32-bit SSE ones fault on it. */
+#ifdef __x86_64__
+#define JACK_MXCSR_FLUSH (JACK_MXCSR_FTZ | JACK_MXCSR_DAZ)
+#else
+#define JACK_MXCSR_FLUSH JACK_MXCSR_FTZ
+#endif
+
+static inline void
+jack_denormals_begin (int flush)
+{
+	unsigned int csr = _mm_getcsr ();
+	unsigned int want = csr & ~(JACK_MXCSR_DE | JACK_MXCSR_UE);
+
+	if (flush) {
+		want |= JACK_MXCSR_FLUSH;
+	}
+
+	if (want != csr) {
+		_mm_setcsr (want);
+	}
+}
+
+static inline int
+jack_denormals_end (void)
+{
+	return (_mm_getcsr () & (JACK_MXCSR_DE | JACK_MXCSR_UE)) != 0;
+}
+
+#elif defined(__aarch64__)
+
+#define JACK_FPCR_FZ  (1U << 24)
+#define JACK_FPSR_UFC (1U << 3)         /* result underflowed */
+#define JACK_FPSR_IDC (1U << 7)         /* denormal operand seen */
+
+static inline void
+jack_denormals_begin (int flush)
+{
+	uint64_t fpcr, fpsr;
+
+	if (flush) {
+		__asm__ __volatile__ ("mrs %0, fpcr" : "=r" (fpcr));
+		if (!(fpcr & JACK_FPCR_FZ)) {
+			__asm__ __volatile__ ("msr fpcr, %0"
+					      :: "r" (fpcr | JACK_FPCR_FZ));
+		}
+	}
+
+	__asm__ __volatile__ ("mrs %0, fpsr" : "=r" (fpsr));
+	if (fpsr & (JACK_FPSR_UFC | JACK_FPSR_IDC)) {
+		__asm__ __volatile__ ("msr fpsr, %0"
+				      :: "r" (fpsr & ~(uint64_t)(JACK_FPSR_UFC
+								 | JACK_FPSR_IDC)));
+	}
+}
+
+static inline int
+jack_denormals_end (void)
+{
+	uint64_t fpsr;
+
+	__asm__ __volatile__ ("mrs %0, fpsr" : "=r" (fpsr));
+
+	return (fpsr & (JACK_FPSR_UFC | JACK_FPSR_IDC)) != 0;
+}
+
+#else
+
+static inline void
+jack_denormals_begin (int flush)
+{
+}
+
+static inline int
+jack_denormals_end (void)
+{
+	return 0;
+}
+
+#endif
+
+#endif /* __jack_denormals_h__ */
@@ -23,6 +23,7 @@
 
 #include <jack/jack.h>
 #include "internal.h"
+#include "futex.h"
 #include "driver_interface.h"
 
 struct _jack_driver;
@@ -35,20 +36,34 @@ struct _jack_port_internal;
 typedef struct {
 	jack_shm_info_t* shm_info;
 	jack_shmsize_t offset;
+	jack_shmsize_t size;            /* bytes */
+	int size_class;
 } jack_port_buffer_info_t;
 
+/* MIDI port buffers come in this many sizes, each four times the one
+ * below, starting from the port type's buffer size. A port asks for
+ * one with the buffer_size argument of jack_port_register().
+ */
+#define JACK_PORT_SIZE_CLASSES 4
+
 /* The engine keeps an array of these in its local memory. */
 typedef struct _jack_port_internal {
 	struct _jack_port_shared *shared;
 	JSList                   *connections;
 	jack_port_buffer_info_t  *buffer_info;
+	uint32_t index_hash[3];         /* keys in the port name index */
+	int index_nhashes;
+	jack_port_buffer_info_t  *mix_buffer_info;      /* if a mix group leader */
+	int32_t mix_left;               /* group left since the last sort */
 } jack_port_internal_t;
 
 /* The engine's internal port type structure. */
 typedef struct _jack_port_buffer_list {
 	pthread_mutex_t lock;                   /* only lock within server */
 	JSList                  *freelist;      /* list of free buffers */
+	JSList                  *class_freelist[JACK_PORT_SIZE_CLASSES - 1]; /* of size classes 1 and up */
 	jack_port_buffer_info_t *info;          /* jack_buffer_info_t array */
+	unsigned long nbuffers;                 /* entries in info */
 } jack_port_buffer_list_t;
 
 typedef struct _jack_reserved_name {
@@ -59,6 +74,66 @@ typedef struct _jack_reserved_name {
 #define JACKD_WATCHDOG_TIMEOUT 10000
 #define JACKD_CLIENT_EVENT_TIMEOUT 2000
 
+/* An execution plan for the process cycle: the order in which clients
+ * run, how each external subgraph is started and waited for, and the
+ * connections of the ports of internal clients. It is built by
+ * jack_rechain_graph() and never changed once published, apart from
+ * the scratch arrays that only the process thread uses.
+ *
+ * Each external client waits on a FIFO and futex word of its own, and
+ * after process() signals the one named by its graph_next[set]. A new
+ * plan gets the set the published one does not use, so clients can be
+ * told about it while the published plan keeps running.
+ */
+typedef struct _jack_plan_entry {
+	jack_client_internal_t *client;
+	int internal;
+	int start_fd;                   /* external clients only */
+	int wait_fd;
+	int start_slot;                 /* graph_futex[] indices */
+	int wait_slot;
+	unsigned int next;              /* entry to continue with afterwards */
+	unsigned int feedcount;         /* parallel: entries to wait for */
+	unsigned int ndependents;       /* parallel: entries fed by this one */
+	unsigned int *dependents;
+} jack_plan_entry_t;
+
+/* The connections of one port of an internal client: count nodes of
+ * the plan's links[] from first on, chained so that libjack walks them
+ * like any other connection list.
+ */
+typedef struct _jack_plan_port {
+	jack_port_t *port;
+	unsigned int first;
+	unsigned int count;
+} jack_plan_port_t;
+
+typedef struct _jack_graph_plan {
+	unsigned long generation;
+	int parallel;
+	int futex;
+	int set;                        /* graph_next[] entry the clients use */
+	unsigned int nentries;
+	jack_plan_entry_t *entries;
+	unsigned int *dependents;
+
+	unsigned int nports;
+	jack_plan_port_t *ports;
+	unsigned int nlinks;
+	JSList *links;
+	jack_port_t **far;              /* the other end of each link */
+
+	int32_t retired_epoch;          /* engine->plan_epoch when replaced */
+
+	/* process thread scratch space */
+	unsigned int *pending;
+	unsigned int *ready;
+	unsigned int *running;
+	struct pollfd *pfd;
+	unsigned int nready;
+	unsigned int nrunning;
+} jack_graph_plan_t;
+
 /* The main engine structure in local memory. */
 struct _jack_engine {
 	jack_control_t        *control;
@@ -104,6 +179,15 @@ struct _jack_engine {
 	jack_shm_info_t port_segment[JACK_MAX_PORT_TYPES];
 
 	unsigned int port_max;
+	uint32_t port_index_used;       /* port name index slots in use */
+	uint32_t port_index_deleted;    /* and deleted since the last rebuild */
+	uint64_t *port_free;            /* one bit per free port slot */
+	uint64_t *port_free_summary;    /* one bit per non-zero port_free word */
+	uint32_t port_free_words;
+	uint32_t ports_in_use;
+	uint32_t ports_in_use_max;      /* high water mark */
+	unsigned long port_allocs;
+	unsigned long port_alloc_failures;
 	pthread_t server_thread;
 
 	int fds[2];
@@ -119,6 +203,16 @@ struct _jack_engine {
 	int session_reply_fd;
 	int session_pending_replies;
 
+	/* parallel scheduler */
+	int parallel;
+
+	/* futex wakeup chain: requested, and in use by the current chain */
+	int futex_wakeup;
+	int futex_active;
+
+	/* percent of the base MIDI buffers' room given to larger ones */
+	unsigned int midi_class_budget;
+
 	unsigned long external_client_cnt;
 	int rtpriority;
 	volatile char freewheeling;
@@ -130,6 +224,13 @@ struct _jack_engine {
 	const char     *server_name;
 	char temporary;
 	int reordered;
+	int sort_deferred;              /* graph transactions in progress */
+	int sort_pending;
+	int latency_sorts;              /* jack_sort_graph() calls and */
+	int latency_edges;              /* connection changes since the
+					   latencies were last computed */
+	jack_port_internal_t *latency_src;      /* the change, if only one */
+	jack_port_internal_t *latency_dst;
 	int feedbackcount;
 	int removing_clients;
 	pid_t wait_pid;
@@ -139,6 +240,24 @@ struct _jack_engine {
 	volatile int timeout_count;
 	volatile int new_clients_allowed;
 
+	/* the published execution plan. the process thread reads it
+	   without the graph lock during plan cycles, so anything it
+	   references is only freed after a grace period, see
+	   jack_engine_retire_plans().
+	 */
+	jack_graph_plan_t *plan;
+	unsigned long plan_generation;
+	int plan_set;                           /* of the plan last built */
+	JSList *plan_retired;
+	volatile int plan_cycles_allowed;       /* nesting depth */
+	volatile int32_t plan_epoch;            /* odd during a plan cycle */
+	volatile int32_t plan_waiters;          /* for plan_epoch to move */
+#ifndef JACK_HAVE_FUTEX
+	pthread_mutex_t plan_lock;
+	pthread_cond_t plan_cond;
+#endif
+	unsigned long plan_cycles;
+
 	/* these lists are protected by `client_lock' */
 	JSList         *clients;
 	JSList         *clients_waiting;
@@ -182,7 +301,10 @@ jack_engine_t  *jack_engine_new(int real_time, int real_time_priority,
 				int verbose, int client_timeout,
 				unsigned int port_max,
 				pid_t waitpid, jack_nframes_t frame_time_offset, int nozombies,
-				int timeout_count_threshold,
+				int timeout_count_threshold, int parallel,
+				int futex_wakeup, int spin_usecs,
+				int flush_denormals,
+				unsigned int midi_class_budget,
 				JSList *drivers);
 void            jack_engine_delete(jack_engine_t *);
 int             jack_run(jack_engine_t *engine);
@@ -200,6 +322,11 @@ void            jack_engine_reset_rolling_usecs(jack_engine_t *engine);
 int             internal_client_request(void* ptr, jack_request_t *request);
 int             jack_get_fifo_fd(jack_engine_t *engine,
 				 unsigned int which_fifo);
+void            jack_engine_publish_plan(jack_engine_t *engine);
+void            jack_engine_allow_plan_cycles(jack_engine_t *engine);
+void            jack_engine_block_plan_cycles(jack_engine_t *engine);
+void            jack_engine_retire_plans(jack_engine_t *engine, int wait);
+void            jack_clear_graph_slot(jack_engine_t *engine, int slot);
 
 extern jack_timer_type_t clock_source;
 
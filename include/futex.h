@@ -0,0 +1,154 @@
+/*
+    Copyright (C) 2026 the JACK developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ */
+
+#ifndef __jack_futex_h__
+#define __jack_futex_h__
+
+/* Process-shared futex words used as counting semaphores for the
+ * process graph wakeup chain (see graph_futex[] in jack_control_t).
+ *
+ * The low bits of a word count pending wakeups. JACK_FUTEX_KICK is
+ * set by the server to break a client out of its wait so that it
+ * looks at its event socket; it does not count as a wakeup.
+ *
+ * Include after internal.h, which provides jack_get_microseconds().
+ */
+
+#include <stdint.h>
+
+#if defined(__linux__) && !defined(JACK_USE_MACH_THREADS)
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define JACK_HAVE_FUTEX 1
+
+#define JACK_FUTEX_KICK       0x40000000
+#define JACK_FUTEX_COUNT_MASK 0x0fffffff
+
+/* Sleep while *addr == val. A negative timeout waits forever.
+ * Returns 0 when woken (or if *addr had already changed), -1 with
+ * errno set otherwise.
+ */
+static inline int
+jack_futex_wait (volatile int32_t *addr, int32_t val, long timeout_usecs)
+{
+	struct timespec ts;
+	struct timespec *tsp = NULL;
+
+	if (timeout_usecs >= 0) {
+		ts.tv_sec = timeout_usecs / 1000000;
+		ts.tv_nsec = (timeout_usecs % 1000000) * 1000;
+		tsp = &ts;
+	}
+
+	if (syscall (SYS_futex, addr, FUTEX_WAIT, val, tsp, NULL, 0) < 0) {
+		if (errno == EAGAIN || errno == EINTR) {
+			return 0;
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
+static inline void
+jack_futex_wake (volatile int32_t *addr, int nwake)
+{
+	syscall (SYS_futex, addr, FUTEX_WAKE, nwake, NULL, NULL, 0);
+}
+
+/* Tell the CPU we are busy-waiting. */
+static inline void
+jack_cpu_relax (void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__asm__ __volatile__ ("pause" ::: "memory");
+#elif defined(__aarch64__)
+	__asm__ __volatile__ ("yield" ::: "memory");
+#else
+	__asm__ __volatile__ ("" ::: "memory");
+#endif
+}
+
+/* Add one wakeup to the word and wake its waiter. */
+static inline void
+jack_futex_post (volatile int32_t *addr)
+{
+	__atomic_add_fetch (addr, 1, __ATOMIC_SEQ_CST);
+	jack_futex_wake (addr, 1);
+}
+
+/* Consume one wakeup if there is one, without blocking. */
+static inline int
+jack_futex_trytake (volatile int32_t *addr)
+{
+	int32_t v = __atomic_load_n (addr, __ATOMIC_ACQUIRE);
+
+	while (v & JACK_FUTEX_COUNT_MASK) {
+		if (__atomic_compare_exchange_n (addr, (int32_t*)&v, v - 1, 0,
+						 __ATOMIC_ACQ_REL,
+						 __ATOMIC_ACQUIRE)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Consume one wakeup, blocking for up to timeout_usecs in total.
+ * Returns 0 on success, -1 on timeout or error.
+ */
+static inline int
+jack_futex_take (volatile int32_t *addr, long timeout_usecs)
+{
+	jack_time_t then = jack_get_microseconds ();
+	jack_time_t elapsed;
+	int32_t v;
+
+	while (1) {
+		if (jack_futex_trytake (addr)) {
+			return 0;
+		}
+
+		elapsed = jack_get_microseconds () - then;
+
+		if (elapsed >= (jack_time_t)timeout_usecs) {
+			return -1;
+		}
+
+		v = __atomic_load_n (addr, __ATOMIC_ACQUIRE);
+
+		if (v & JACK_FUTEX_COUNT_MASK) {
+			continue;
+		}
+
+		if (jack_futex_wait (addr, v, timeout_usecs - elapsed) < 0
+		    && errno != ETIMEDOUT) {
+			return -1;
+		}
+	}
+}
+
+#endif /* __linux__ && !JACK_USE_MACH_THREADS */
+
+#endif /* __jack_futex_h__ */
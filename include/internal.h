@@ -45,6 +45,8 @@ extern void jack_info(const char *fmt, ...);
 #include <jack/session.h>
 #include <jack/thread.h>
 #include <jack/metadata.h>
+#include <jack/midiport.h>
+#include <jack/ringbuffer.h>
 
 #include "port.h"
 
@@ -151,6 +153,8 @@ typedef struct {
 
 } POST_PACKED_STRUCTURE jack_frame_timer_t;
 
+#define JACK_GRAPH_FUTEX_MAX 1024
+
 /* JACK engine shared memory data structure. */
 typedef struct {
 
@@ -177,6 +181,7 @@ typedef struct {
 	int8_t real_time;
 	int8_t do_mlock;
 	int8_t do_munlock;
+	int8_t flush_denormals;                 /* set FTZ/DAZ in process threads */
 	int32_t client_priority;
 	int32_t max_client_priority;
 	int32_t has_capabilities;
@@ -185,12 +190,49 @@ typedef struct {
 	float max_delayed_usecs;
 	uint32_t port_max;
 	int32_t engine_ok;
+	int32_t spin_usecs;                     /* default client spin-wait limit */
+	uint32_t port_index_size;               /* port name index slots, see portindex.h */
+	volatile uint32_t port_index_seq __attribute__((aligned (4)));
+	volatile uint32_t process_cycle __attribute__((aligned (4))); /* never 0 */
+	uint32_t gain_offset;                   /* connection gains, see jack_connection_gain() */
+	volatile uint32_t denormal_cycles;      /* server cycles that met denormals */
 	jack_port_type_id_t n_port_types;
 	jack_port_type_info_t port_types[JACK_MAX_PORT_TYPES];
+
+	/* wakeup words for the futex process chain, indexed like the
+	   graph FIFOs. explicitly aligned, since futexes need it and the
+	   structure is packed.
+	 */
+	volatile int32_t graph_futex[JACK_GRAPH_FUTEX_MAX] __attribute__((aligned (4)));
+
+	/* which graph_next[] entry of each client the current cycle
+	   uses, set before the first client is woken */
+	volatile int32_t graph_set __attribute__((aligned (4)));
+
 	jack_port_shared_t ports[0];
 
 } POST_PACKED_STRUCTURE jack_control_t;
 
+/* Gain and mute of one connection. The server sets gain and mute;
+ * the client that owns the destination port mixes with them, and
+ * keeps in applied the gain it reached at the end of the last cycle,
+ * so that a change is ramped in over one period.
+ */
+typedef struct {
+	volatile float gain;
+	volatile int32_t mute;
+	volatile float applied;
+	int32_t in_use;                 /* server only */
+} POST_PACKED_STRUCTURE jack_connection_gain_t;
+
+/* port_max of these follow the port name index in the control segment */
+static inline jack_connection_gain_t *
+jack_connection_gain (jack_control_t *control, uint32_t slot)
+{
+	return (jack_connection_gain_t*)((char*)control
+					 + control->gain_offset) + slot;
+}
+
 typedef enum  {
 	BufferSizeChange,
 	SampleRateChange,
@@ -208,7 +250,8 @@ typedef enum  {
 	SaveSession,
 	LatencyCallback,
 	PropertyChange,
-	PortRename
+	PortRename,
+	ConnectionGain
 } JackEventType;
 
 const char* jack_event_type_name (JackEventType);
@@ -231,6 +274,7 @@ typedef struct {
 	union {
 		char other_name[JACK_PORT_NAME_SIZE];
 		jack_property_change_t property_change;
+		uint32_t gain_slot;
 	} z;
 } POST_PACKED_STRUCTURE jack_event_t;
 
@@ -272,6 +316,18 @@ typedef volatile struct {
 	volatile uint64_t finished_at;
 	volatile int32_t last_status;        /* w: client, r: engine and client */
 
+	/* futex wakeup chain, see graph_futex[] in jack_control_t */
+	volatile int32_t wait_slot __attribute__((aligned (4))); /* w: client r: engine */
+	/* FIFO and graph_futex[] index to signal after process(), for
+	   each slot set; see graph_set in jack_control_t */
+	volatile int32_t graph_next[2] __attribute__((aligned (4))); /* w: engine r: client */
+	volatile int8_t futex_capable;          /* w: client r: engine */
+	volatile int8_t futex_wakeup;           /* w: engine r: client */
+	volatile int8_t event_pending;          /* w: engine and client r: client */
+	volatile uint32_t spin_hits;            /* w: client r: engine and client */
+	volatile uint32_t spin_misses;          /* w: client r: engine and client */
+	volatile uint32_t denormal_cycles;      /* w: client r: engine and client */
+
 	/* indicators for whether callbacks have been set for this client.
 	   We do not include ptrs to the callbacks here (or their arguments)
 	   so that we can avoid 32/64 bit pointer size mismatches between
@@ -319,6 +375,7 @@ typedef struct {
 
 	jack_shm_registry_index_t client_shm_index;
 	jack_shm_registry_index_t engine_shm_index;
+	int32_t shm_fds;                /* memfd segments sent after this */
 
 	char fifo_prefix[PATH_MAX + 1];
 
@@ -383,9 +440,41 @@ typedef enum {
 	SessionReply = 31,
 	SessionHasCallback = 32,
 	PropertyChangeNotify = 33,
-	PortNameChanged = 34
+	PortNameChanged = 34,
+	GraphTransaction = 35,
+	ReindexPort = 36,
+	SetConnectionGain = 37
 } RequestType;
 
+/* In the flags of a RegisterPort request: buffer_size is the capacity
+ * a MIDI port asked for with jack_midi_port_register(). Without it the
+ * size is ignored, as it always was for the built-in types. Never
+ * stored in the port's flags.
+ */
+#define JACK_PORT_REQUEST_CAPACITY 0x80000000U
+
+/* SetConnectionGain changes these, and always returns both. */
+#define JACK_CONNECTION_SET_GAIN 0x1
+#define JACK_CONNECTION_SET_MUTE 0x2
+
+/* One operation of a GraphTransaction request. The ops follow the
+ * request on the socket, and come back with status (and port_id for
+ * registrations) filled in.
+ */
+#define JACK_GRAPH_TXN_MAX 65536
+
+typedef struct {
+	uint32_t type;                  /* ConnectPorts, DisconnectPorts,
+					   DisconnectPort, RegisterPort or
+					   UnRegisterPort */
+	int32_t status;
+	jack_port_id_t port_id;
+	uint32_t flags;
+	jack_shmsize_t buffer_size;
+	char a[JACK_PORT_NAME_SIZE];    /* source port or port name */
+	char b[JACK_PORT_NAME_SIZE];    /* destination port or port type */
+} POST_PACKED_STRUCTURE jack_graph_op_t;
+
 struct _jack_request {
 
 	//RequestType type;
@@ -403,6 +492,13 @@ struct _jack_request {
 			char source_port[JACK_PORT_NAME_SIZE];
 			char destination_port[JACK_PORT_NAME_SIZE];
 		} POST_PACKED_STRUCTURE connect;
+		struct {
+			char source_port[JACK_PORT_NAME_SIZE];
+			char destination_port[JACK_PORT_NAME_SIZE];
+			uint32_t what;  /* JACK_CONNECTION_SET_*, or 0 to ask */
+			float gain;
+			int32_t mute;
+		} POST_PACKED_STRUCTURE connection_gain;
 		struct {
 			char path[JACK_PORT_NAME_SIZE];
 			jack_session_event_type_t type;
@@ -443,6 +539,11 @@ struct _jack_request {
 			size_t keylen;
 			const char* key; /* not delivered inline to server, see oop_client_deliver_request() */
 		} POST_PACKED_STRUCTURE property;
+		struct {
+			uint32_t nops;
+			jack_uuid_t client_id;
+			jack_graph_op_t *ops; /* not delivered inline to server, see oop_client_deliver_request() */
+		} POST_PACKED_STRUCTURE transaction;
 		jack_uuid_t client_id;
 		jack_nframes_t nframes;
 		jack_time_t timeout;
@@ -464,13 +565,26 @@ typedef struct _jack_client_internal {
 	int event_fd;
 	int subgraph_start_fd;
 	int subgraph_wait_fd;
+	int subgraph_start_slot;        /* graph_futex[] index for start_fd */
+	int subgraph_wait_slot;         /* graph_futex[] index for wait_fd */
+	int graph_slot;                 /* external clients: FIFOs and graph_futex[]
+					   words 2 * graph_slot (to start it) and
+					   2 * graph_slot + 1 (its own finish) */
 	JSList    *ports;       /* protected by engine->client_lock */
 	JSList    *truefeeds;   /* protected by engine->client_lock */
 	JSList    *sortfeeds;   /* protected by engine->client_lock */
 	int fedcount;
 	int tfedcount;
+	int sortfedcount;       /* scratch for jack_sort_graph() */
+	unsigned long sort_mark;        /* scratch for the feeds search */
+	int latency_mark;       /* scratch for jack_compute_new_latency() */
+	int runfedcount;        /* sortfeeds entries from clients that run */
+	int plan_index;         /* entry in the plan being built */
 	jack_shm_info_t control_shm;
 	unsigned long execution_order;
+	long reorder_order;             /* last GraphReordered sent, or -1 */
+	int reorder_upstream;
+	int reorder_next[2];            /* control->graph_next[] it was told about */
 	struct  _jack_client_internal *next_client;     /* not a linked list! */
 	dlhandle handle;
 	int (*initialize)(jack_client_t*, const char*); /* int. clients only */
@@ -501,6 +615,8 @@ typedef struct _jack_thread_arg {
 
 extern int  jack_client_handle_port_connection(jack_client_t *client,
 					       jack_event_t *event);
+extern int  jack_client_handle_connection_gain(jack_client_t *client,
+					       jack_event_t *event);
 extern jack_client_t *jack_driver_client_new(jack_engine_t *,
 					     const char *client_name);
 extern jack_client_t *jack_client_alloc_internal(jack_client_control_t*,
@@ -546,8 +662,104 @@ extern int jack_port_name_equals(jack_port_shared_t* port, const char* target);
  */
 extern size_t jack_midi_internal_event_size();
 
+/* Free the MIDI spills of a client whose process thread has stopped. */
+extern void jack_midi_free_spills(const jack_client_t *client);
+extern void jack_midi_spill_mark(jack_port_t *port, void *port_buffer);
+
 extern int jack_client_handle_latency_callback(jack_client_t *client, jack_event_t *event, int is_driver);
 
+/* Client API additions. Their public declarations belong in the
+ * <jack/...> headers, which are maintained in a separate repository.
+ */
+
+extern int jack_set_spin_wait(jack_client_t *client, int usecs);
+extern int jack_get_spin_wait_stats(jack_client_t *client,
+				    uint32_t *hits, uint32_t *misses);
+extern int jack_get_denormal_cycles(jack_client_t *client,
+				    uint32_t *client_cycles,
+				    uint32_t *server_cycles);
+
+typedef struct _jack_graph_txn jack_graph_txn_t;
+
+extern jack_graph_txn_t *jack_graph_txn_begin(jack_client_t *client);
+extern int jack_graph_txn_connect(jack_graph_txn_t *txn,
+				  const char *source_port,
+				  const char *destination_port);
+extern int jack_graph_txn_disconnect(jack_graph_txn_t *txn,
+				     const char *source_port,
+				     const char *destination_port);
+extern int jack_graph_txn_port_disconnect(jack_graph_txn_t *txn,
+					  jack_port_t *port);
+extern int jack_graph_txn_port_register(jack_graph_txn_t *txn,
+					const char *port_name,
+					const char *port_type,
+					unsigned long flags,
+					unsigned long buffer_size);
+extern int jack_graph_txn_port_unregister(jack_graph_txn_t *txn,
+					  jack_port_t *port);
+extern int jack_graph_txn_commit(jack_graph_txn_t *txn);
+extern int jack_graph_txn_status(jack_graph_txn_t *txn, int op);
+extern jack_port_t *jack_graph_txn_port(jack_graph_txn_t *txn, int op);
+extern void jack_graph_txn_free(jack_graph_txn_t *txn);
+
+/* Events of a MIDI port buffer in a range of frames. */
+typedef struct {
+	void *port_buffer;
+	uint32_t index;
+	uint32_t end;
+} jack_midi_iter_t;
+
+extern uint32_t jack_midi_event_index_at(void *port_buffer,
+					 jack_nframes_t time);
+extern int jack_midi_event_get_at(jack_midi_event_t *event,
+				  void *port_buffer, jack_nframes_t time);
+extern void jack_midi_iter_init(jack_midi_iter_t *iter, void *port_buffer,
+				jack_nframes_t start, jack_nframes_t end);
+extern int jack_midi_iter_next(jack_midi_iter_t *iter,
+			       jack_midi_event_t *event);
+
+extern jack_ringbuffer_t *jack_ringbuffer_create_padded(size_t sz);
+extern jack_ringbuffer_t *jack_ringbuffer_create_mirrored(size_t sz);
+extern jack_ringbuffer_t *jack_ringbuffer_create_mpsc(size_t sz);
+extern int jack_ringbuffer_mpsc_write(jack_ringbuffer_t *rb, const char *src,
+				      size_t cnt);
+extern ssize_t jack_ringbuffer_mpsc_read(jack_ringbuffer_t *rb, char *dest,
+					 size_t cnt);
+extern int jack_ringbuffer_wait_read(jack_ringbuffer_t *rb, size_t cnt,
+				     long timeout_usecs);
+extern int jack_ringbuffer_wait_write(jack_ringbuffer_t *rb, size_t cnt,
+				      long timeout_usecs);
+extern void *jack_ringbuffer_record_reserve(jack_ringbuffer_t *rb,
+					   size_t size);
+extern void jack_ringbuffer_record_commit(jack_ringbuffer_t *rb, size_t size);
+extern void *jack_ringbuffer_record_peek(jack_ringbuffer_t *rb, size_t *size);
+extern void jack_ringbuffer_record_consume(jack_ringbuffer_t *rb);
+
+extern int jack_port_set_silent(jack_port_t *port, jack_nframes_t nframes);
+extern int jack_port_is_silent(jack_port_t *port);
+
+extern jack_port_t *jack_midi_port_register(jack_client_t *client,
+					    const char *port_name,
+					    unsigned long flags,
+					    size_t capacity);
+extern int jack_midi_port_set_spill(jack_port_t *port, size_t bytes);
+extern int jack_midi_port_get_spill_depth(jack_port_t *port,
+					  uint32_t *depth,
+					  uint32_t *max_depth);
+
+extern int jack_connection_set_gain(jack_client_t *client,
+				    const char *source_port,
+				    const char *destination_port,
+				    float gain);
+extern int jack_connection_set_mute(jack_client_t *client,
+				    const char *source_port,
+				    const char *destination_port,
+				    int mute);
+extern int jack_connection_get_gain(jack_client_t *client,
+				    const char *source_port,
+				    const char *destination_port,
+				    float *gain, int *mute);
+
 #ifdef __GNUC__
 #  define likely(x)     __builtin_expect ((x), 1)
 #  define unlikely(x)   __builtin_expect ((x), 0)
@@ -23,14 +23,54 @@
 #ifdef USE_DYNSIMD
 #if (defined(__i386__) || defined(__x86_64__))
 #define ARCH_X86
+#elif defined(__aarch64__)
+#define ARCH_ARM64
 #endif  /* __i386__ || __x86_64__ */
 #endif  /* USE_DYNSIMD */
 
+/* Inputs summed per pass over a port's mix buffer. */
+#define JACK_MIX_FANIN 8
+
+/* The plain C kernels, in port.c. They are what every vector version
+ * is checked against.
+ */
+void gen_mixnf(float *, const float **, int, int, int);
+void gen_scalef(float *, const float *, int, float, float, int);
+
+#ifdef USE_DYNSIMD
+void gen_copyf(float *, const float *, int);
+void gen_mixf(float *, const float *, int);
+void gen_f2i(int *, const float *, int, float);
+void gen_i2f(float *, const int *, int, float);
+#endif  /* USE_DYNSIMD */
+
+#ifdef USE_DYNSIMD
+
+/* Sample kernels for this CPU, filled in by jack_port_set_funcs().
+ * Every entry is also implemented in plain C, and the vector versions
+ * give the same results, bit for bit.
+ */
+typedef struct {
+	void (*copyf)(float *, const float *, int);
+	void (*add2f)(float *, const float *, int);
+	void (*f2i)(int *, const float *, int, float);
+	void (*i2f)(float *, const int *, int, float);
+	void (*mixnf)(float *, const float **, int, int, int);
+	void (*scalef)(float *, const float *, int, float, float, int);
+} jack_simd_funcs_t;
+
+extern jack_simd_funcs_t jack_simd_funcs;
+
+#endif  /* USE_DYNSIMD */
+
 #ifdef ARCH_X86
 #define ARCH_X86_SSE(x)         ((x) & 0xff)
 #define ARCH_X86_HAVE_SSE2(x)   (ARCH_X86_SSE (x) >= 2)
-#define ARCH_X86_3DNOW(x)       ((x) >> 8)
+#define ARCH_X86_3DNOW(x)       (((x) >> 8) & 0xff)
 #define ARCH_X86_HAVE_3DNOW(x)  (ARCH_X86_3DNOW (x))
+#define ARCH_X86_AVX(x)         (((x) >> 16) & 0xff)
+#define ARCH_X86_HAVE_AVX2(x)   (ARCH_X86_AVX (x) >= 1)
+#define ARCH_X86_HAVE_AVX512(x) (ARCH_X86_AVX (x) >= 2)
 
 typedef float v2sf __attribute__((vector_size (8)));
 typedef float v4sf __attribute__((vector_size (16)));
@@ -47,9 +87,39 @@ void x86_sse_copyf(float *, const float *, int);
 void x86_sse_add2f(float *, const float *, int);
 void x86_sse_f2i(int *, const float *, int, float);
 void x86_sse_i2f(float *, const int *, int, float);
+void x86_sse_mixnf(float *, const float **, int, int, int);
+void x86_sse_scalef(float *, const float *, int, float, float, int);
+
+int have_avx(void);
+void x86_avx2_copyf(float *, const float *, int);
+void x86_avx2_add2f(float *, const float *, int);
+void x86_avx2_f2i(int *, const float *, int, float);
+void x86_avx2_i2f(float *, const int *, int, float);
+void x86_avx2_mixnf(float *, const float **, int, int, int);
+void x86_avx2_scalef(float *, const float *, int, float, float, int);
+void x86_avx512_copyf(float *, const float *, int);
+void x86_avx512_add2f(float *, const float *, int);
+void x86_avx512_f2i(int *, const float *, int, float);
+void x86_avx512_i2f(float *, const int *, int, float);
+void x86_avx512_mixnf(float *, const float **, int, int, int);
+void x86_avx512_scalef(float *, const float *, int, float, float, int);
 
 #endif /* ARCH_X86 */
 
+#ifdef ARCH_ARM64
+
+extern int cpu_type;
+
+int have_neon(void);
+void arm64_neon_copyf(float *, const float *, int);
+void arm64_neon_add2f(float *, const float *, int);
+void arm64_neon_f2i(int *, const float *, int, float);
+void arm64_neon_i2f(float *, const int *, int, float);
+void arm64_neon_mixnf(float *, const float **, int, int, int);
+void arm64_neon_scalef(float *, const float *, int, float, float, int);
+
+#endif /* ARCH_ARM64 */
+
 void jack_port_set_funcs(void);
 
 #endif /* __jack_intsimd_h__ */
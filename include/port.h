@@ -114,6 +114,21 @@ typedef struct _jack_port_shared {
 	char in_use;
 	char unused;                    /* legacy locked field */
 
+	/* Input ports fed by the same set of output ports share one
+	 * mix buffer, see jack_port_get_buffer(). mix_group is the id
+	 * of the port whose mix_* fields hold the shared state, or -1.
+	 */
+	int32_t mix_group __attribute__((aligned (4)));
+	jack_shmsize_t mix_offset;      /* shared mix buffer, if a leader */
+	volatile uint32_t mix_ready;    /* process_cycle summed in it */
+	volatile uint32_t mix_claim;    /* process_cycle being summed */
+
+	jack_shmsize_t buffer_size;     /* of a MIDI port, in bytes; else 0 */
+
+	/* process_cycle in which the owner declared the port's buffer
+	 * silent, see jack_port_set_silent(); 0 if never */
+	volatile uint32_t silent_cycle;
+
 } POST_PACKED_STRUCTURE jack_port_shared_t;
 
 typedef struct _jack_port_functions {
@@ -151,9 +166,12 @@ struct _jack_port {
 	jack_port_type_info_t    *type_info;    /* shared memory type info */
 	struct _jack_port_shared *shared;       /* corresponding shm struct */
 	struct _jack_port        *tied;         /* locally tied source port */
+	const jack_client_t      *client;       /* client that made this */
 	jack_port_functions_t fptr;
 	pthread_mutex_t connection_lock;
 	JSList                   *connections;
+	int gain_slot;                          /* for a connection, or -1 */
+	uint32_t mix_cycle;                     /* process_cycle of last mixdown */
 };
 
 /*  Inline would be cleaner, but it needs to be fast even in
@@ -168,6 +186,7 @@ struct _jack_port {
 
 /* not for use by JACK applications */
 size_t jack_port_type_buffer_size(jack_port_type_info_t* port_type_info, jack_nframes_t nframes);
+size_t jack_port_buffer_size(jack_port_t *port, jack_nframes_t nframes);
 
 #endif /* __jack_port_h__ */
 
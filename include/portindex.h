@@ -0,0 +1,187 @@
+/*
+    Copyright (C) 2026 the JACK developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ */
+
+#ifndef __jack_portindex_h__
+#define __jack_portindex_h__
+
+/* Port name index, kept in the engine control segment right after
+ * ports[port_max]. It maps the name and both aliases of every port
+ * in use to the port id, using open addressing with linear probing.
+ *
+ * Only the server writes it, with the port_lock held, and brackets
+ * every change with port_index_seq (odd while a change is in
+ * progress). Readers do not lock: they probe, then check that the
+ * sequence number did not move. A candidate is always verified
+ * against the port itself, so a hash collision or a name that a
+ * client changed behind the server's back can cause a miss at
+ * worst, never a wrong port.
+ *
+ * Include after internal.h.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define JACK_PORT_INDEX_EMPTY   0               /* ends a probe chain */
+#define JACK_PORT_INDEX_DELETED 0xffffffffU     /* does not end it */
+#define JACK_PORT_INDEX_RETRIES 16
+
+typedef struct {
+	uint32_t hash;
+	uint32_t id;            /* port id + 1, or EMPTY or DELETED */
+} jack_port_index_slot_t;
+
+/* Slots for up to three keys per port at a load factor of 1/2. */
+static inline uint32_t
+jack_port_index_size (uint32_t port_max)
+{
+	uint32_t size = 16;
+
+	while (size < port_max * 6) {
+		size <<= 1;
+	}
+
+	return size;
+}
+
+/* Bytes to reserve after ports[port_max] in the control segment. */
+static inline size_t
+jack_port_index_bytes (uint32_t port_max)
+{
+	return sizeof(jack_port_index_slot_t) * jack_port_index_size (port_max)
+	       + sizeof(jack_port_index_slot_t);
+}
+
+static inline jack_port_index_slot_t *
+jack_port_index_slots (jack_control_t *control)
+{
+	uintptr_t addr = (uintptr_t)&control->ports[control->port_max];
+
+	/* the control segment is page aligned in every process, so
+	   rounding the address gives the same offset everywhere */
+	addr = (addr + sizeof(jack_port_index_slot_t) - 1)
+	       & ~(uintptr_t)(sizeof(jack_port_index_slot_t) - 1);
+
+	return (jack_port_index_slot_t*)addr;
+}
+
+/* FNV-1a. Never returns 0, so that a zeroed slot cannot match. */
+static inline uint32_t
+jack_port_index_hash (const char *key)
+{
+	uint32_t h = 2166136261U;
+
+	while (*key) {
+		h ^= (unsigned char)*key++;
+		h *= 16777619U;
+	}
+
+	return h ? h : 1;
+}
+
+/* Hash a name the way jack_port_name_equals() will compare it. */
+static inline uint32_t
+jack_port_index_key_hash (const char *name)
+{
+	char buf[JACK_PORT_NAME_SIZE + 1];
+
+	if (strncmp (name, "ALSA:capture", 12) == 0
+	    || strncmp (name, "ALSA:playback", 13) == 0) {
+		snprintf (buf, sizeof(buf), "alsa_pcm%s", name + 4);
+		name = buf;
+	}
+
+	return jack_port_index_hash (name);
+}
+
+/* Find the lowest numbered port in use whose name or alias is
+ * `name', as a linear scan would. Returns 1 and sets *id if found, 0
+ * if not, and -1 if there is no index or it was changing too fast to
+ * read, in which case the caller should scan.
+ */
+static inline int
+jack_port_index_lookup (jack_control_t *control, const char *name,
+			jack_port_id_t *id)
+{
+	jack_port_index_slot_t *slots;
+	jack_port_shared_t *port;
+	uint32_t size, mask, hash, seq, i, n, v;
+	int tries, found;
+
+	if ((size = control->port_index_size) == 0) {
+		return -1;
+	}
+
+	slots = jack_port_index_slots (control);
+	mask = size - 1;
+	hash = jack_port_index_key_hash (name);
+
+	for (tries = 0; tries < JACK_PORT_INDEX_RETRIES; tries++) {
+
+		seq = __atomic_load_n (&control->port_index_seq,
+				       __ATOMIC_ACQUIRE);
+
+		if (seq & 1) {
+			continue;
+		}
+
+		found = 0;
+
+		for (i = hash & mask, n = 0; n < size; i = (i + 1) & mask, n++) {
+
+			v = __atomic_load_n (&slots[i].id, __ATOMIC_RELAXED);
+
+			if (v == JACK_PORT_INDEX_EMPTY) {
+				break;
+			}
+
+			if (v == JACK_PORT_INDEX_DELETED
+			    || v > control->port_max
+			    || __atomic_load_n (&slots[i].hash,
+						__ATOMIC_RELAXED) != hash) {
+				continue;
+			}
+
+			v--;
+
+			if (found && v >= *id) {
+				continue;
+			}
+
+			port = &control->ports[v];
+
+			if (port->in_use && jack_port_name_equals (port, name)) {
+				*id = v;
+				found = 1;
+			}
+		}
+
+		__atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n (&control->port_index_seq,
+				     __ATOMIC_RELAXED) == seq) {
+			return found;
+		}
+	}
+
+	return -1;
+}
+
+#endif /* __jack_portindex_h__ */
@@ -17,7 +17,9 @@
  * segment name (instead of NAME_MAX or PATH_MAX as defined by the
  * standard).
  */
-#ifdef USE_POSIX_SHM
+#if defined(USE_MEMFD_SHM)
+typedef int jack_shm_id_t;              /* memfd, local to a process */
+#elif defined(USE_POSIX_SHM)
 #ifndef SHM_NAME_MAX
 #define SHM_NAME_MAX NAME_MAX
 #endif
@@ -79,6 +81,10 @@ typedef struct _jack_shm_registry {
 typedef struct _jack_shm_info {
 	jack_shm_registry_index_t index;        /* offset into the registry */
 	void                     *attached_at;  /* address where attached */
+#ifdef USE_MEMFD_SHM
+	int                       fd;           /* memfd until attached */
+	jack_shmsize_t            size;         /* for munmap */
+#endif
 } jack_shm_info_t;
 
 /* utility functions used only within JACK */
@@ -108,4 +114,9 @@ extern void jack_destroy_shm(jack_shm_info_t*);
 extern int  jack_attach_shm(jack_shm_info_t*);
 extern int  jack_resize_shm(jack_shm_info_t*, jack_shmsize_t size);
 
+#ifdef USE_MEMFD_SHM
+extern int  jack_shm_send(int sock, jack_shm_registry_index_t index);
+extern int  jack_shm_recv(int sock, jack_shm_info_t* si);
+#endif
+
 #endif /* __jack_shm_h__ */
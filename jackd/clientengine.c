@@ -230,6 +230,11 @@ jack_remove_client (jack_engine_t *engine, jack_client_internal_t *client)
 
 	VERBOSE (engine, "after: client list contains %d", jack_slist_length (engine->clients));
 
+	/* drop the client from the execution plan before it goes away,
+	   and wait until no cycle can still be running an older one */
+	jack_engine_publish_plan (engine);
+	jack_engine_retire_plans (engine, TRUE);
+
 	jack_client_delete (engine, client);
 
 	if (engine->temporary) {
@@ -270,13 +275,20 @@ jack_check_clients (jack_engine_t* engine, int with_timeout_check)
 {
 	/* CALLER MUST HOLD graph read lock */
 
-	JSList* node;
+	jack_graph_plan_t *plan;
 	jack_client_internal_t* client;
+	unsigned int i;
 	int errs = 0;
 
-	for (node = engine->clients; node; node = jack_slist_next (node)) {
+	/* the process thread calls this too, so go by the plan: it
+	   has the same clients as the client list, which the server
+	   thread may be sorting */
 
-		client = (jack_client_internal_t*)node->data;
+	plan = __atomic_load_n (&engine->plan, __ATOMIC_ACQUIRE);
+
+	for (i = 0; plan && i < plan->nentries; i++) {
+
+		client = plan->entries[i].client;
 
 		if (client->error) {
 			VERBOSE (engine, "client %s already marked with error = %d\n", client->control->name, client->error);
@@ -577,7 +589,19 @@ jack_setup_client_control (jack_engine_t *engine, int fd, ClientType type, const
 	client->ports = 0;
 	client->truefeeds = 0;
 	client->sortfeeds = 0;
+	client->fedcount = 0;
+	client->tfedcount = 0;
+	client->sortfedcount = 0;
+	client->sort_mark = 0;
+	client->latency_mark = 0;
+	client->runfedcount = 0;
+	client->plan_index = 0;
 	client->execution_order = UINT_MAX;
+	client->reorder_order = -1;
+	client->reorder_upstream = 0;
+	client->reorder_next[0] = -1;
+	client->reorder_next[1] = -1;
+	client->graph_slot = -1;
 	client->next_client = NULL;
 	client->handle = NULL;
 	client->finish = NULL;
@@ -625,6 +649,17 @@ jack_setup_client_control (jack_engine_t *engine, int fd, ClientType type, const
 	strcpy ((char*)client->control->name, name);
 	client->subgraph_start_fd = -1;
 	client->subgraph_wait_fd = -1;
+	client->subgraph_start_slot = -1;
+	client->subgraph_wait_slot = -1;
+	client->control->wait_slot = -1;
+	client->control->graph_next[0] = -1;
+	client->control->graph_next[1] = -1;
+	client->control->futex_capable = FALSE;
+	client->control->futex_wakeup = FALSE;
+	client->control->event_pending = FALSE;
+	client->control->spin_hits = 0;
+	client->control->spin_misses = 0;
+	client->control->denormal_cycles = 0;
 
 	client->session_reply_pending = FALSE;
 
@@ -694,6 +729,29 @@ jack_ensure_uuid_unique (jack_engine_t *engine, jack_uuid_t uuid)
 	jack_unlock_graph (engine);
 }
 
+/* The lowest graph slot that no other client has. An external client
+ * keeps its slot, and so the FIFOs it waits on, for as long as it
+ * lives.
+ */
+static int
+jack_client_alloc_graph_slot (jack_engine_t *engine)
+{
+	/* caller must hold the graph lock */
+	JSList *node;
+	int slot;
+
+	for (slot = 0;; slot++) {
+		for (node = engine->clients; node; node = jack_slist_next (node)) {
+			if (((jack_client_internal_t*)node->data)->graph_slot == slot) {
+				break;
+			}
+		}
+		if (node == NULL) {
+			return slot;
+		}
+	}
+}
+
 /* set up all types of clients */
 static jack_client_internal_t *
 setup_client (jack_engine_t *engine, ClientType type, char *name,
@@ -756,13 +814,26 @@ setup_client (jack_engine_t *engine, ClientType type, char *name,
 
 		client->private_client->deliver_request = internal_client_request;
 		client->private_client->deliver_arg = engine;
+
+		/* the connection lists of its ports come from the
+		 * execution plan */
+		client->private_client->engine_connections = TRUE;
 	}
 
 	/* add new client to the clients list */
 	jack_lock_graph (engine);
+
+	if (!jack_client_is_internal (client)) {
+		client->graph_slot = jack_client_alloc_graph_slot (engine);
+		jack_clear_graph_slot (engine, client->graph_slot);
+	}
+
 	engine->clients = jack_slist_prepend (engine->clients, client);
 	jack_engine_reset_rolling_usecs (engine);
 
+	/* keep the plan's clients the same as the list's */
+	jack_engine_publish_plan (engine);
+
 	if (jack_client_is_internal (client)) {
 
 
@@ -872,8 +943,10 @@ jack_client_create (jack_engine_t *engine, int client_fd)
 	jack_client_connect_request_t req;
 	jack_client_connect_result_t res;
 	ssize_t nbytes;
+	int failed;
 
 	res.status = 0;
+	res.shm_fds = 0;
 
 	VALGRIND_MEMSET (&res, 0, sizeof(res));
 
@@ -953,9 +1026,22 @@ jack_client_create (jack_engine_t *engine, int client_fd)
 		res.engine_control = (uint64_t)((intptr_t)engine->control);
 	} else {
 		strcpy (res.fifo_prefix, engine->fifo_prefix);
+#ifdef USE_MEMFD_SHM
+		res.shm_fds = 2;
+#endif
 	}
 
-	if (write (client_fd, &res, sizeof(res)) != sizeof(res)) {
+	failed = (write (client_fd, &res, sizeof(res)) != sizeof(res));
+
+#ifdef USE_MEMFD_SHM
+	/* the client attaches these before anything else */
+	if (!failed && res.shm_fds) {
+		failed = jack_shm_send (client_fd, engine->control_shm.index)
+			 || jack_shm_send (client_fd, client->control_shm.index);
+	}
+#endif
+
+	if (failed) {
 		jack_error ("cannot write connection response to client");
 		jack_lock_graph (engine);
 		client->control->dead = 1;
@@ -991,14 +1077,10 @@ jack_client_activate (jack_engine_t *engine, jack_uuid_t id)
 
 		jack_transport_activate (engine, client);
 
-		/* we call this to make sure the FIFO is
-		 * built+ready by the time the client needs
-		 * it. we don't care about the return value at
-		 * this point.
-		 */
+		/* its FIFOs were made along with its graph
+		 * slot, when it was created */
 
-		jack_get_fifo_fd (engine,
-				  ++engine->external_client_cnt);
+		++engine->external_client_cnt;
 		jack_sort_graph (engine);
 
 
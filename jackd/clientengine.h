@@ -27,6 +27,15 @@ jack_client_is_internal (jack_client_internal_t *client)
 	       (client->control->type == ClientDriver);
 }
 
+/* true if the client takes part in the process cycle */
+static inline int
+jack_client_runs (jack_client_internal_t *client)
+{
+	return client->control->active &&
+	       (client->control->process_cbset ||
+		client->control->thread_cb_cbset);
+}
+
 static inline char *
 jack_client_state_name (jack_client_internal_t *client)
 {
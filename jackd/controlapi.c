@@ -116,6 +116,26 @@ struct jackctl_server {
 	/* int, timeout thres... */
 	union jackctl_parameter_value timothres;
 	union jackctl_parameter_value default_timothres;
+
+	/* bool, run independent clients concurrently */
+	union jackctl_parameter_value parallel;
+	union jackctl_parameter_value default_parallel;
+
+	/* bool, wake clients through futexes instead of FIFOs */
+	union jackctl_parameter_value futex_wakeup;
+	union jackctl_parameter_value default_futex_wakeup;
+
+	/* uint32_t, how long clients may spin before blocking */
+	union jackctl_parameter_value spin_usecs;
+	union jackctl_parameter_value default_spin_usecs;
+
+	/* bool, flush denormals to zero in process threads */
+	union jackctl_parameter_value flush_denormals;
+	union jackctl_parameter_value default_flush_denormals;
+
+	/* uint32_t, percent of the base MIDI buffers' room for larger ones */
+	union jackctl_parameter_value midi_class_budget;
+	union jackctl_parameter_value default_midi_class_budget;
 };
 
 struct jackctl_driver {
@@ -1049,6 +1069,76 @@ jackctl_server_t * jackctl_server_create (
 		goto fail_free_parameters;
 	}
 
+	value.b = false;
+	if (jackctl_add_parameter (
+		    &server_ptr->parameters,
+		    '\0',
+		    "parallel",
+		    "Run independent clients in parallel",
+		    "",
+		    JackParamBool,
+		    &server_ptr->parallel,
+		    &server_ptr->default_parallel,
+		    value, NULL) == NULL) {
+		goto fail_free_parameters;
+	}
+
+	value.b = false;
+	if (jackctl_add_parameter (
+		    &server_ptr->parameters,
+		    '\0',
+		    "futex-wakeup",
+		    "Wake clients through futexes instead of FIFOs",
+		    "",
+		    JackParamBool,
+		    &server_ptr->futex_wakeup,
+		    &server_ptr->default_futex_wakeup,
+		    value, NULL) == NULL) {
+		goto fail_free_parameters;
+	}
+
+	value.ui = 0;
+	if (jackctl_add_parameter (
+		    &server_ptr->parameters,
+		    'W',
+		    "spin-usecs",
+		    "Microseconds clients may spin before blocking",
+		    "",
+		    JackParamUInt,
+		    &server_ptr->spin_usecs,
+		    &server_ptr->default_spin_usecs,
+		    value, NULL) == NULL) {
+		goto fail_free_parameters;
+	}
+
+	value.b = false;
+	if (jackctl_add_parameter (
+		    &server_ptr->parameters,
+		    '\0',
+		    "flush-denormals",
+		    "Flush denormals to zero in process threads",
+		    "",
+		    JackParamBool,
+		    &server_ptr->flush_denormals,
+		    &server_ptr->default_flush_denormals,
+		    value, NULL) == NULL) {
+		goto fail_free_parameters;
+	}
+
+	value.ui = 25;
+	if (jackctl_add_parameter (
+		    &server_ptr->parameters,
+		    '\0',
+		    "midi-class-budget",
+		    "Percent of the MIDI port buffer space to add for larger buffers",
+		    "",
+		    JackParamUInt,
+		    &server_ptr->midi_class_budget,
+		    &server_ptr->default_midi_class_budget,
+		    value, NULL) == NULL) {
+		goto fail_free_parameters;
+	}
+
 	//TODO: need
 	//JackServerGlobals::on_device_acquire = on_device_acquire;
 	//JackServerGlobals::on_device_release = on_device_release;
@@ -1154,7 +1244,11 @@ jackctl_server_start (
 						   server_ptr->do_mlock.b, server_ptr->do_unlock.b, server_ptr->name.str,
 						   server_ptr->temporary.b, server_ptr->verbose.b, server_ptr->client_timeout.i,
 						   server_ptr->port_max.i, getpid (), frame_time_offset,
-						   server_ptr->nozombies.b, server_ptr->timothres.ui, drivers)) == 0) {
+						   server_ptr->nozombies.b, server_ptr->timothres.ui,
+						   server_ptr->parallel.b, server_ptr->futex_wakeup.b,
+						   server_ptr->spin_usecs.ui,
+						   server_ptr->flush_denormals.b,
+						   server_ptr->midi_class_budget.ui, drivers)) == 0) {
 		jack_error ("cannot create engine");
 		goto fail_unregister;
 	}
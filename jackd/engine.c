@@ -48,6 +48,9 @@
 #include "messagebuffer.h"
 #include "driver.h"
 #include "shm.h"
+#include "futex.h"
+#include "portindex.h"
+#include "denormals.h"
 
 #include <sysdeps/poll.h>
 #include <sysdeps/ipc.h>
@@ -74,6 +77,7 @@ typedef struct {
 	signed int dir; /* -1 = feedback, 0 = self, 1 = forward */
 	jack_client_internal_t *srcclient;
 	jack_client_internal_t *dstclient;
+	int gain_slot;          /* jack_connection_gain() slot, or -1 */
 } jack_connection_internal_t;
 
 typedef struct _jack_driver_info {
@@ -86,10 +90,14 @@ typedef struct _jack_driver_info {
 jack_timer_type_t clock_source = JACK_TIMER_SYSTEM_CLOCK;
 
 static int      jack_port_assign_buffer(jack_engine_t *,
-					jack_port_internal_t *);
+					jack_port_internal_t *,
+					jack_shmsize_t request);
 static jack_port_internal_t *jack_get_port_by_name(jack_engine_t *,
 						   const char *name);
 static int  jack_rechain_graph(jack_engine_t *engine);
+static void jack_plan_free(jack_graph_plan_t *plan);
+static int  jack_engine_enter_plan_cycle(jack_engine_t *engine);
+static void jack_engine_end_cycle(jack_engine_t *engine, int locked);
 static void jack_clear_fifos(jack_engine_t *engine);
 static int  jack_port_do_connect(jack_engine_t *engine,
 				 const char *source_port,
@@ -100,6 +108,19 @@ static int  jack_port_do_disconnect(jack_engine_t *engine,
 static int  jack_port_do_disconnect_all(jack_engine_t *engine,
 					jack_port_id_t);
 static int  jack_port_do_unregister(jack_engine_t *engine, jack_request_t *);
+static int  jack_port_do_reindex(jack_engine_t *engine, jack_request_t *);
+static int  jack_port_do_connection_gain(jack_engine_t *engine,
+					 jack_request_t *);
+static int  jack_port_slots_init(jack_engine_t *engine);
+static void jack_update_mix_groups(jack_engine_t *engine,
+				   jack_port_internal_t *src,
+				   jack_port_internal_t *dst);
+static void jack_port_leave_mix_group(jack_engine_t *engine,
+				      jack_port_internal_t *port);
+static void jack_port_dissolve_mix_group(jack_engine_t *engine,
+					 jack_port_internal_t *port);
+static int  jack_do_graph_transaction(jack_engine_t *engine,
+				      jack_request_t *req, int internal);
 static int  jack_port_do_register(jack_engine_t *engine, jack_request_t *, int);
 static int  jack_do_get_port_connections(jack_engine_t *engine,
 					 jack_request_t *req, int reply_fd);
@@ -129,8 +150,6 @@ static void jack_engine_driver_exit(jack_engine_t* engine);
 static int  jack_start_freewheeling(jack_engine_t* engine, jack_uuid_t);
 static int jack_client_feeds_transitive(jack_client_internal_t *source,
 					jack_client_internal_t *dest);
-static int jack_client_sort(jack_client_internal_t *a,
-			    jack_client_internal_t *b);
 static void jack_check_acyclic(jack_engine_t* engine);
 static void jack_compute_all_port_total_latencies(jack_engine_t *engine);
 static void jack_compute_port_total_latency(jack_engine_t *engine, jack_port_shared_t*);
@@ -141,7 +160,9 @@ static void jack_do_get_client_by_uuid(jack_engine_t *engine, jack_request_t *re
 static void jack_do_get_uuid_by_client_name(jack_engine_t *engine, jack_request_t *req);
 static void jack_do_reserve_name(jack_engine_t *engine, jack_request_t *req);
 static void jack_do_session_reply(jack_engine_t *engine, jack_request_t *req );
-static void jack_compute_new_latency(jack_engine_t *engine);
+static void jack_compute_new_latency(jack_engine_t *engine,
+				     jack_client_internal_t *src,
+				     jack_client_internal_t *dst);
 static int jack_do_has_session_cb(jack_engine_t *engine, jack_request_t *req);
 
 static inline int
@@ -184,6 +205,40 @@ jack_port_buffer_list (jack_engine_t *engine, jack_port_internal_t *port)
 	return &engine->port_buffers[port->shared->ptype_id];
 }
 
+static inline JSList **
+jack_port_buffer_freelist (jack_port_buffer_list_t *blist, int size_class)
+{
+	return size_class ? &blist->class_freelist[size_class - 1]
+	       : &blist->freelist;
+}
+
+/* Only MIDI ports have buffers of more than one size. */
+static inline int
+jack_port_type_has_classes (jack_port_type_id_t ptid)
+{
+	return ptid == JACK_MIDI_PORT_TYPE;
+}
+
+/* Buffers of size class c in a segment for nports ports. The larger
+ * classes share a budget of engine->midi_class_budget percent of the
+ * bytes in the base class, split evenly between them; a class gets as
+ * many buffers as fit in its share, which may be none.
+ */
+static unsigned long
+jack_port_class_buffers (jack_engine_t *engine, jack_port_type_id_t ptid,
+			 unsigned long nports, int c)
+{
+	if (c == 0) {
+		return nports;
+	}
+	if (!jack_port_type_has_classes (ptid)) {
+		return 0;
+	}
+
+	return (nports * engine->midi_class_budget)
+	       / (100UL * (JACK_PORT_SIZE_CLASSES - 1) << (2 * c));
+}
+
 static int
 make_directory (const char *path)
 {
@@ -364,6 +419,13 @@ jack_engine_place_port_buffers (jack_engine_t* engine,
 	jack_port_buffer_info_t *bi;
 	jack_port_buffer_list_t* pti = &engine->port_buffers[ptid];
 	jack_port_functions_t *pfuncs = jack_get_port_functions (ptid);
+	unsigned long nbuffers = 0;
+	unsigned long n;
+	int c;
+
+	for (c = 0; c < JACK_PORT_SIZE_CLASSES; c++) {
+		nbuffers += jack_port_class_buffers (engine, ptid, nports, c);
+	}
 
 	pthread_mutex_lock (&pti->lock);
 	offset = 0;
@@ -373,15 +435,19 @@ jack_engine_place_port_buffers (jack_engine_t* engine,
 		/* Buffer info array already allocated for this port
 		 * type.  This must be a resize operation, so
 		 * recompute the buffer offsets, but leave the free
-		 * list alone.
+		 * lists alone.
 		 */
 		int i;
 
 		bi = pti->info;
-		while (offset < size) {
-			bi->offset = offset;
-			offset += one_buffer;
-			++bi;
+		for (c = 0; c < JACK_PORT_SIZE_CLASSES; c++) {
+			for (n = jack_port_class_buffers (engine, ptid, nports, c);
+			     n > 0; n--) {
+				bi->offset = offset;
+				bi->size = one_buffer << (2 * c);
+				offset += bi->size;
+				++bi;
+			}
 		}
 
 		/* update any existing output port offsets */
@@ -397,22 +463,37 @@ jack_engine_place_port_buffers (jack_engine_t* engine,
 			}
 		}
 
+		/* and shared mix buffers */
+		for (i = 0; i < engine->port_max; i++) {
+			bi = engine->internal_ports[i].mix_buffer_info;
+			if (bi && engine->control->ports[i].ptype_id == ptid) {
+				engine->control->ports[i].mix_offset = bi->offset;
+			}
+		}
+
 	} else {
 		jack_port_type_info_t* port_type = &engine->control->port_types[ptid];
 
 		/* Allocate an array of buffer info structures for all
 		 * the buffers in the segment.  Chain them to the free
-		 * list in memory address order, offset zero must come
+		 * lists in memory address order, offset zero must come
 		 * first.
 		 */
 		bi = pti->info = (jack_port_buffer_info_t*)
-				 malloc (nports * sizeof(jack_port_buffer_info_t));
-
-		while (offset < size) {
-			bi->offset = offset;
-			pti->freelist = jack_slist_append (pti->freelist, bi);
-			offset += one_buffer;
-			++bi;
+				 malloc (nbuffers * sizeof(jack_port_buffer_info_t));
+		pti->nbuffers = nbuffers;
+
+		for (c = 0; c < JACK_PORT_SIZE_CLASSES; c++) {
+			JSList **freelist = jack_port_buffer_freelist (pti, c);
+			for (n = jack_port_class_buffers (engine, ptid, nports, c);
+			     n > 0; n--) {
+				bi->offset = offset;
+				bi->size = one_buffer << (2 * c);
+				bi->size_class = c;
+				*freelist = jack_slist_append (*freelist, bi);
+				offset += bi->size;
+				++bi;
+			}
 		}
 
 		/* Allocate the first buffer of the port segment
@@ -434,8 +515,8 @@ jack_engine_place_port_buffers (jack_engine_t* engine,
 		char* shm_segment = (char*)jack_shm_addr (shm_info);
 
 		bi = pti->info;
-		for (i = 0; i < nports; ++i, ++bi)
-			pfuncs->buffer_init (shm_segment + bi->offset, one_buffer, nframes);
+		for (i = 0; i < nbuffers; ++i, ++bi)
+			pfuncs->buffer_init (shm_segment + bi->offset, bi->size, nframes);
 	}
 
 	pthread_mutex_unlock (&pti->lock);
@@ -452,11 +533,16 @@ jack_resize_port_segment (jack_engine_t *engine,
 	jack_shmsize_t size;            /* segment size */
 	jack_port_type_info_t* port_type = &engine->control->port_types[ptid];
 	jack_shm_info_t* shm_info = &engine->port_segment[ptid];
+	int c;
 
 	one_buffer = jack_port_type_buffer_size (port_type, engine->control->buffer_size);
 	VERBOSE (engine, "resizing port buffer segment for type %d, one buffer = %u bytes", ptid, one_buffer);
 
-	size = nports * one_buffer;
+	size = 0;
+	for (c = 0; c < JACK_PORT_SIZE_CLASSES; c++) {
+		size += jack_port_class_buffers (engine, ptid, nports, c)
+			* (one_buffer << (2 * c));
+	}
 
 	if (shm_info->attached_at == 0) {
 
@@ -474,9 +560,6 @@ jack_resize_port_segment (jack_engine_t *engine,
 			return -1;
 		}
 
-		engine->control->port_types[ptid].shm_registry_index =
-			shm_info->index;
-
 	} else {
 
 		/* resize existing buffer segment */
@@ -488,6 +571,10 @@ jack_resize_port_segment (jack_engine_t *engine,
 		}
 	}
 
+	/* the new segment need not have the old one's index */
+	engine->control->port_types[ptid].shm_registry_index =
+		shm_info->index;
+
 	jack_engine_place_port_buffers (engine, ptid, one_buffer, size, nports, engine->control->buffer_size);
 
 #ifdef USE_MLOCK
@@ -578,15 +665,12 @@ jack_set_buffer_size_request (jack_engine_t *engine, jack_nframes_t nframes)
 }
 
 
-static JSList *
-jack_process_internal (jack_engine_t *engine, JSList *node,
-		       jack_nframes_t nframes)
+static void
+jack_call_internal_process (jack_engine_t *engine,
+			    jack_client_internal_t *client,
+			    jack_nframes_t nframes)
 {
-	jack_client_internal_t *client;
-	jack_client_control_t *ctl;
-
-	client = (jack_client_internal_t*)node->data;
-	ctl = client->control;
+	jack_client_control_t *ctl = client->control;
 
 	/* internal client */
 
@@ -612,12 +696,6 @@ jack_process_internal (jack_engine_t *engine, JSList *node,
 	}
 
 	ctl->state = Finished;
-
-	if (engine->process_errors) {
-		return NULL;            /* will stop the loop */
-	} else {
-		return jack_slist_next (node);
-	}
 }
 
 #ifdef __linux
@@ -657,14 +735,12 @@ linux_poll_bug_encountered (jack_engine_t* engine, jack_time_t then, jack_time_t
 #endif
 
 #ifdef JACK_USE_MACH_THREADS
-static JSList *
-jack_process_external (jack_engine_t *engine, JSList *node)
+static unsigned int
+jack_process_external (jack_engine_t *engine, jack_graph_plan_t *plan,
+		       unsigned int i)
 {
-	jack_client_internal_t * client = (jack_client_internal_t*)node->data;
-	jack_client_control_t *ctl;
-
-	client = (jack_client_internal_t*)node->data;
-	ctl = client->control;
+	jack_client_internal_t *client = plan->entries[i].client;
+	jack_client_control_t *ctl = client->control;
 
 	engine->current_client = client;
 
@@ -677,26 +753,24 @@ jack_process_external (jack_engine_t *engine, JSList *node)
 		ctl->state = Finished;
 	}
 
-	return jack_slist_next (node);
+	return i + 1;
 }
 #else /* !JACK_USE_MACH_THREADS */
-static JSList *
-jack_process_external (jack_engine_t *engine, JSList *node)
+static unsigned int
+jack_process_external (jack_engine_t *engine, jack_graph_plan_t *plan,
+		       unsigned int i)
 {
 	int status = 0;
 	char c = 0;
 	struct pollfd pfd[1];
 	int poll_timeout;
 	jack_time_t poll_timeout_usecs;
-	jack_client_internal_t *client;
-	jack_client_control_t *ctl;
+	jack_plan_entry_t *entry = &plan->entries[i];
+	jack_client_internal_t *client = entry->client;
+	jack_client_control_t *ctl = client->control;
 	jack_time_t now, then;
 	int pollret;
 
-	client = (jack_client_internal_t*)node->data;
-
-	ctl = client->control;
-
 	/* external subgraph */
 
 	/* a race exists if we do this after the write(2) */
@@ -707,14 +781,14 @@ jack_process_external (jack_engine_t *engine, JSList *node)
 	engine->current_client = client;
 
 	DEBUG ("calling process() on an external subgraph, fd==%d",
-	       client->subgraph_start_fd);
+	       entry->start_fd);
 
-	if (write (client->subgraph_start_fd, &c, sizeof(c)) != sizeof(c)) {
+	if (write (entry->start_fd, &c, sizeof(c)) != sizeof(c)) {
 		jack_error ("cannot initiate graph processing (%s)",
 			    strerror (errno));
 		engine->process_errors++;
 		jack_engine_signal_problems (engine);
-		return NULL; /* will stop the loop */
+		return plan->nentries; /* will stop the loop */
 	}
 
 	then = jack_get_microseconds ();
@@ -729,11 +803,11 @@ jack_process_external (jack_engine_t *engine, JSList *node)
 
 again:
 	poll_timeout = 1 + poll_timeout_usecs / 1000;
-	pfd[0].fd = client->subgraph_wait_fd;
+	pfd[0].fd = entry->wait_fd;
 	pfd[0].events = POLLERR | POLLIN | POLLHUP | POLLNVAL;
 
 	DEBUG ("waiting on fd==%d for process() subgraph to finish (timeout = %d, period_usecs = %d)",
-	       client->subgraph_wait_fd, poll_timeout, engine->driver->period_usecs);
+	       entry->wait_fd, poll_timeout, engine->driver->period_usecs);
 
 	if ((pollret = poll (pfd, 1, poll_timeout)) < 0) {
 		jack_error ("poll on subgraph processing failed (%s)",
@@ -761,7 +835,7 @@ again:
 
 		if (engine->freewheeling) {
 			if (jack_check_client_status (engine)) {
-				return NULL;
+				return plan->nentries;
 			} else {
 				/* all clients are fine - we're just not done yet. since
 				   we're freewheeling, that is fine.
@@ -783,7 +857,7 @@ again:
 		jack_error ("subgraph starting at %s timed out "
 			    "(subgraph_wait_fd=%d, status = %d, state = %s, pollret = %d revents = 0x%x)",
 			    client->control->name,
-			    client->subgraph_wait_fd, status,
+			    entry->wait_fd, status,
 			    jack_client_state_name (client),
 			    pollret, pfd[0].revents);
 		status = 1;
@@ -801,7 +875,7 @@ again:
 			 " awa = %" PRIu64 " fin = %" PRIu64
 			 " dur=%" PRIu64,
 			 now,
-			 client->subgraph_wait_fd,
+			 entry->wait_fd,
 			 now - then,
 			 status,
 			 ctl->signalled_at,
@@ -813,17 +887,16 @@ again:
 		if (jack_check_clients (engine, 1)) {
 
 			engine->process_errors++;
-			return NULL;            /* will stop the loop */
+			return plan->nentries;  /* will stop the loop */
 		}
 	} else {
 		engine->timeout_count = 0;
 	}
 
 
-	DEBUG ("reading byte from subgraph_wait_fd==%d",
-	       client->subgraph_wait_fd);
+	DEBUG ("reading byte from subgraph_wait_fd==%d", entry->wait_fd);
 
-	if (read (client->subgraph_wait_fd, &c, sizeof(c)) != sizeof(c)) {
+	if (read (entry->wait_fd, &c, sizeof(c)) != sizeof(c)) {
 		if (errno == EAGAIN) {
 			jack_error ("pp: cannot clean up byte from graph wait "
 				    "fd - no data present");
@@ -832,19 +905,281 @@ again:
 				    strerror (errno));
 			client->error++;
 		}
-		return NULL;    /* will stop the loop */
+		return plan->nentries;  /* will stop the loop */
 	}
 
 	/* Move to next internal client (or end of client list) */
-	while (node) {
-		if (jack_client_is_internal ((jack_client_internal_t*)
-					     node->data)) {
-			break;
+	return entry->next;
+}
+
+#ifdef JACK_HAVE_FUTEX
+
+/* Same as jack_process_external(), but the subgraph is started and
+ * waited for through graph_futex[] words in the engine control block
+ * instead of FIFOs. A client that dies no longer shows up as POLLHUP,
+ * so lost clients are only found by the timeout check.
+ */
+static unsigned int
+jack_process_external_futex (jack_engine_t *engine, jack_graph_plan_t *plan,
+			     unsigned int i)
+{
+	jack_plan_entry_t *entry = &plan->entries[i];
+	jack_client_internal_t *client = entry->client;
+	jack_client_control_t *ctl = client->control;
+	volatile int32_t *wait_word;
+	long timeout_usecs;
+
+	/* a race exists if we do this after the wakeup */
+	ctl->state = Triggered;
+	ctl->signalled_at = jack_get_microseconds ();
+
+	engine->current_client = client;
+
+	DEBUG ("calling process() on an external subgraph, slot==%d",
+	       entry->start_slot);
+
+	jack_futex_post (&engine->control->graph_futex[entry->start_slot]);
+
+	if (engine->freewheeling) {
+		timeout_usecs = 250000; /* 0.25 seconds */
+	} else {
+		timeout_usecs = (engine->client_timeout_msecs > 0 ?
+				 engine->client_timeout_msecs * 1000 :
+				 engine->driver->period_usecs);
+	}
+
+	wait_word = &engine->control->graph_futex[entry->wait_slot];
+
+	while (jack_futex_take (wait_word, timeout_usecs)) {
+
+		if (engine->freewheeling
+		    && jack_check_client_status (engine) == 0) {
+			/* all clients are fine - we're just not done
+			   yet, which is fine while freewheeling */
+			continue;
+		}
+
+		jack_error ("subgraph starting at %s timed out "
+			    "(wait slot=%d, state = %s)",
+			    ctl->name, entry->wait_slot,
+			    jack_client_state_name (client));
+
+		if (jack_check_clients (engine, 1)) {
+			engine->process_errors++;
+		}
+		return plan->nentries;  /* will stop the loop */
+	}
+
+	engine->timeout_count = 0;
+
+	/* Move to next internal client (or end of client list) */
+	return entry->next;
+}
+
+#endif /* JACK_HAVE_FUTEX */
+
+/* Parallel scheduling: every external client is its own subgraph
+ * (see jack_rechain_graph_parallel()), and the server thread acts as
+ * the dispatcher. A client is triggered as soon as every client that
+ * feeds it (according to the sortfeeds relation) has finished, so
+ * independent branches of the graph run concurrently and the cycle
+ * is bounded by the critical path rather than the sum of all
+ * process() times.
+ */
+
+static void
+jack_parallel_client_done (jack_graph_plan_t *plan, unsigned int i)
+{
+	jack_plan_entry_t *entry = &plan->entries[i];
+	unsigned int d, j;
+
+	for (d = 0; d < entry->ndependents; d++) {
+		j = entry->dependents[d];
+		if (--plan->pending[j] == 0) {
+			plan->ready[plan->nready++] = j;
+		}
+	}
+}
+
+static int
+jack_parallel_trigger (jack_engine_t *engine, jack_graph_plan_t *plan,
+		       unsigned int i)
+{
+	jack_plan_entry_t *entry = &plan->entries[i];
+	jack_client_control_t *ctl = entry->client->control;
+	char c = 0;
+
+	/* a race exists if we do this after the write(2) */
+	ctl->state = Triggered;
+	ctl->signalled_at = jack_get_microseconds ();
+
+	engine->current_client = entry->client;
+
+	DEBUG ("parallel trigger of %s, fd==%d", ctl->name, entry->start_fd);
+
+	if (write (entry->start_fd, &c, sizeof(c)) != sizeof(c)) {
+		jack_error ("cannot initiate graph processing for %s (%s)",
+			    ctl->name, strerror (errno));
+		engine->process_errors++;
+		jack_engine_signal_problems (engine);
+		return -1;
+	}
+
+	plan->pfd[plan->nrunning].fd = entry->wait_fd;
+	plan->pfd[plan->nrunning].events = POLLERR | POLLIN | POLLHUP | POLLNVAL;
+	plan->running[plan->nrunning++] = i;
+
+	return 0;
+}
+
+static void
+jack_engine_process_parallel (jack_engine_t *engine, jack_graph_plan_t *plan,
+			      jack_nframes_t nframes)
+{
+	/* precondition: caller has graph_lock, or is in a plan cycle */
+	jack_plan_entry_t *entry;
+	jack_client_internal_t *client;
+	unsigned int i;
+	int pollret;
+	int poll_timeout;
+	jack_time_t poll_timeout_usecs;
+	jack_time_t then, elapsed;
+	char c;
+
+	plan->nready = 0;
+	plan->nrunning = 0;
+
+	for (i = 0; i < plan->nentries; i++) {
+		plan->pending[i] = plan->entries[i].feedcount;
+		if (jack_client_runs (plan->entries[i].client)
+		    && plan->pending[i] == 0) {
+			plan->ready[plan->nready++] = i;
 		}
-		node = jack_slist_next (node);
 	}
 
-	return node;
+	if (engine->freewheeling) {
+		poll_timeout_usecs = 250000; /* 0.25 seconds */
+	} else {
+		poll_timeout_usecs = (engine->client_timeout_msecs > 0 ?
+				      engine->client_timeout_msecs * 1000 :
+				      engine->driver->period_usecs);
+	}
+
+	then = jack_get_microseconds ();
+
+	while (engine->process_errors == 0) {
+
+		/* start everything that is ready. internal clients
+		   run right here, which may make more clients ready.
+		 */
+
+		while (engine->process_errors == 0 && plan->nready) {
+
+			i = plan->ready[--plan->nready];
+			entry = &plan->entries[i];
+			client = entry->client;
+
+			if (client->control->dead || !jack_client_runs (client)) {
+				jack_parallel_client_done (plan, i);
+			} else if (entry->internal) {
+				jack_call_internal_process (engine, client,
+							    nframes);
+				jack_parallel_client_done (plan, i);
+			} else {
+				(void)jack_parallel_trigger (engine, plan, i);
+			}
+		}
+
+		if (engine->process_errors || plan->nrunning == 0) {
+			break;
+		}
+
+		/* the timeout covers the whole parallel section, not
+		   each individual wakeup */
+
+		elapsed = jack_get_microseconds () - then;
+		poll_timeout = 1 + (elapsed < poll_timeout_usecs ?
+				    poll_timeout_usecs - elapsed : 0) / 1000;
+
+		if ((pollret = poll (plan->pfd, plan->nrunning,
+				     poll_timeout)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			jack_error ("poll on parallel subgraphs failed (%s)",
+				    strerror (errno));
+			engine->process_errors++;
+			break;
+		}
+
+		if (pollret == 0) {
+
+			if (engine->freewheeling) {
+				if (jack_check_client_status (engine)) {
+					break;
+				}
+				then = jack_get_microseconds ();
+				continue;
+			}
+
+			if (jack_get_microseconds () - then
+			    < poll_timeout_usecs) {
+				/* early return from poll(2) */
+				continue;
+			}
+
+			jack_error ("parallel cycle timed out with %u "
+				    "client(s) still running (first: %s)",
+				    plan->nrunning,
+				    plan->entries[plan->running[0]].client->control->name);
+
+			if (jack_check_clients (engine, 1)) {
+				engine->process_errors++;
+			}
+			break;
+		}
+
+		engine->timeout_count = 0;
+
+		for (i = 0; i < plan->nrunning; ) {
+
+			struct pollfd *pfd = &plan->pfd[i];
+
+			entry = &plan->entries[plan->running[i]];
+			client = entry->client;
+
+			if (pfd->revents & ~POLLIN) {
+				jack_error ("parallel subgraph %s lost client",
+					    client->control->name);
+				if (jack_check_clients (engine, 1)) {
+					engine->process_errors++;
+				}
+				return;
+			}
+
+			if (!(pfd->revents & POLLIN)) {
+				i++;
+				continue;
+			}
+
+			if (read (entry->wait_fd, &c, sizeof(c)) != sizeof(c)) {
+				jack_error ("pp: cannot clean up byte from "
+					    "parallel graph wait fd (%s)",
+					    strerror (errno));
+				client->error++;
+				return;
+			}
+
+			/* remove from the running set by moving the last
+			   entry into this slot */
+
+			jack_parallel_client_done (plan, plan->running[i]);
+
+			plan->nrunning--;
+			plan->running[i] = plan->running[plan->nrunning];
+			plan->pfd[i] = plan->pfd[plan->nrunning];
+		}
+	}
 }
 
 #endif /* JACK_USE_MACH_THREADS */
@@ -852,36 +1187,67 @@ again:
 static int
 jack_engine_process (jack_engine_t *engine, jack_nframes_t nframes)
 {
-	/* precondition: caller has graph_lock */
-	jack_client_internal_t *client;
-	JSList *node;
+	/* precondition: caller has graph_lock, or is in a plan cycle */
+	jack_graph_plan_t *plan;
+	jack_plan_entry_t *entry;
+	jack_client_control_t *ctl;
+	unsigned int i;
 
 	engine->process_errors = 0;
 
-	for (node = engine->clients; node; node = jack_slist_next (node)) {
-		jack_client_control_t *ctl =
-			((jack_client_internal_t*)node->data)->control;
+	if ((plan = __atomic_load_n (&engine->plan, __ATOMIC_ACQUIRE)) == NULL) {
+		return 0;
+	}
+
+	/* tell clients which of their graph_next[] FIFOs this plan
+	   uses, before any of them is woken */
+	__atomic_store_n (&engine->control->graph_set, plan->set,
+			  __ATOMIC_RELEASE);
+
+	/* a new stamp for shared mixdowns. 0 is what a new mix group
+	   starts with, so skip it */
+	if (__atomic_add_fetch (&engine->control->process_cycle, 1,
+				__ATOMIC_RELEASE) == 0) {
+		__atomic_store_n (&engine->control->process_cycle, 1,
+				  __ATOMIC_RELEASE);
+	}
+
+	for (i = 0; i < plan->nentries; i++) {
+		ctl = plan->entries[i].client->control;
 		ctl->state = NotTriggered;
 		ctl->timed_out = 0;
 		ctl->awake_at = 0;
 		ctl->finished_at = 0;
 	}
 
-	for (node = engine->clients; engine->process_errors == 0 && node; ) {
+#ifndef JACK_USE_MACH_THREADS
+	if (plan->parallel) {
+		jack_engine_process_parallel (engine, plan, nframes);
+		return engine->process_errors > 0;
+	}
+#endif
+
+	for (i = 0; engine->process_errors == 0 && i < plan->nentries; ) {
 
-		client = (jack_client_internal_t*)node->data;
+		entry = &plan->entries[i];
+		ctl = entry->client->control;
 
-		DEBUG ("considering client %s for processing",
-		       client->control->name);
+		DEBUG ("considering client %s for processing", ctl->name);
 
-		if (!client->control->active ||
-		    (!client->control->process_cbset && !client->control->thread_cb_cbset) ||
-		    client->control->dead) {
-			node = jack_slist_next (node);
-		} else if (jack_client_is_internal (client)) {
-			node = jack_process_internal (engine, node, nframes);
+		if (!ctl->active ||
+		    (!ctl->process_cbset && !ctl->thread_cb_cbset) ||
+		    ctl->dead) {
+			i++;
+		} else if (entry->internal) {
+			jack_call_internal_process (engine, entry->client,
+						    nframes);
+			i++;
+#ifdef JACK_HAVE_FUTEX
+		} else if (plan->futex) {
+			i = jack_process_external_futex (engine, plan, i);
+#endif
 		} else {
-			node = jack_process_external (engine, node);
+			i = jack_process_external (engine, plan, i);
 		}
 	}
 
@@ -946,7 +1312,8 @@ jack_calc_cpu_load (jack_engine_t *engine)
 static void
 jack_engine_post_process (jack_engine_t *engine)
 {
-	/* precondition: caller holds the graph lock. */
+	/* precondition: caller holds the graph lock, or is in a plan
+	   cycle, during which the client list does not change. */
 
 	jack_transport_cycle_end (engine);
 	jack_calc_cpu_load (engine);
@@ -1311,7 +1678,7 @@ do_request (jack_engine_t *engine, jack_request_t *req, int *reply_fd)
 	case SetBufferSize:
 		req->status = jack_set_buffer_size_request (engine, req->x.nframes);
 		jack_lock_graph (engine);
-		jack_compute_new_latency (engine);
+		jack_compute_new_latency (engine, NULL, NULL);
 		jack_unlock_graph (engine);
 		break;
 
@@ -1334,7 +1701,7 @@ do_request (jack_engine_t *engine, jack_request_t *req, int *reply_fd)
 	case RecomputeTotalLatencies:
 		jack_lock_graph (engine);
 		jack_compute_all_port_total_latencies (engine);
-		jack_compute_new_latency (engine);
+		jack_compute_new_latency (engine, NULL, NULL);
 		jack_unlock_graph (engine);
 		req->status = 0;
 		break;
@@ -1391,6 +1758,19 @@ do_request (jack_engine_t *engine, jack_request_t *req, int *reply_fd)
 		jack_unlock_graph (engine);
 		break;
 
+	case ReindexPort:
+		req->status = jack_port_do_reindex (engine, req);
+		break;
+
+	case SetConnectionGain:
+		req->status = jack_port_do_connection_gain (engine, req);
+		break;
+
+	case GraphTransaction:
+		req->status = jack_do_graph_transaction (engine, req,
+							 reply_fd ? FALSE : TRUE);
+		break;
+
 	default:
 		/* some requests are handled entirely on the client
 		 * side, by adjusting the shared memory area(s) */
@@ -1409,6 +1789,50 @@ internal_client_request (void* ptr, jack_request_t *request)
 	return request->status;
 }
 
+/* the request socket is blocking, but large transfers may still
+   arrive or leave in pieces */
+
+static int
+jack_read_all (int fd, void *dst, size_t size)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < size) {
+		if ((n = read (fd, (char*)dst + done, size - done)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (n == 0) {
+			return -1;
+		}
+		done += n;
+	}
+
+	return 0;
+}
+
+static int
+jack_write_all (int fd, const void *src, size_t size)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < size) {
+		if ((n = write (fd, (const char*)src + done, size - done)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		done += n;
+	}
+
+	return 0;
+}
+
 static int
 handle_external_client_request (jack_engine_t *engine, int fd)
 {
@@ -1419,6 +1843,7 @@ handle_external_client_request (jack_engine_t *engine, int fd)
 	int reply_fd;
 	JSList *node;
 	ssize_t r;
+	size_t opsize = 0;
 
 	for (node = engine->clients; node; node = jack_slist_next (node)) {
 		if (((jack_client_internal_t*)node->data)->request_fd == fd) {
@@ -1472,6 +1897,29 @@ handle_external_client_request (jack_engine_t *engine, int fd)
 		}
 	}
 
+	if (req.type == GraphTransaction) {
+		if (req.x.transaction.nops == 0
+		    || req.x.transaction.nops > JACK_GRAPH_TXN_MAX) {
+			jack_error ("bad graph transaction size %" PRIu32
+				    " from client", req.x.transaction.nops);
+			return -1;
+		}
+		opsize = sizeof(jack_graph_op_t) * req.x.transaction.nops;
+		if ((req.x.transaction.ops = (jack_graph_op_t*)
+					     malloc (opsize)) == NULL) {
+			jack_error ("cannot allocate %" PRIu32 " graph "
+				    "operations", req.x.transaction.nops);
+			return -1;
+		}
+		if (jack_read_all (client->request_fd,
+				   req.x.transaction.ops, opsize)) {
+			jack_error ("cannot read graph operations from "
+				    "client (%s)", strerror (errno));
+			free (req.x.transaction.ops);
+			return -1;
+		}
+	}
+
 	reply_fd = client->request_fd;
 
 	jack_unlock_graph (engine);
@@ -1487,8 +1935,21 @@ handle_external_client_request (jack_engine_t *engine, int fd)
 		if (write (reply_fd, &req, sizeof(req))
 		    < (ssize_t)sizeof(req)) {
 			jack_error ("cannot write request result to client");
+			if (req.type == GraphTransaction) {
+				free (req.x.transaction.ops);
+			}
 			return -1;
 		}
+		if (req.type == GraphTransaction) {
+			r = jack_write_all (reply_fd, req.x.transaction.ops,
+					    opsize);
+			free (req.x.transaction.ops);
+			if (r) {
+				jack_error ("cannot write graph operation "
+					    "results to client");
+				return -1;
+			}
+		}
 	} else {
 		DEBUG ("*not* replying to client");
 	}
@@ -1757,7 +2218,10 @@ jack_engine_t *
 jack_engine_new (int realtime, int rtpriority, int do_mlock, int do_unlock,
 		 const char *server_name, int temporary, int verbose,
 		 int client_timeout, unsigned int port_max, pid_t wait_pid,
-		 jack_nframes_t frame_time_offset, int nozombies, int timeout_count_threshold, JSList *drivers)
+		 jack_nframes_t frame_time_offset, int nozombies, int timeout_count_threshold,
+		 int parallel, int futex_wakeup, int spin_usecs,
+		 int flush_denormals, unsigned int midi_class_budget,
+		 JSList *drivers)
 {
 	jack_engine_t *engine;
 	unsigned int i;
@@ -1831,6 +2295,44 @@ jack_engine_new (int realtime, int rtpriority, int do_mlock, int do_unlock,
 	engine->wait_pid = wait_pid;
 	engine->nozombies = nozombies;
 	engine->timeout_count_threshold = timeout_count_threshold;
+#ifdef JACK_USE_MACH_THREADS
+	if (parallel) {
+		jack_error ("parallel scheduling is not supported on this "
+			    "platform; using serial scheduling");
+		parallel = 0;
+	}
+#endif
+	engine->parallel = parallel;
+#ifndef JACK_HAVE_FUTEX
+	if (futex_wakeup) {
+		jack_error ("futex wakeups are not supported on this "
+			    "platform; using FIFOs");
+		futex_wakeup = 0;
+	}
+#endif
+	if (futex_wakeup && parallel) {
+		jack_error ("futex wakeups cannot be used with parallel "
+			    "scheduling; using FIFOs");
+		futex_wakeup = 0;
+	}
+	engine->futex_wakeup = futex_wakeup;
+	engine->futex_active = 0;
+	engine->sort_deferred = 0;
+	engine->sort_pending = FALSE;
+	engine->plan = NULL;
+	engine->plan_generation = 0;
+	engine->plan_retired = NULL;
+	engine->plan_set = 0;
+	engine->plan_cycles_allowed = 0;
+	engine->plan_epoch = 0;
+	engine->plan_waiters = 0;
+#ifndef JACK_HAVE_FUTEX
+	pthread_mutex_init (&engine->plan_lock, NULL);
+	pthread_cond_init (&engine->plan_cond, NULL);
+#endif
+	engine->plan_cycles = 0;
+	engine->latency_sorts = 0;
+	engine->latency_edges = 0;
 	engine->removing_clients = 0;
 	engine->new_clients_allowed = 1;
 
@@ -1882,7 +2384,9 @@ jack_engine_new (int realtime, int rtpriority, int do_mlock, int do_unlock,
 	srandom (time ((time_t*)0));
 
 	if (jack_shmalloc (sizeof(jack_control_t)
-			   + ((sizeof(jack_port_shared_t) * engine->port_max)),
+			   + ((sizeof(jack_port_shared_t) * engine->port_max))
+			   + jack_port_index_bytes (engine->port_max)
+			   + sizeof(jack_connection_gain_t) * engine->port_max,
 			   &engine->control_shm)) {
 		jack_error ("cannot create engine control shared memory "
 			    "segment (%s)", strerror (errno));
@@ -1919,7 +2423,10 @@ jack_engine_new (int realtime, int rtpriority, int do_mlock, int do_unlock,
 
 		/* set buffer list info correctly */
 		engine->port_buffers[i].freelist = NULL;
+		memset (engine->port_buffers[i].class_freelist, 0,
+			sizeof(engine->port_buffers[i].class_freelist));
 		engine->port_buffers[i].info = NULL;
+		engine->port_buffers[i].nbuffers = 0;
 
 		/* mark each port segment as not allocated */
 		engine->port_segment[i].index = -1;
@@ -1935,7 +2442,13 @@ jack_engine_new (int realtime, int rtpriority, int do_mlock, int do_unlock,
 		engine->control->ports[i].id = i;
 		engine->control->ports[i].alias1[0] = '\0';
 		engine->control->ports[i].alias2[0] = '\0';
+		engine->control->ports[i].mix_group = -1;
+		engine->control->ports[i].mix_offset = 0;
+		engine->control->ports[i].mix_ready = 0;
+		engine->control->ports[i].mix_claim = 0;
+		engine->control->ports[i].silent_cycle = 0;
 	}
+	engine->control->process_cycle = 1;
 
 	/* allocate internal port structures so that we can keep track
 	 * of port connections.
@@ -1943,18 +2456,60 @@ jack_engine_new (int realtime, int rtpriority, int do_mlock, int do_unlock,
 	engine->internal_ports = (jack_port_internal_t*)
 				 malloc (sizeof(jack_port_internal_t) * engine->port_max);
 
-	for (i = 0; i < engine->port_max; i++)
+	for (i = 0; i < engine->port_max; i++) {
 		engine->internal_ports[i].connections = 0;
+		engine->internal_ports[i].index_nhashes = 0;
+		engine->internal_ports[i].mix_buffer_info = NULL;
+		engine->internal_ports[i].mix_left = -1;
+	}
 
-	if (make_sockets (engine->server_name, engine->fds) < 0) {
-		jack_error ("cannot create server sockets");
+	if (jack_port_slots_init (engine)) {
+		jack_error ("cannot allocate port slot bitmap");
 		return NULL;
 	}
 
+	/* the name index is published once port_index_size is set */
+
 	engine->control->port_max = engine->port_max;
-	engine->control->real_time = realtime;
+	engine->control->port_index_seq = 0;
+	memset (jack_port_index_slots (engine->control), 0,
+		sizeof(jack_port_index_slot_t)
+		* jack_port_index_size (engine->port_max));
+	engine->port_index_used = 0;
+	engine->port_index_deleted = 0;
+	engine->control->port_index_size =
+		jack_port_index_size (engine->port_max);
+
+	engine->control->gain_offset = (char*)
+		(jack_port_index_slots (engine->control)
+		 + jack_port_index_size (engine->port_max))
+		- (char*)engine->control;
+	memset (jack_connection_gain (engine->control, 0), 0,
+		sizeof(jack_connection_gain_t) * engine->port_max);
 
-	/* leave some headroom for other client threads to run
+	if (make_sockets (engine->server_name, engine->fds) < 0) {
+		jack_error ("cannot create server sockets");
+		return NULL;
+	}
+
+	engine->control->real_time = realtime;
+
+	for (i = 0; i < JACK_GRAPH_FUTEX_MAX; i++) {
+		engine->control->graph_futex[i] = 0;
+	}
+
+	/* clients only spin while waiting on the futex chain */
+	if (spin_usecs && !engine->futex_wakeup) {
+		jack_info ("spin waiting needs futex wakeups; clients "
+			   "will not spin");
+	}
+	engine->control->spin_usecs = (spin_usecs > 0 ? spin_usecs : 0);
+
+	engine->control->flush_denormals = (flush_denormals ? TRUE : FALSE);
+	engine->midi_class_budget = midi_class_budget;
+	engine->control->denormal_cycles = 0;
+
+	/* leave some headroom for other client threads to run
 	   with priority higher than the regular client threads
 	   but less than the server. see thread.h for
 	   jack_client_real_time_priority() and jack_client_max_real_time_priority()
@@ -2270,18 +2825,20 @@ jack_stop_freewheeling (jack_engine_t* engine, int engine_exiting)
 static int
 jack_check_client_status (jack_engine_t* engine)
 {
-	JSList *node;
+	jack_graph_plan_t *plan;
+	unsigned int i;
 	int err = 0;
 
 	/* we are already late, or something else went wrong,
 	   so it can't hurt to check the existence of all
-	   clients.
+	   clients. the plan has the same clients as the client
+	   list, which the server thread may be sorting.
 	 */
 
-	for (node = engine->clients; node;
-	     node = jack_slist_next (node)) {
-		jack_client_internal_t *client =
-			(jack_client_internal_t*)node->data;
+	plan = __atomic_load_n (&engine->plan, __ATOMIC_ACQUIRE);
+
+	for (i = 0; plan && i < plan->nentries; i++) {
+		jack_client_internal_t *client = plan->entries[i].client;
 
 		if (client->control->type == ClientExternal) {
 			if (kill (client->control->pid, 0)) {
@@ -2313,6 +2870,7 @@ jack_run_one_cycle (jack_engine_t *engine, jack_nframes_t nframes,
 {
 	jack_driver_t* driver = engine->driver;
 	int ret = -1;
+	int locked = TRUE;
 	static int consecutive_excessive_delays = 0;
 
 #define WORK_SCALE 1.0f
@@ -2342,19 +2900,24 @@ jack_run_one_cycle (jack_engine_t *engine, jack_nframes_t nframes,
 
 	DEBUG ("trying to acquire read lock (FW = %d)", engine->freewheeling);
 	if (jack_try_rdlock_graph (engine)) {
-		VERBOSE (engine, "lock-driven null cycle");
-		if (!engine->freewheeling) {
-			driver->null_cycle (driver, nframes);
-		} else {
-			/* don't return too fast */
-			usleep (1000);
+		/* the server thread may still let us run from the
+		   published plan */
+		if (!jack_engine_enter_plan_cycle (engine)) {
+			VERBOSE (engine, "lock-driven null cycle");
+			if (!engine->freewheeling) {
+				driver->null_cycle (driver, nframes);
+			} else {
+				/* don't return too fast */
+				usleep (1000);
+			}
+			return 0;
 		}
-		return 0;
+		locked = FALSE;
 	}
 
 	if (jack_trylock_problems (engine)) {
 		VERBOSE (engine, "problem-lock-driven null cycle");
-		jack_unlock_graph (engine);
+		jack_engine_end_cycle (engine, locked);
 		if (!engine->freewheeling) {
 			driver->null_cycle (driver, nframes);
 		} else {
@@ -2367,7 +2930,7 @@ jack_run_one_cycle (jack_engine_t *engine, jack_nframes_t nframes,
 	if (engine->problems || (engine->timeout_count_threshold && (engine->timeout_count > (1 + engine->timeout_count_threshold * 1000 / engine->driver->period_usecs) ))) {
 		VERBOSE (engine, "problem-driven null cycle problems=%d", engine->problems);
 		jack_unlock_problems (engine);
-		jack_unlock_graph (engine);
+		jack_engine_end_cycle (engine, locked);
 		if (!engine->freewheeling) {
 			driver->null_cycle (driver, nframes);
 		} else {
@@ -2379,6 +2942,9 @@ jack_run_one_cycle (jack_engine_t *engine, jack_nframes_t nframes,
 
 	jack_unlock_problems (engine);
 
+	/* the driver's conversions and the internal clients run here */
+	jack_denormals_begin (engine->control->flush_denormals);
+
 	if (!engine->freewheeling) {
 		DEBUG ("waiting for driver read\n");
 		if (jack_drivers_read (engine, nframes)) {
@@ -2399,6 +2965,10 @@ jack_run_one_cycle (jack_engine_t *engine, jack_nframes_t nframes,
 		}
 	}
 
+	if (jack_denormals_end ()) {
+		engine->control->denormal_cycles++;
+	}
+
 	jack_engine_post_process (engine);
 
 	if (delayed_usecs > engine->control->max_delayed_usecs) {
@@ -2408,7 +2978,7 @@ jack_run_one_cycle (jack_engine_t *engine, jack_nframes_t nframes,
 	ret = 0;
 
 unlock:
-	jack_unlock_graph (engine);
+	jack_engine_end_cycle (engine, locked);
 	DEBUG ("cycle finished, status = %d", ret);
 
 	return ret;
@@ -2611,8 +3181,21 @@ jack_engine_delete (jack_engine_t *engine)
 	jack_release_shm (&engine->control_shm);
 	jack_destroy_shm (&engine->control_shm);
 
+	VERBOSE (engine, "ports: at most %" PRIu32 " of %u in use, "
+		 "%lu allocated, %lu refused", engine->ports_in_use_max,
+		 engine->port_max, engine->port_allocs,
+		 engine->port_alloc_failures);
+	free (engine->port_free);
+	free (engine->port_free_summary);
+
 	VERBOSE (engine, "max usecs: %.3f, engine deleted", engine->max_usecs);
 
+	jack_engine_retire_plans (engine, TRUE);
+	jack_plan_free (engine->plan);
+#ifndef JACK_HAVE_FUTEX
+	pthread_cond_destroy (&engine->plan_cond);
+	pthread_mutex_destroy (&engine->plan_lock);
+#endif
 	free (engine);
 
 	jack_messagebuffer_exit ();
@@ -2926,6 +3509,31 @@ jack_notify_all_port_interested_clients (jack_engine_t *engine, jack_uuid_t src,
 	}
 }
 
+#ifdef JACK_HAVE_FUTEX
+
+/* A client blocked in the futex chain is not polling its event
+ * socket. Flag the event in its control block, then disturb the word
+ * it is sleeping on so that it goes and looks.
+ */
+static void
+jack_kick_futex_waiter (jack_engine_t *engine, jack_client_internal_t *client)
+{
+	int32_t slot;
+
+	__atomic_store_n (&client->control->event_pending, 1,
+			  __ATOMIC_SEQ_CST);
+
+	slot = __atomic_load_n (&client->control->wait_slot, __ATOMIC_SEQ_CST);
+
+	if (slot >= 0 && slot < JACK_GRAPH_FUTEX_MAX) {
+		__atomic_or_fetch (&engine->control->graph_futex[slot],
+				   JACK_FUTEX_KICK, __ATOMIC_SEQ_CST);
+		jack_futex_wake (&engine->control->graph_futex[slot], INT32_MAX);
+	}
+}
+
+#endif /* JACK_HAVE_FUTEX */
+
 int
 jack_deliver_event (jack_engine_t *engine, jack_client_internal_t *client,
 		    const jack_event_t *event, ...)
@@ -2980,6 +3588,11 @@ jack_deliver_event (jack_engine_t *engine, jack_client_internal_t *client,
 				(client->private_client, event);
 			break;
 
+		case ConnectionGain:
+			jack_client_handle_connection_gain
+				(client->private_client, event);
+			break;
+
 		case BufferSizeChange:
 			jack_client_fix_port_buffers (client->private_client);
 
@@ -3047,6 +3660,17 @@ jack_deliver_event (jack_engine_t *engine, jack_client_internal_t *client,
 				jack_engine_signal_problems (engine);
 			}
 
+#ifdef USE_MEMFD_SHM
+			/* the client cannot attach a port segment it has not
+			   been given */
+			if (event->type == AttachPortSegment && !client->error
+			    && jack_shm_send (client->event_fd,
+					      engine->port_segment[event->y.ptid].index)) {
+				client->error += JACK_ERROR_WITH_SOCKETS;
+				jack_engine_signal_problems (engine);
+			}
+#endif
+
 			/* for property changes, deliver the extra data representing
 			   the variable length "key" that has changed in some way.
 			 */
@@ -3063,6 +3687,10 @@ jack_deliver_event (jack_engine_t *engine, jack_client_internal_t *client,
 				}
 			}
 
+#ifdef JACK_HAVE_FUTEX
+			jack_kick_futex_waiter (engine, client);
+#endif
+
 			if (client->error) {
 				status = -1;
 			} else {
@@ -3185,1117 +3813,2846 @@ again:
 	return status;
 }
 
-int
-jack_rechain_graph (jack_engine_t *engine)
-{
-	JSList *node, *next;
-	unsigned long n;
-	int err = 0;
-	jack_client_internal_t *subgraph_client, *next_client;
-	jack_event_t event;
-	int upstream_is_jackd;
-
-	VALGRIND_MEMSET (&event, 0, sizeof(event));
-
-	jack_clear_fifos (engine);
-
-	subgraph_client = 0;
-
-	VERBOSE (engine, "++ jack_rechain_graph():");
-
-	event.type = GraphReordered;
-
-	for (n = 0, node = engine->clients, next = NULL; node; node = next) {
+/* Execution plans.
+ *
+ * The process thread normally runs with the graph read-locked. While
+ * the server thread holds the write lock it may instead open a window
+ * with jack_engine_allow_plan_cycles(), during which cycles run from
+ * the published plan without the graph lock. Windows nest, and are
+ * open for all of a connect or disconnect. Inside one the server
+ * thread must not add clients to the chain or take them out of it,
+ * and must not free anything a plan or a driver port refers to; it may
+ * sort the clients and publish new plans, since a new plan uses the
+ * graph_next[] set of each client that the published one does not.
+ *
+ * A plan that has been replaced is freed once no cycle can still be
+ * running it, see jack_engine_retire_plans(). plan_epoch is odd while
+ * a plan cycle runs, so that takes at most one cycle and never stops
+ * the process thread.
+ */
 
-		jack_client_internal_t* client = (jack_client_internal_t*)node->data;
+static void
+jack_plan_free (jack_graph_plan_t *plan)
+{
+	unsigned int i;
 
-		next = jack_slist_next (node);
+	if (plan == NULL) {
+		return;
+	}
 
-		if (!client->control->process_cbset && !client->control->thread_cb_cbset) {
-			continue;
+	if (plan->far) {
+		for (i = 0; i < plan->nlinks; i++) {
+			jack_port_free (plan->far[i]);
 		}
+	}
 
-		VERBOSE (engine, "+++ client is now %s active ? %d",
-			 client->control->name, client->control->active);
+	free (plan->entries);
+	free (plan->dependents);
+	free (plan->ports);
+	free (plan->links);
+	free (plan->far);
+	free (plan->pending);
+	free (plan->ready);
+	free (plan->running);
+	free (plan->pfd);
+	free (plan);
+}
 
-		if (client->control->active) {
+void
+jack_engine_allow_plan_cycles (jack_engine_t *engine)
+{
+	/* caller must hold the graph write lock */
+	__atomic_add_fetch (&engine->plan_cycles_allowed, 1, __ATOMIC_SEQ_CST);
+}
 
-			/* find the next active client. its ok for
-			 * this to be NULL */
+/* Sleep until plan_epoch is no longer `epoch'. The process thread
+ * only wakes us if plan_waiters says someone is waiting, so that it
+ * makes no system call in the usual case.
+ */
+static void
+jack_engine_wait_plan_epoch (jack_engine_t *engine, int32_t epoch)
+{
+	__atomic_add_fetch (&engine->plan_waiters, 1, __ATOMIC_SEQ_CST);
 
-			while (next) {
-				if (client->control->active && (client->control->process_cbset || client->control->thread_cb_cbset)) {
-					break;
-				}
-				next = jack_slist_next (next);
-			}
-			;
+#ifdef JACK_HAVE_FUTEX
+	while (__atomic_load_n (&engine->plan_epoch, __ATOMIC_SEQ_CST) == epoch) {
+		jack_futex_wait (&engine->plan_epoch, epoch, -1);
+	}
+#else
+	pthread_mutex_lock (&engine->plan_lock);
+	while (__atomic_load_n (&engine->plan_epoch, __ATOMIC_SEQ_CST) == epoch) {
+		pthread_cond_wait (&engine->plan_cond, &engine->plan_lock);
+	}
+	pthread_mutex_unlock (&engine->plan_lock);
+#endif
 
-			if (next == NULL) {
-				next_client = NULL;
-			} else {
-				next_client = (jack_client_internal_t*)
-					      next->data;
-			}
+	__atomic_sub_fetch (&engine->plan_waiters, 1, __ATOMIC_SEQ_CST);
+}
 
-			client->execution_order = n;
-			client->next_client = next_client;
+/* Called by the process thread when it leaves a plan cycle. */
+static void
+jack_engine_next_plan_epoch (jack_engine_t *engine)
+{
+	__atomic_add_fetch (&engine->plan_epoch, 1, __ATOMIC_SEQ_CST);
 
-			if (jack_client_is_internal (client)) {
+	if (__atomic_load_n (&engine->plan_waiters, __ATOMIC_SEQ_CST) == 0) {
+		return;
+	}
 
-				/* break the chain for the current
-				 * subgraph. the server will wait for
-				 * chain on the nth FIFO, and will
-				 * then execute this internal
-				 * client. */
+#ifdef JACK_HAVE_FUTEX
+	jack_futex_wake (&engine->plan_epoch, INT32_MAX);
+#else
+	pthread_mutex_lock (&engine->plan_lock);
+	pthread_cond_broadcast (&engine->plan_cond);
+	pthread_mutex_unlock (&engine->plan_lock);
+#endif
+}
 
-				if (subgraph_client) {
-					subgraph_client->subgraph_wait_fd =
-						jack_get_fifo_fd (engine, n);
-					VERBOSE (engine, "client %s: wait_fd="
-						 "%d, execution_order="
-						 "%lu.",
-						 subgraph_client->
-						 control->name,
-						 subgraph_client->
-						 subgraph_wait_fd, n);
-					n++;
-				}
+/* Wait for the plan cycle that is running, if any, to finish. */
+static void
+jack_engine_wait_plan_cycle (jack_engine_t *engine)
+{
+	int32_t epoch;
 
-				VERBOSE (engine, "client %s: internal "
-					 "client, execution_order="
-					 "%lu.",
-					 client->control->name, n);
+	epoch = __atomic_load_n (&engine->plan_epoch, __ATOMIC_SEQ_CST);
 
-				/* this does the right thing for
-				 * internal clients too
-				 */
+	if (epoch & 1) {
+		jack_engine_wait_plan_epoch (engine, epoch);
+	}
+}
 
-				jack_deliver_event (engine, client, &event);
+void
+jack_engine_block_plan_cycles (jack_engine_t *engine)
+{
+	/* caller must hold the graph write lock */
 
-				subgraph_client = 0;
+	if (__atomic_sub_fetch (&engine->plan_cycles_allowed, 1,
+				__ATOMIC_SEQ_CST) > 0) {
+		return;
+	}
 
-			} else {
+	/* a plan cycle may have got in before the window shut */
+	jack_engine_wait_plan_cycle (engine);
+	jack_engine_retire_plans (engine, FALSE);
+}
 
-				if (subgraph_client == NULL) {
+/* Free the plans that have been replaced and that no cycle can still
+ * be using. With wait, keep at it until they are all gone, which takes
+ * at most the rest of the cycle that is running.
+ */
+void
+jack_engine_retire_plans (jack_engine_t *engine, int wait)
+{
+	/* caller must hold the graph write lock */
+	jack_graph_plan_t *plan;
+	JSList *node, *next;
+	int32_t epoch;
 
-					/* start a new subgraph. the
-					 * engine will start the chain
-					 * by writing to the nth
-					 * FIFO.
-					 */
+	while (engine->plan_retired) {
 
-					subgraph_client = client;
-					subgraph_client->subgraph_start_fd =
-						jack_get_fifo_fd (engine, n);
-					VERBOSE (engine, "client %s: "
-						 "start_fd=%d, execution"
-						 "_order=%lu.",
-						 subgraph_client->
-						 control->name,
-						 subgraph_client->
-						 subgraph_start_fd, n);
+		epoch = __atomic_load_n (&engine->plan_epoch, __ATOMIC_SEQ_CST);
 
-					/* this external client after
-					   this will have jackd as its
-					   upstream connection.
-					 */
+		for (node = engine->plan_retired; node; node = next) {
+			next = jack_slist_next (node);
+			plan = (jack_graph_plan_t*)node->data;
 
-					upstream_is_jackd = 1;
+			/* a cycle that started after the plan was
+			   replaced cannot have picked it up */
+			if ((plan->retired_epoch & 1) == 0
+			    || epoch != plan->retired_epoch) {
+				engine->plan_retired = jack_slist_remove_link (
+					engine->plan_retired, node);
+				jack_slist_free_1 (node);
+				jack_plan_free (plan);
+			}
+		}
 
-				} else {
-					VERBOSE (engine, "client %s: in"
-						 " subgraph after %s, "
-						 "execution_order="
-						 "%lu.",
-						 client->control->name,
-						 subgraph_client->
-						 control->name, n);
-					subgraph_client->subgraph_wait_fd = -1;
+		if (!wait || engine->plan_retired == NULL) {
+			break;
+		}
 
-					/* this external client after
-					   this will have another
-					   client as its upstream
-					   connection.
-					 */
+		/* what is left was retired during this cycle */
+		jack_engine_wait_plan_epoch (engine, epoch);
+	}
+}
 
-					upstream_is_jackd = 0;
-				}
+static int
+jack_engine_enter_plan_cycle (jack_engine_t *engine)
+{
+	__atomic_add_fetch (&engine->plan_epoch, 1, __ATOMIC_SEQ_CST);
 
-				/* make sure fifo for 'n + 1' exists
-				 * before issuing client reorder
-				 */
-				(void)jack_get_fifo_fd (
-					engine, client->execution_order + 1);
-				event.x.n = client->execution_order;
-				event.y.n = upstream_is_jackd;
-				jack_deliver_event (engine, client, &event);
-				n++;
-			}
-		}
+	if (__atomic_load_n (&engine->plan_cycles_allowed, __ATOMIC_SEQ_CST)) {
+		engine->plan_cycles++;
+		return 1;
 	}
 
-	if (subgraph_client) {
-		subgraph_client->subgraph_wait_fd =
-			jack_get_fifo_fd (engine, n);
-		VERBOSE (engine, "client %s: wait_fd=%d, "
-			 "execution_order=%lu (last client).",
-			 subgraph_client->control->name,
-			 subgraph_client->subgraph_wait_fd, n);
+	jack_engine_next_plan_epoch (engine);
+	return 0;
+}
+
+static void
+jack_engine_end_cycle (jack_engine_t *engine, int locked)
+{
+	if (locked) {
+		jack_unlock_graph (engine);
+	} else {
+		jack_engine_next_plan_epoch (engine);
 	}
+}
 
-	VERBOSE (engine, "-- jack_rechain_graph()");
+/* Internal clients get the connection lists of their ports from the
+ * plan, so that they change together with the execution order. Only
+ * the ports the client itself registered are in its ports list.
+ */
+static int
+jack_plan_port_managed (jack_client_internal_t *client, jack_port_t *port)
+{
+	return jack_uuid_compare (port->shared->client_id,
+				  client->control->uuid) == 0;
+}
 
-	return err;
+static int
+jack_engine_manages_connections (jack_client_internal_t *client)
+{
+	return client->private_client
+	       && client->private_client->engine_connections;
 }
 
-static jack_nframes_t
-jack_get_port_total_latency (jack_engine_t *engine,
-			     jack_port_internal_t *port, int hop_count,
-			     int toward_port)
+static int
+jack_plan_add_connections (jack_engine_t *engine, jack_graph_plan_t *plan)
 {
-	JSList *node;
-	jack_nframes_t latency;
-	jack_nframes_t max_latency = 0;
+	jack_client_internal_t *client;
+	jack_port_internal_t *iport;
+	jack_connection_internal_t *connection;
+	jack_port_internal_t *other;
+	jack_plan_port_t *pp;
+	jack_port_t *port, *far;
+	JSList *node, *pnode, *cnode;
 
-#ifdef DEBUG_TOTAL_LATENCY_COMPUTATION
-	char prefix[32];
-	int i;
+	for (node = engine->clients; node; node = jack_slist_next (node)) {
+		client = (jack_client_internal_t*)node->data;
+		if (!jack_engine_manages_connections (client)) {
+			continue;
+		}
 
-	for (i = 0; i < hop_count; ++i)
-		prefix[i] = '\t';
+		for (pnode = client->private_client->ports; pnode;
+		     pnode = jack_slist_next (pnode)) {
+			port = (jack_port_t*)pnode->data;
+			if (!jack_plan_port_managed (client, port)) {
+				continue;
+			}
 
-	prefix[i] = '\0';
-#endif
+			pp = &plan->ports[plan->nports++];
+			pp->port = port;
+			pp->first = plan->nlinks;
+			pp->count = 0;
 
-	/* call tree must hold engine->client_lock. */
+			iport = &engine->internal_ports[port->shared->id];
 
-	latency = port->shared->latency;
+			for (cnode = iport->connections; cnode;
+			     cnode = jack_slist_next (cnode)) {
+				connection = (jack_connection_internal_t*)
+					     cnode->data;
+				other = (connection->source == iport ?
+					 connection->destination :
+					 connection->source);
+
+				if ((far = jack_port_new (client->private_client,
+							  other->shared->id,
+							  engine->control)) == NULL) {
+					return -1;
+				}
 
-	/* we don't prevent cyclic graphs, so we have to do something
-	   to bottom out in the event that they are created.
-	 */
+				far->gain_slot =
+					(port->shared->flags & JackPortIsInput) ?
+					connection->gain_slot : -1;
 
-	if (hop_count > 8) {
-		return latency;
+				plan->far[plan->nlinks] = far;
+				plan->links[plan->nlinks].data = far;
+				plan->links[plan->nlinks].next = NULL;
+				if (pp->count++) {
+					plan->links[plan->nlinks - 1].next =
+						&plan->links[plan->nlinks];
+				}
+				plan->nlinks++;
+			}
+		}
 	}
 
-#ifdef DEBUG_TOTAL_LATENCY_COMPUTATION
-	jack_info ("%sFor port %s (%s)", prefix, port->shared->name, (toward_port ? "toward" : "away"));
-#endif
-
-	for (node = port->connections; node; node = jack_slist_next (node)) {
-
-		jack_nframes_t this_latency;
-		jack_connection_internal_t *connection;
-
-		connection = (jack_connection_internal_t*)node->data;
-
+	return 0;
+}
 
-		if ((toward_port &&
-		     (connection->source->shared == port->shared)) ||
-		    (!toward_port &&
-		     (connection->destination->shared == port->shared))) {
+/* Point the ports of internal clients at their lists in the plan just
+ * published, or at nothing if there is none. The old lists stay
+ * readable until the plan they are in is freed.
+ */
+static void
+jack_plan_install_connections (jack_engine_t *engine, jack_graph_plan_t *plan)
+{
+	jack_client_internal_t *client;
+	jack_plan_port_t *pp;
+	JSList *node, *pnode;
+	unsigned int i;
 
-#ifdef DEBUG_TOTAL_LATENCY_COMPUTATION
-			jack_info ("%s\tskip connection %s->%s",
-				   prefix,
-				   connection->source->shared->name,
-				   connection->destination->shared->name);
-#endif
+	if (plan) {
+		for (i = 0; i < plan->nports; i++) {
+			pp = &plan->ports[i];
+			jack_port_set_connections (pp->port, pp->count ?
+						   &plan->links[pp->first] :
+						   NULL);
+		}
+		return;
+	}
 
+	for (node = engine->clients; node; node = jack_slist_next (node)) {
+		client = (jack_client_internal_t*)node->data;
+		if (!jack_engine_manages_connections (client)) {
 			continue;
 		}
+		for (pnode = client->private_client->ports; pnode;
+		     pnode = jack_slist_next (pnode)) {
+			if (jack_plan_port_managed (client, (jack_port_t*)pnode->data)) {
+				jack_port_set_connections ((jack_port_t*)pnode->data,
+							   NULL);
+			}
+		}
+	}
+}
 
-#ifdef DEBUG_TOTAL_LATENCY_COMPUTATION
-		jack_info ("%s\tconnection %s->%s ... ",
-			   prefix,
-			   connection->source->shared->name,
-			   connection->destination->shared->name);
-#endif
-		/* if we're a destination in the connection, recurse
-		   on the source to get its total latency
-		 */
+/* Build a plan from the client list and the subgraph FIFOs and slots
+ * set up by jack_rechain_graph(), and swap it in. Must also be called
+ * when a client is added or removed, so that the clients in the plan
+ * are always those in engine->clients.
+ */
+void
+jack_engine_publish_plan (jack_engine_t *engine)
+{
+	/* caller must hold the graph write lock */
+	jack_graph_plan_t *plan, *old;
+	jack_plan_entry_t *entry;
+	jack_client_internal_t *client, *dst;
+	JSList *node, *fnode, *pnode;
+	unsigned int n, ndeps, nports, nlinks, i, next;
+	unsigned int *dep;
+	jack_port_t *port;
+
+	n = jack_slist_length (engine->clients);
+	ndeps = 0;
+	nports = 0;
+	nlinks = 0;
 
-		if (connection->destination == port) {
+	for (node = engine->clients; node; node = jack_slist_next (node)) {
+		client = (jack_client_internal_t*)node->data;
+		if (!jack_engine_manages_connections (client)) {
+			continue;
+		}
+		for (pnode = client->private_client->ports; pnode;
+		     pnode = jack_slist_next (pnode)) {
+			port = (jack_port_t*)pnode->data;
+			if (jack_plan_port_managed (client, port)) {
+				nports++;
+				nlinks += jack_slist_length (
+					engine->internal_ports[port->shared->id].connections);
+			}
+		}
+	}
 
-			if (connection->source->shared->flags
-			    & JackPortIsTerminal) {
-				this_latency = connection->source->
-					       shared->latency;
-			} else {
-				this_latency =
-					jack_get_port_total_latency (
-						engine, connection->source,
-						hop_count + 1,
-						toward_port);
+	if (engine->parallel) {
+		for (node = engine->clients; node; node = jack_slist_next (node)) {
+			client = (jack_client_internal_t*)node->data;
+			if (!jack_client_runs (client)) {
+				continue;
 			}
+			for (fnode = client->sortfeeds; fnode;
+			     fnode = jack_slist_next (fnode)) {
+				dst = (jack_client_internal_t*)fnode->data;
+				if (jack_client_runs (dst)) {
+					ndeps++;
+				}
+			}
+		}
+	}
 
-		} else {
+	/* allocate at least one of everything, so that a NULL
+	   return always means failure */
+
+	if ((plan = (jack_graph_plan_t*)calloc (1, sizeof(*plan))) == NULL
+	    || (plan->entries = (jack_plan_entry_t*)
+				calloc (n + 1, sizeof(jack_plan_entry_t))) == NULL
+	    || (plan->dependents = (unsigned int*)
+				   calloc (ndeps + 1, sizeof(unsigned int))) == NULL
+	    || (plan->ports = (jack_plan_port_t*)
+			      calloc (nports + 1, sizeof(jack_plan_port_t))) == NULL
+	    || (plan->links = (JSList*)
+			      calloc (nlinks + 1, sizeof(JSList))) == NULL
+	    || (plan->far = (jack_port_t**)
+			    calloc (nlinks + 1, sizeof(jack_port_t*))) == NULL
+	    || (plan->pending = (unsigned int*)
+				calloc (n + 1, sizeof(unsigned int))) == NULL
+	    || (plan->ready = (unsigned int*)
+			      calloc (n + 1, sizeof(unsigned int))) == NULL
+	    || (plan->running = (unsigned int*)
+				calloc (n + 1, sizeof(unsigned int))) == NULL
+	    || (plan->pfd = (struct pollfd*)
+			    calloc (n + 1, sizeof(struct pollfd))) == NULL
+	    || jack_plan_add_connections (engine, plan)) {
+		jack_error ("cannot allocate execution plan for %u clients; "
+			    "processing stops", n);
+		jack_plan_free (plan);
+		plan = NULL;
+		goto publish;
+	}
+
+	plan->generation = ++engine->plan_generation;
+	plan->parallel = engine->parallel;
+	plan->futex = engine->futex_active;
+	plan->set = engine->plan_set;
+	plan->nentries = n;
+
+	for (i = 0, node = engine->clients; node; node = jack_slist_next (node), i++) {
+		client = (jack_client_internal_t*)node->data;
+		client->plan_index = i;
 
-			/* "port" is the source, so get the latency of
-			 * the destination */
-			if (connection->destination->shared->flags
-			    & JackPortIsTerminal) {
-				this_latency = connection->destination->
-					       shared->latency;
-			} else {
-				this_latency =
-					jack_get_port_total_latency (
-						engine,
-						connection->destination,
-						hop_count + 1,
-						toward_port);
-			}
+		entry = &plan->entries[i];
+		entry->client = client;
+		entry->internal = jack_client_is_internal (client);
+		entry->start_fd = client->subgraph_start_fd;
+		entry->wait_fd = client->subgraph_wait_fd;
+		entry->start_slot = client->subgraph_start_slot;
+		entry->wait_slot = client->subgraph_wait_slot;
+	}
+
+	/* after an external subgraph, processing continues with the
+	   next internal client */
+
+	for (next = n, i = n; i-- > 0; ) {
+		plan->entries[i].next = next;
+		if (plan->entries[i].internal) {
+			next = i;
 		}
+	}
 
-		if (this_latency > max_latency) {
-			max_latency = this_latency;
+	if (plan->parallel) {
+		dep = plan->dependents;
+		for (i = 0; i < n; i++) {
+			entry = &plan->entries[i];
+			client = entry->client;
+			if (!jack_client_runs (client)) {
+				continue;
+			}
+			entry->feedcount = client->runfedcount;
+			entry->dependents = dep;
+			for (fnode = client->sortfeeds; fnode;
+			     fnode = jack_slist_next (fnode)) {
+				dst = (jack_client_internal_t*)fnode->data;
+				if (jack_client_runs (dst)) {
+					*dep++ = dst->plan_index;
+					entry->ndependents++;
+				}
+			}
 		}
 	}
 
-#ifdef DEBUG_TOTAL_LATENCY_COMPUTATION
-	jack_info ("%s\treturn %lu + %lu = %lu", prefix, latency, max_latency, latency + max_latency);
-#endif
+	VERBOSE (engine, "execution plan %lu: %u clients",
+		 plan->generation, n);
+
+publish:
+	old = __atomic_exchange_n (&engine->plan, plan, __ATOMIC_SEQ_CST);
+
+	if (old) {
+		old->retired_epoch = __atomic_load_n (&engine->plan_epoch,
+						      __ATOMIC_SEQ_CST);
+		engine->plan_retired = jack_slist_prepend (engine->plan_retired, old);
+	}
 
-	return latency + max_latency;
+	jack_plan_install_connections (engine, plan);
+	jack_engine_retire_plans (engine, FALSE);
 }
 
+/* Send GraphReordered to a client, unless its place in the chain and
+ * the FIFOs it signals are the same as last time and it has no graph
+ * order callback that wants to hear about it anyway.
+ */
 static void
-jack_compute_port_total_latency (jack_engine_t* engine, jack_port_shared_t* port)
+jack_deliver_reorder (jack_engine_t *engine, jack_client_internal_t *client,
+		      jack_event_t *event, int upstream)
 {
-	if (port->in_use) {
-		port->total_latency =
-			jack_get_port_total_latency (
-				engine, &engine->internal_ports[port->id],
-				0, !(port->flags & JackPortIsOutput));
+	if (client->reorder_order == (long)client->execution_order
+	    && client->reorder_upstream == upstream
+	    && client->reorder_next[0] == client->control->graph_next[0]
+	    && client->reorder_next[1] == client->control->graph_next[1]
+	    && !client->control->graph_order_cbset) {
+		return;
 	}
+
+	client->reorder_order = (long)client->execution_order;
+	client->reorder_upstream = upstream;
+	client->reorder_next[0] = client->control->graph_next[0];
+	client->reorder_next[1] = client->control->graph_next[1];
+
+	jack_deliver_event (engine, client, event);
 }
 
+/* Tell an external client in the chain where it now is: it waits on
+ * its own FIFO 2 * graph_slot, and signals `next' after process() in
+ * cycles that run the new plan. Only done once `next' is known, so
+ * that the client can open it before the plan is published.
+ */
 static void
-jack_compute_all_port_total_latencies (jack_engine_t *engine)
+jack_chain_external (jack_engine_t *engine, jack_client_internal_t *client,
+		     int set, int next, int upstream)
 {
-	jack_port_shared_t *shared = engine->control->ports;
-	unsigned int i;
-	int toward_port;
+	jack_event_t event;
 
-	for (i = 0; i < engine->control->port_max; i++) {
-		if (shared[i].in_use) {
+	VALGRIND_MEMSET (&event, 0, sizeof(event));
 
-			if (shared[i].flags & JackPortIsOutput) {
-				toward_port = FALSE;
-			} else {
-				toward_port = TRUE;
-			}
+	client->control->graph_next[set] = next;
 
-			shared[i].total_latency =
-				jack_get_port_total_latency (
-					engine, &engine->internal_ports[i],
-					0, toward_port);
-		}
+	event.type = GraphReordered;
+	event.x.n = 2 * client->graph_slot;
+	event.y.n = upstream;
+	jack_deliver_reorder (engine, client, &event, upstream);
+}
+
+/* Pick the graph_next[] set for the next plan: the one the published
+ * plan does not use. Once no cycle can still be running an older plan
+ * that used it, the server thread is free to rewrite it.
+ */
+static int
+jack_engine_next_plan_set (jack_engine_t *engine)
+{
+	jack_engine_retire_plans (engine, TRUE);
+
+	/* stale wakeups can only be drained when nothing is
+	   running */
+	if (!engine->plan_cycles_allowed) {
+		jack_clear_fifos (engine);
 	}
+
+	engine->plan_set ^= 1;
+
+	return engine->plan_set;
 }
 
-static void
-jack_compute_new_latency (jack_engine_t *engine)
+#ifndef JACK_USE_MACH_THREADS
+
+static int
+jack_rechain_graph_parallel (jack_engine_t *engine)
 {
-	JSList *node;
-	JSList *reverse_list = NULL;
+	JSList *node, *fnode;
+	unsigned long n;
+	jack_client_internal_t *client, *dst;
 	jack_event_t event;
+	int set;
 
 	VALGRIND_MEMSET (&event, 0, sizeof(event));
 
-	event.type = LatencyCallback;
-	event.x.n  = 0;
+	set = jack_engine_next_plan_set (engine);
 
-	/* iterate over all clients in graph order, and emit
-	 * capture latency callback.
-	 * also builds up list in reverse graph order.
-	 */
-	for (node = engine->clients; node; node = jack_slist_next (node)) {
+	VERBOSE (engine, "++ jack_rechain_graph_parallel(): set %d", set);
 
-		jack_client_internal_t* client = (jack_client_internal_t*)node->data;
-		reverse_list = jack_slist_prepend (reverse_list, client);
-		jack_deliver_event (engine, client, &event);
-	}
+	event.type = GraphReordered;
 
-	if (engine->driver) {
-		jack_deliver_event (engine, engine->driver->internal_client, &event);
+	for (node = engine->clients; node; node = jack_slist_next (node)) {
+		((jack_client_internal_t*)node->data)->runfedcount = 0;
 	}
 
-	/* now issue playback latency callbacks in reverse graphorder
-	 */
-	event.x.n  = 1;
-	for (node = reverse_list; node; node = jack_slist_next (node)) {
-		jack_client_internal_t* client = (jack_client_internal_t*)node->data;
-		jack_deliver_event (engine, client, &event);
-	}
+	for (n = 0, node = engine->clients; node;
+	     node = jack_slist_next (node)) {
 
-	if (engine->driver) {
-		jack_deliver_event (engine, engine->driver->internal_client, &event);
-	}
+		client = (jack_client_internal_t*)node->data;
 
-	jack_slist_free (reverse_list);
-}
+		client->next_client = NULL;
+		client->subgraph_start_fd = -1;
+		client->subgraph_wait_fd = -1;
 
+		if (!jack_client_runs (client)) {
+			/* tell it again when it rejoins the chain */
+			client->reorder_order = -1;
+			continue;
+		}
 
-/* How the sort works:
- *
- * Each client has a "sortfeeds" list of clients indicating which clients
- * it should be considered as feeding for the purposes of sorting the
- * graph. This list differs from the clients it /actually/ feeds in the
- * following ways:
- *
- * 1. Connections from a client to itself are disregarded
- *
- * 2. Connections to a driver client are disregarded
- *
- * 3. If a connection from A to B is a feedback connection (ie there was
- *    already a path from B to A when the connection was made) then instead
- *    of B appearing on A's sortfeeds list, A will appear on B's sortfeeds
- *    list.
- *
- * If client A is on client B's sortfeeds list, client A must come after
- * client B in the execution order. The above 3 rules ensure that the
- * sortfeeds relation is always acyclic so that all ordering constraints
- * can actually be met.
- *
- * Each client also has a "truefeeds" list which is the same as sortfeeds
- * except that feedback connections appear normally instead of reversed.
- * This is used to detect whether the graph has become acyclic.
- *
- */
+		/* count the inputs each client has to wait for. this
+		   includes reversed feedback connections, so that a
+		   client never runs while something it feeds is still
+		   reading its buffers.
+		 */
 
-void
-jack_sort_graph (jack_engine_t *engine)
-{
-	/* called, obviously, must hold engine->client_lock */
+		for (fnode = client->sortfeeds; fnode;
+		     fnode = jack_slist_next (fnode)) {
+			dst = (jack_client_internal_t*)fnode->data;
+			if (jack_client_runs (dst)) {
+				dst->runfedcount++;
+			}
+		}
 
-	VERBOSE (engine, "++ jack_sort_graph");
-	engine->clients = jack_slist_sort (engine->clients,
-					   (JCompareFunc)jack_client_sort);
-	jack_compute_all_port_total_latencies (engine);
-	jack_compute_new_latency (engine);
-	jack_rechain_graph (engine);
-	engine->timeout_count = 0;
-	VERBOSE (engine, "-- jack_sort_graph");
-}
+		client->execution_order = n++;
 
-static int
-jack_client_sort (jack_client_internal_t *a, jack_client_internal_t *b)
-{
-	/* drivers are forced to the front, ie considered as sources
-	   rather than sinks for purposes of the sort */
+		if (jack_client_is_internal (client)) {
 
-	if (jack_client_feeds_transitive (a, b) ||
-	    (a->control->type == ClientDriver &&
-	     b->control->type != ClientDriver)) {
-		return -1;
-	} else if (jack_client_feeds_transitive (b, a) ||
-		   (b->control->type == ClientDriver &&
-		    a->control->type != ClientDriver)) {
-		return 1;
-	} else {
-		return 0;
-	}
-}
+			/* the server thread runs internal clients
+			   itself, as soon as their inputs are ready */
 
-/* transitive closure of the relation expressed by the sortfeeds lists. */
-static int
-jack_client_feeds_transitive (jack_client_internal_t *source,
-			      jack_client_internal_t *dest )
-{
-	jack_client_internal_t *med;
-	JSList *node;
+			VERBOSE (engine, "client %s: internal client, "
+				 "execution_order=%lu.",
+				 client->control->name,
+				 client->execution_order);
 
-	if (jack_slist_find (source->sortfeeds, dest)) {
-		return 1;
-	}
+			jack_deliver_reorder (engine, client, &event, 0);
 
-	for (node = source->sortfeeds; node; node = jack_slist_next (node)) {
+		} else {
 
-		med = (jack_client_internal_t*)node->data;
+			/* every external client is a subgraph of its
+			   own, started on its own FIFO 2 * graph_slot
+			   and finishing on the one after it.
+			 */
 
-		if (jack_client_feeds_transitive (med, dest)) {
-			return 1;
+			client->subgraph_start_slot = 2 * client->graph_slot;
+			client->subgraph_wait_slot = 2 * client->graph_slot + 1;
+			client->subgraph_start_fd =
+				jack_get_fifo_fd (engine, client->subgraph_start_slot);
+			client->subgraph_wait_fd =
+				jack_get_fifo_fd (engine, client->subgraph_wait_slot);
+
+			VERBOSE (engine, "client %s: start_fd=%d, wait_fd=%d, "
+				 "execution_order=%lu.",
+				 client->control->name,
+				 client->subgraph_start_fd,
+				 client->subgraph_wait_fd,
+				 client->execution_order);
+
+			jack_chain_external (engine, client, set,
+					     client->subgraph_wait_slot, 1);
 		}
 	}
 
+	jack_engine_publish_plan (engine);
+
+	VERBOSE (engine, "-- jack_rechain_graph_parallel()");
+
 	return 0;
 }
 
-/**
- * Checks whether the graph has become acyclic and if so modifies client
- * sortfeeds lists to turn leftover feedback connections into normal ones.
- * This lowers latency, but at the expense of some data corruption.
+#endif /* !JACK_USE_MACH_THREADS */
+
+/* The last external client of a subgraph signals its own finish,
+ * which the server waits for before it goes on.
  */
 static void
-jack_check_acyclic (jack_engine_t *engine)
+jack_end_subgraph (jack_engine_t *engine, jack_client_internal_t *subgraph_client,
+		   jack_client_internal_t *last, int set, int upstream)
 {
-	JSList *srcnode, *dstnode, *portnode, *connnode;
-	jack_client_internal_t *src, *dst;
-	jack_port_internal_t *port;
-	jack_connection_internal_t *conn;
-	int stuck;
-	int unsortedclients = 0;
+	int slot = 2 * last->graph_slot + 1;
 
-	VERBOSE (engine, "checking for graph become acyclic");
+	subgraph_client->subgraph_wait_fd = jack_get_fifo_fd (engine, slot);
+	subgraph_client->subgraph_wait_slot = slot;
 
-	for (srcnode = engine->clients; srcnode;
-	     srcnode = jack_slist_next (srcnode)) {
+	VERBOSE (engine, "client %s: wait_fd=%d (slot %d, after %s)",
+		 subgraph_client->control->name,
+		 subgraph_client->subgraph_wait_fd, slot,
+		 last->control->name);
 
-		src = (jack_client_internal_t*)srcnode->data;
-		src->tfedcount = src->fedcount;
-		unsortedclients++;
-	}
+	jack_chain_external (engine, last, set, slot, upstream);
+}
 
-	stuck = FALSE;
+int
+jack_rechain_graph (jack_engine_t *engine)
+{
+	JSList *node, *next;
+	unsigned long n;
+	int err = 0;
+	jack_client_internal_t *subgraph_client, *next_client, *prev;
+	jack_event_t event;
+	int upstream_is_jackd, prev_upstream = 0;
+	int set;
 
-	/* find out whether a normal sort would have been possible */
-	while (unsortedclients && !stuck) {
+#ifndef JACK_USE_MACH_THREADS
+	if (engine->parallel) {
+		return jack_rechain_graph_parallel (engine);
+	}
+#endif
 
-		stuck = TRUE;
+	VALGRIND_MEMSET (&event, 0, sizeof(event));
 
-		for (srcnode = engine->clients; srcnode;
-		     srcnode = jack_slist_next (srcnode)) {
+	set = jack_engine_next_plan_set (engine);
 
-			src = (jack_client_internal_t*)srcnode->data;
+#ifdef JACK_HAVE_FUTEX
+	/* use the futex chain only if every external client in it can
+	   follow, and their slots fit in graph_futex[]. clients find
+	   out through their control block before the GraphReordered
+	   event reaches them. this only changes when clients join or
+	   leave the chain, which is never done while plan cycles are
+	   allowed.
+	 */
+	engine->futex_active = engine->futex_wakeup;
 
-			if (!src->tfedcount) {
+	for (node = engine->clients; node; node = jack_slist_next (node)) {
+		jack_client_internal_t* client = (jack_client_internal_t*)node->data;
 
-				stuck = FALSE;
-				unsortedclients--;
-				src->tfedcount = -1;
+		if (jack_client_runs (client)
+		    && !jack_client_is_internal (client)
+		    && (!client->control->futex_capable
+			|| 2 * client->graph_slot + 1 >= JACK_GRAPH_FUTEX_MAX)) {
+			engine->futex_active = FALSE;
+		}
+	}
 
-				for (dstnode = src->truefeeds; dstnode;
-				     dstnode = jack_slist_next (dstnode)) {
+	for (node = engine->clients; node; node = jack_slist_next (node)) {
+		jack_client_internal_t* client = (jack_client_internal_t*)node->data;
 
-					dst = (jack_client_internal_t*)
-					      dstnode->data;
-					dst->tfedcount--;
-				}
-			}
+		if (!jack_client_is_internal (client)
+		    && client->control->futex_wakeup != engine->futex_active) {
+			client->control->futex_wakeup = engine->futex_active;
+			/* it has to switch over, so tell it in any case */
+			client->reorder_order = -1;
 		}
 	}
+#endif
 
-	if (stuck) {
+	subgraph_client = 0;
+	prev = 0;
 
-		VERBOSE (engine, "graph is still cyclic" );
-	} else {
+	VERBOSE (engine, "++ jack_rechain_graph(): set %d", set);
 
-		VERBOSE (engine, "graph has become acyclic");
+	event.type = GraphReordered;
 
-		/* turn feedback connections around in sortfeeds */
-		for (srcnode = engine->clients; srcnode;
-		     srcnode = jack_slist_next (srcnode)) {
+	for (n = 0, node = engine->clients, next = NULL; node; node = next) {
 
-			src = (jack_client_internal_t*)srcnode->data;
+		jack_client_internal_t* client = (jack_client_internal_t*)node->data;
 
-			for (portnode = src->ports; portnode;
-			     portnode = jack_slist_next (portnode)) {
+		next = jack_slist_next (node);
 
-				port = (jack_port_internal_t*)portnode->data;
+		if (!jack_client_runs (client)) {
+			/* tell it again when it rejoins the chain */
+			client->reorder_order = -1;
+		}
 
-				for (connnode = port->connections; connnode;
-				     connnode = jack_slist_next (connnode)) {
+		if (!client->control->process_cbset && !client->control->thread_cb_cbset) {
+			continue;
+		}
 
-					conn = (jack_connection_internal_t*)
-					       connnode->data;
+		VERBOSE (engine, "+++ client is now %s active ? %d",
+			 client->control->name, client->control->active);
 
-					if (conn->dir == -1 ) {
-						/*&&
-						        conn->srcclient == src) */
+		if (client->control->active) {
 
-						VERBOSE (engine,
-							 "reversing connection from "
-							 "%s to %s",
-							 conn->srcclient->control->name,
-							 conn->dstclient->control->name);
-						conn->dir = 1;
-						conn->dstclient->sortfeeds =
-							jack_slist_remove
-								(conn->dstclient->sortfeeds,
-								conn->srcclient);
+			/* find the next active client. its ok for
+			 * this to be NULL */
+
+			while (next) {
+				if (client->control->active && (client->control->process_cbset || client->control->thread_cb_cbset)) {
+					break;
+				}
+				next = jack_slist_next (next);
+			}
+			;
+
+			if (next == NULL) {
+				next_client = NULL;
+			} else {
+				next_client = (jack_client_internal_t*)
+					      next->data;
+			}
+
+			client->execution_order = n++;
+			client->next_client = next_client;
+
+			if (jack_client_is_internal (client)) {
+
+				/* break the chain for the current
+				 * subgraph. the server will wait for
+				 * the last client in it to finish,
+				 * and will then execute this internal
+				 * client. */
+
+				if (subgraph_client) {
+					jack_end_subgraph (engine, subgraph_client,
+							   prev, set, prev_upstream);
+				}
+
+				VERBOSE (engine, "client %s: internal "
+					 "client, execution_order="
+					 "%lu.",
+					 client->control->name,
+					 client->execution_order);
+
+				/* this does the right thing for
+				 * internal clients too
+				 */
+
+				jack_deliver_reorder (engine, client, &event, 0);
+
+				subgraph_client = 0;
+
+			} else {
+
+				if (subgraph_client == NULL) {
+
+					/* start a new subgraph. the
+					 * engine will start the chain
+					 * by writing to this client's
+					 * FIFO.
+					 */
+
+					subgraph_client = client;
+					subgraph_client->subgraph_start_slot =
+						2 * client->graph_slot;
+					subgraph_client->subgraph_start_fd =
+						jack_get_fifo_fd (engine,
+								  subgraph_client->subgraph_start_slot);
+					VERBOSE (engine, "client %s: "
+						 "start_fd=%d, execution"
+						 "_order=%lu.",
+						 subgraph_client->
+						 control->name,
+						 subgraph_client->
+						 subgraph_start_fd,
+						 client->execution_order);
+
+					/* this external client after
+					   this will have jackd as its
+					   upstream connection.
+					 */
+
+					upstream_is_jackd = 1;
+
+				} else {
+					VERBOSE (engine, "client %s: in"
+						 " subgraph after %s, "
+						 "execution_order="
+						 "%lu.",
+						 client->control->name,
+						 subgraph_client->
+						 control->name,
+						 client->execution_order);
+					subgraph_client->subgraph_wait_fd = -1;
+
+					/* the one before wakes this
+					   one, so this external
+					   client will have another
+					   client as its upstream
+					   connection.
+					 */
+
+					jack_chain_external (engine, prev, set,
+							     2 * client->graph_slot,
+							     prev_upstream);
+					upstream_is_jackd = 0;
+				}
+
+				prev = client;
+				prev_upstream = upstream_is_jackd;
+			}
+		}
+	}
+
+	if (subgraph_client) {
+		jack_end_subgraph (engine, subgraph_client, prev, set,
+				   prev_upstream);
+	}
+
+	jack_engine_publish_plan (engine);
+
+	VERBOSE (engine, "-- jack_rechain_graph()");
+
+	return err;
+}
+
+/* A port's total latency is its own latency plus the largest latency
+ * of the ports on the other end of its connections. Connections only
+ * join an output to an input, and the server knows nothing of the
+ * paths inside a client, so that is as far as it goes.
+ */
+static jack_nframes_t
+jack_get_port_total_latency (jack_engine_t *engine,
+			     jack_port_internal_t *port)
+{
+	JSList *node;
+	jack_connection_internal_t *connection;
+	jack_port_internal_t *other;
+	jack_nframes_t max_latency = 0;
+
+	/* call tree must hold engine->client_lock. */
+
+	for (node = port->connections; node; node = jack_slist_next (node)) {
+
+		connection = (jack_connection_internal_t*)node->data;
+
+		if (connection->destination == port) {
+			other = connection->source;
+		} else {
+			other = connection->destination;
+		}
+
+		if (other->shared->latency > max_latency) {
+			max_latency = other->shared->latency;
+		}
+	}
+
+	return port->shared->latency + max_latency;
+}
+
+static void
+jack_compute_port_total_latency (jack_engine_t* engine, jack_port_shared_t* port)
+{
+	if (port->in_use) {
+		port->total_latency =
+			jack_get_port_total_latency (
+				engine, &engine->internal_ports[port->id]);
+	}
+}
+
+static void
+jack_compute_all_port_total_latencies (jack_engine_t *engine)
+{
+	unsigned int i;
+
+	for (i = 0; i < engine->control->port_max; i++) {
+		jack_compute_port_total_latency (engine,
+						 &engine->control->ports[i]);
+	}
+}
+
+#define JACK_LATENCY_DOWNSTREAM 1
+#define JACK_LATENCY_UPSTREAM   2
+
+/* Deliver capture latency callbacks in graph order, then playback
+ * latency callbacks in reverse graph order, so that each client sees
+ * the latencies of the clients it depends on already updated.
+ *
+ * If the latencies are being recomputed because of a connection from
+ * client src to client dst, only capture latencies downstream of dst
+ * and playback latencies upstream of src can have changed, so only
+ * those clients are called. src and dst are NULL to call everyone.
+ */
+static void
+jack_compute_new_latency (jack_engine_t *engine,
+			  jack_client_internal_t *src,
+			  jack_client_internal_t *dst)
+{
+	JSList *node, *fnode;
+	JSList *reverse_list = NULL;
+	jack_client_internal_t *client, *fed;
+	jack_event_t event;
+	int changed;
+
+	VALGRIND_MEMSET (&event, 0, sizeof(event));
+
+	for (node = engine->clients; node; node = jack_slist_next (node)) {
+		client = (jack_client_internal_t*)node->data;
+		reverse_list = jack_slist_prepend (reverse_list, client);
+		client->latency_mark = (src ? 0 : (JACK_LATENCY_DOWNSTREAM
+						   | JACK_LATENCY_UPSTREAM));
+	}
+
+	if (src) {
+
+		dst->latency_mark |= JACK_LATENCY_DOWNSTREAM;
+		src->latency_mark |= JACK_LATENCY_UPSTREAM;
+
+		/* one pass does it unless there are feedback
+		   connections */
+
+		do {
+			changed = FALSE;
+			for (node = engine->clients; node;
+			     node = jack_slist_next (node)) {
+				client = (jack_client_internal_t*)node->data;
+				if (!(client->latency_mark
+				      & JACK_LATENCY_DOWNSTREAM)) {
+					continue;
+				}
+				for (fnode = client->truefeeds; fnode;
+				     fnode = jack_slist_next (fnode)) {
+					fed = (jack_client_internal_t*)
+					      fnode->data;
+					if (!(fed->latency_mark
+					      & JACK_LATENCY_DOWNSTREAM)) {
+						fed->latency_mark |=
+							JACK_LATENCY_DOWNSTREAM;
+						changed = TRUE;
+					}
+				}
+			}
+		} while (changed);
+
+		do {
+			changed = FALSE;
+			for (node = reverse_list; node;
+			     node = jack_slist_next (node)) {
+				client = (jack_client_internal_t*)node->data;
+				if (client->latency_mark
+				    & JACK_LATENCY_UPSTREAM) {
+					continue;
+				}
+				for (fnode = client->truefeeds; fnode;
+				     fnode = jack_slist_next (fnode)) {
+					fed = (jack_client_internal_t*)
+					      fnode->data;
+					if (fed->latency_mark
+					    & JACK_LATENCY_UPSTREAM) {
+						client->latency_mark |=
+							JACK_LATENCY_UPSTREAM;
+						changed = TRUE;
+						break;
+					}
+				}
+			}
+		} while (changed);
+	}
+
+	event.type = LatencyCallback;
+	event.x.n  = 0;
+
+	for (node = engine->clients; node; node = jack_slist_next (node)) {
+		client = (jack_client_internal_t*)node->data;
+		if (client->latency_mark & JACK_LATENCY_DOWNSTREAM) {
+			jack_deliver_event (engine, client, &event);
+		}
+	}
+
+	if (engine->driver) {
+		jack_deliver_event (engine, engine->driver->internal_client, &event);
+	}
+
+	event.x.n  = 1;
+
+	for (node = reverse_list; node; node = jack_slist_next (node)) {
+		client = (jack_client_internal_t*)node->data;
+		if (client->latency_mark & JACK_LATENCY_UPSTREAM) {
+			jack_deliver_event (engine, client, &event);
+		}
+	}
+
+	if (engine->driver) {
+		jack_deliver_event (engine, engine->driver->internal_client, &event);
+	}
+
+	jack_slist_free (reverse_list);
+}
+
+/* Record a connection change for the next jack_sort_graph() */
+static void
+jack_note_latency_edge (jack_engine_t *engine, jack_port_internal_t *src,
+			jack_port_internal_t *dst)
+{
+	engine->latency_edges++;
+	engine->latency_src = src;
+	engine->latency_dst = dst;
+}
+
+/* Bring port and client latencies up to date. Called from
+ * jack_sort_graph(), with the client_lock held.
+ */
+static void
+jack_compute_latencies (jack_engine_t *engine)
+{
+	jack_client_internal_t *src = NULL;
+	jack_client_internal_t *dst = NULL;
+
+	/* when the graph is being sorted because of a single
+	   connection change, only the two ports on it have new total
+	   latencies */
+
+	if (engine->latency_sorts == 1 && engine->latency_edges == 1) {
+		src = jack_client_internal_by_id (
+			engine, engine->latency_src->shared->client_id);
+		dst = jack_client_internal_by_id (
+			engine, engine->latency_dst->shared->client_id);
+	}
+
+	if (src && dst) {
+		jack_compute_port_total_latency (engine,
+						 engine->latency_src->shared);
+		jack_compute_port_total_latency (engine,
+						 engine->latency_dst->shared);
+		jack_compute_new_latency (engine, src, dst);
+	} else {
+		jack_compute_all_port_total_latencies (engine);
+		jack_compute_new_latency (engine, NULL, NULL);
+	}
+
+	engine->latency_sorts = 0;
+	engine->latency_edges = 0;
+}
+
+/* How the sort works:
+ *
+ * Each client has a "sortfeeds" list of clients indicating which clients
+ * it should be considered as feeding for the purposes of sorting the
+ * graph. This list differs from the clients it /actually/ feeds in the
+ * following ways:
+ *
+ * 1. Connections from a client to itself are disregarded
+ *
+ * 2. Connections to a driver client are disregarded
+ *
+ * 3. If a connection from A to B is a feedback connection (ie there was
+ *    already a path from B to A when the connection was made) then instead
+ *    of B appearing on A's sortfeeds list, A will appear on B's sortfeeds
+ *    list.
+ *
+ * If client A is on client B's sortfeeds list, client A must come after
+ * client B in the execution order. The above 3 rules ensure that the
+ * sortfeeds relation is always acyclic so that all ordering constraints
+ * can actually be met.
+ *
+ * Each client also has a "truefeeds" list which is the same as sortfeeds
+ * except that feedback connections appear normally instead of reversed.
+ * This is used to detect whether the graph has become acyclic.
+ *
+ * The execution order is a topological order of the sortfeeds relation
+ * (Kahn's algorithm), with the drivers forced to the front. Clients
+ * that do not depend on each other keep their previous relative order.
+ *
+ */
+
+static void
+jack_sort_clients (jack_engine_t *engine)
+{
+	jack_client_internal_t **order;
+	jack_client_internal_t *client, *dst;
+	JSList *node, *fnode;
+	unsigned int n, head, tail;
+
+	n = jack_slist_length (engine->clients);
+
+	if (n < 2) {
+		return;
+	}
+
+	if ((order = (jack_client_internal_t**)
+		     malloc (sizeof(jack_client_internal_t*) * n)) == NULL) {
+		jack_error ("cannot allocate memory to sort %u clients", n);
+		return;
+	}
+
+	for (node = engine->clients; node; node = jack_slist_next (node)) {
+		((jack_client_internal_t*)node->data)->sortfedcount = 0;
+	}
+
+	for (node = engine->clients; node; node = jack_slist_next (node)) {
+		client = (jack_client_internal_t*)node->data;
+		for (fnode = client->sortfeeds; fnode;
+		     fnode = jack_slist_next (fnode)) {
+			((jack_client_internal_t*)fnode->data)->sortfedcount++;
+		}
+	}
+
+	tail = 0;
+
+	/* drivers are forced to the front, ie considered as sources
+	   rather than sinks for purposes of the sort. a count of -1
+	   marks a client as placed. */
+
+	for (node = engine->clients; node; node = jack_slist_next (node)) {
+		client = (jack_client_internal_t*)node->data;
+		if (client->control->type == ClientDriver) {
+			client->sortfedcount = -1;
+			order[tail++] = client;
+		}
+	}
+
+	for (node = engine->clients; node; node = jack_slist_next (node)) {
+		client = (jack_client_internal_t*)node->data;
+		if (client->sortfedcount == 0) {
+			client->sortfedcount = -1;
+			order[tail++] = client;
+		}
+	}
+
+	for (head = 0; head < tail; head++) {
+		for (fnode = order[head]->sortfeeds; fnode;
+		     fnode = jack_slist_next (fnode)) {
+			dst = (jack_client_internal_t*)fnode->data;
+			if (dst->sortfedcount > 0 && --dst->sortfedcount == 0) {
+				dst->sortfedcount = -1;
+				order[tail++] = dst;
+			}
+		}
+	}
+
+	if (tail < n) {
+
+		/* can't happen as long as connect and
+		   jack_check_acyclic() keep sortfeeds acyclic */
+
+		jack_error ("client sort order has a cycle; %u clients "
+			    "left in their previous order", n - tail);
+
+		for (node = engine->clients; node; node = jack_slist_next (node)) {
+			client = (jack_client_internal_t*)node->data;
+			if (client->sortfedcount != -1) {
+				order[tail++] = client;
+			}
+		}
+	}
+
+	/* reuse the list nodes for the new order */
+
+	for (head = 0, node = engine->clients; node;
+	     node = jack_slist_next (node)) {
+		node->data = order[head++];
+	}
+
+	free (order);
+}
+
+/* Whether engine->clients is still a valid execution order: drivers
+ * first, and every client ahead of everything on its sortfeeds list.
+ */
+static int
+jack_client_order_valid (jack_engine_t *engine)
+{
+	jack_client_internal_t *client;
+	JSList *node, *fnode;
+	int pos, seen_client;
+
+	for (pos = 0, seen_client = FALSE, node = engine->clients; node;
+	     node = jack_slist_next (node)) {
+		client = (jack_client_internal_t*)node->data;
+		if (client->control->type == ClientDriver) {
+			if (seen_client) {
+				return FALSE;
+			}
+		} else {
+			seen_client = TRUE;
+		}
+		client->sortfedcount = pos++;
+	}
+
+	for (node = engine->clients; node; node = jack_slist_next (node)) {
+		client = (jack_client_internal_t*)node->data;
+		for (fnode = client->sortfeeds; fnode;
+		     fnode = jack_slist_next (fnode)) {
+			if (((jack_client_internal_t*)fnode->data)->sortfedcount
+			    <= client->sortfedcount) {
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+void
+jack_sort_graph (jack_engine_t *engine)
+{
+	/* called, obviously, must hold engine->client_lock */
+
+	jack_port_internal_t *mix_src = NULL;
+	jack_port_internal_t *mix_dst = NULL;
+
+	engine->latency_sorts++;
+
+	if (engine->sort_deferred) {
+		/* a graph transaction will sort once it is done */
+		engine->sort_pending = TRUE;
+		return;
+	}
+
+	VERBOSE (engine, "++ jack_sort_graph");
+
+	/* most connections don't contradict the current order, in
+	   which case nobody has to move */
+
+	if (!jack_client_order_valid (engine)) {
+		jack_sort_clients (engine);
+	}
+
+	/* a single connection change only touches the mix groups of
+	   its destination; anything else builds them all again */
+
+	if (engine->latency_sorts == 1 && engine->latency_edges == 1) {
+		mix_src = engine->latency_src;
+		mix_dst = engine->latency_dst;
+	}
+
+	/* the list is in its new order, but the plan still has the
+	   old one, so cycles can go on while latencies are updated */
+
+	jack_engine_allow_plan_cycles (engine);
+	jack_compute_latencies (engine);
+	jack_engine_block_plan_cycles (engine);
+
+	jack_rechain_graph (engine);
+
+	/* after the plan, so that internal clients have the
+	   connection lists the groups are made from */
+	jack_update_mix_groups (engine, mix_src, mix_dst);
+
+	engine->timeout_count = 0;
+	VERBOSE (engine, "-- jack_sort_graph");
+}
+
+static int
+jack_client_feeds_search (jack_client_internal_t *source,
+			  jack_client_internal_t *dest, unsigned long mark)
+{
+	jack_client_internal_t *med;
+	JSList *node;
+
+	/* each client is looked at once per search */
+
+	if (source->sort_mark == mark) {
+		return 0;
+	}
+
+	source->sort_mark = mark;
+
+	for (node = source->sortfeeds; node; node = jack_slist_next (node)) {
+
+		med = (jack_client_internal_t*)node->data;
+
+		if (med == dest || jack_client_feeds_search (med, dest, mark)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* transitive closure of the relation expressed by the sortfeeds lists. */
+static int
+jack_client_feeds_transitive (jack_client_internal_t *source,
+			      jack_client_internal_t *dest )
+{
+	static unsigned long mark = 0;
+
+	return jack_client_feeds_search (source, dest, ++mark);
+}
+
+/**
+ * Checks whether the graph has become acyclic and if so modifies client
+ * sortfeeds lists to turn leftover feedback connections into normal ones.
+ * This lowers latency, but at the expense of some data corruption.
+ */
+static void
+jack_check_acyclic (jack_engine_t *engine)
+{
+	JSList *srcnode, *dstnode, *portnode, *connnode;
+	jack_client_internal_t *src, *dst;
+	jack_port_internal_t *port;
+	jack_connection_internal_t *conn;
+	int stuck;
+	int unsortedclients = 0;
+
+	VERBOSE (engine, "checking for graph become acyclic");
+
+	for (srcnode = engine->clients; srcnode;
+	     srcnode = jack_slist_next (srcnode)) {
+
+		src = (jack_client_internal_t*)srcnode->data;
+		src->tfedcount = src->fedcount;
+		unsortedclients++;
+	}
+
+	stuck = FALSE;
+
+	/* find out whether a normal sort would have been possible */
+	while (unsortedclients && !stuck) {
+
+		stuck = TRUE;
+
+		for (srcnode = engine->clients; srcnode;
+		     srcnode = jack_slist_next (srcnode)) {
+
+			src = (jack_client_internal_t*)srcnode->data;
+
+			if (!src->tfedcount) {
+
+				stuck = FALSE;
+				unsortedclients--;
+				src->tfedcount = -1;
+
+				for (dstnode = src->truefeeds; dstnode;
+				     dstnode = jack_slist_next (dstnode)) {
+
+					dst = (jack_client_internal_t*)
+					      dstnode->data;
+					dst->tfedcount--;
+				}
+			}
+		}
+	}
+
+	if (stuck) {
+
+		VERBOSE (engine, "graph is still cyclic" );
+	} else {
+
+		VERBOSE (engine, "graph has become acyclic");
+
+		/* turn feedback connections around in sortfeeds */
+		for (srcnode = engine->clients; srcnode;
+		     srcnode = jack_slist_next (srcnode)) {
+
+			src = (jack_client_internal_t*)srcnode->data;
+
+			for (portnode = src->ports; portnode;
+			     portnode = jack_slist_next (portnode)) {
+
+				port = (jack_port_internal_t*)portnode->data;
+
+				for (connnode = port->connections; connnode;
+				     connnode = jack_slist_next (connnode)) {
+
+					conn = (jack_connection_internal_t*)
+					       connnode->data;
+
+					if (conn->dir == -1 ) {
+						/*&&
+						        conn->srcclient == src) */
+
+						VERBOSE (engine,
+							 "reversing connection from "
+							 "%s to %s",
+							 conn->srcclient->control->name,
+							 conn->dstclient->control->name);
+						conn->dir = 1;
+						conn->dstclient->sortfeeds =
+							jack_slist_remove
+								(conn->dstclient->sortfeeds,
+								conn->srcclient);
+
+						conn->srcclient->sortfeeds =
+							jack_slist_prepend
+								(conn->srcclient->sortfeeds,
+								conn->dstclient );
+					}
+				}
+			}
+		}
+		engine->feedbackcount = 0;
+	}
+}
+
+/**
+ * Dumps current engine configuration.
+ */
+void jack_dump_configuration (jack_engine_t *engine, int take_lock)
+{
+	JSList *clientnode, *portnode, *connectionnode;
+	jack_client_internal_t *client;
+	jack_client_control_t *ctl;
+	jack_port_internal_t *port;
+	jack_connection_internal_t* connection;
+	int n, m, o;
+
+	jack_info ("engine.c: <-- dump begins -->");
+
+	if (take_lock) {
+		jack_rdlock_graph (engine);
+	}
+
+	jack_info ("execution plan %lu, %lu cycles run from a plan "
+		   "without the graph lock",
+		   engine->plan ? engine->plan->generation : 0UL,
+		   engine->plan_cycles);
+
+	jack_info ("%" PRIu32 " server cycles met denormals (flushed: %s)",
+		   engine->control->denormal_cycles,
+		   engine->control->flush_denormals ? "yes" : "no");
+
+	jack_info ("MIDI buffer size class budget: %u%%",
+		   engine->midi_class_budget);
+
+	jack_info ("ports: %" PRIu32 " of %u in use, at most %" PRIu32
+		   ", %lu allocated, %lu refused",
+		   engine->ports_in_use, engine->port_max,
+		   engine->ports_in_use_max, engine->port_allocs,
+		   engine->port_alloc_failures);
+
+	for (n = 0, clientnode = engine->clients; clientnode;
+	     clientnode = jack_slist_next (clientnode)) {
+		client = (jack_client_internal_t*)clientnode->data;
+		ctl = client->control;
+
+		jack_info ("client #%d: %s (type: %d, process? %s, thread ? %s"
+			   " start=%d wait=%d spin hits=%" PRIu32
+			   " misses=%" PRIu32 " denormal cycles=%" PRIu32,
+			   ++n,
+			   ctl->name,
+			   ctl->type,
+			   ctl->process_cbset ? "yes" : "no",
+			   ctl->thread_cb_cbset ? "yes" : "no",
+			   client->subgraph_start_fd,
+			   client->subgraph_wait_fd,
+			   ctl->spin_hits, ctl->spin_misses,
+			   ctl->denormal_cycles);
+
+		for (m = 0, portnode = client->ports; portnode;
+		     portnode = jack_slist_next (portnode)) {
+			port = (jack_port_internal_t*)portnode->data;
+
+			jack_info ("\t port #%d: %s", ++m,
+				   port->shared->name);
+
+			for (o = 0, connectionnode = port->connections;
+			     connectionnode;
+			     connectionnode = jack_slist_next (connectionnode)) {
+				connection = (jack_connection_internal_t*)
+					     connectionnode->data;
+
+				jack_info ("\t\t connection #%d: %s %s",
+					   ++o,
+					   (port->shared->flags
+					    & JackPortIsInput) ? "<-" : "->",
+					   (port->shared->flags & JackPortIsInput) ?
+					   connection->source->shared->name :
+					   connection->destination->shared->name);
+			}
+		}
+	}
+
+	if (take_lock) {
+		jack_unlock_graph (engine);
+	}
+
+
+	jack_info ("engine.c: <-- dump ends -->");
+}
+
+static int
+jack_port_do_connect (jack_engine_t *engine,
+		      const char *source_port,
+		      const char *destination_port)
+{
+	jack_connection_internal_t *connection;
+	jack_port_internal_t *srcport, *dstport;
+	jack_port_id_t src_id, dst_id;
+	jack_client_internal_t *srcclient, *dstclient;
+	JSList *it;
+
+	if ((srcport = jack_get_port_by_name (engine, source_port)) == NULL) {
+		jack_error ("unknown source port in attempted connection [%s]",
+			    source_port);
+		return -1;
+	}
+
+	if ((dstport = jack_get_port_by_name (engine, destination_port))
+	    == NULL) {
+		jack_error ("unknown destination port in attempted connection"
+			    " [%s]", destination_port);
+		return -1;
+	}
+
+	if ((dstport->shared->flags & JackPortIsInput) == 0) {
+		jack_error ("destination port in attempted connection of"
+			    " %s and %s is not an input port",
+			    source_port, destination_port);
+		return -1;
+	}
+
+	if ((srcport->shared->flags & JackPortIsOutput) == 0) {
+		jack_error ("source port in attempted connection of %s and"
+			    " %s is not an output port",
+			    source_port, destination_port);
+		return -1;
+	}
+
+	if (srcport->shared->ptype_id != dstport->shared->ptype_id) {
+		jack_error ("ports used in attemped connection are not of "
+			    "the same data type");
+		return -1;
+	}
+
+	if ((srcclient = jack_client_internal_by_id (engine,
+						     srcport->shared->client_id))
+	    == 0) {
+		jack_error ("unknown client set as owner of port - "
+			    "cannot connect");
+		return -1;
+	}
+
+	if (!srcclient->control->active) {
+		jack_error ("cannot connect ports owned by inactive clients;"
+			    " \"%s\" is not active", srcclient->control->name);
+		return -1;
+	}
+
+	if ((dstclient = jack_client_internal_by_id (engine,
+						     dstport->shared->client_id))
+	    == 0) {
+		jack_error ("unknown client set as owner of port - cannot "
+			    "connect");
+		return -1;
+	}
+
+	if (!dstclient->control->active) {
+		jack_error ("cannot connect ports owned by inactive clients;"
+			    " \"%s\" is not active", dstclient->control->name);
+		return -1;
+	}
+
+	for (it = srcport->connections; it; it = it->next) {
+		if (((jack_connection_internal_t*)it->data)->destination
+		    == dstport) {
+			return EEXIST;
+		}
+	}
+
+	connection = (jack_connection_internal_t*)
+		     malloc (sizeof(jack_connection_internal_t));
+
+	connection->source = srcport;
+	connection->destination = dstport;
+	connection->srcclient = srcclient;
+	connection->dstclient = dstclient;
+	connection->gain_slot = -1;
+
+	src_id = srcport->shared->id;
+	dst_id = dstport->shared->id;
+
+	jack_lock_graph (engine);
+
+	/* clients keep running from the published plan while the
+	   connection is made, clients are told and a new plan is
+	   built */
+	jack_engine_allow_plan_cycles (engine);
+
+	if (dstport->connections && !dstport->shared->has_mixdown) {
+		jack_port_type_info_t *port_type =
+			jack_port_type_info (engine, dstport);
+		jack_error ("cannot make multiple connections to a port of"
+			    " type [%s]", port_type->type_name);
+		free (connection);
+		jack_engine_block_plan_cycles (engine);
+		jack_unlock_graph (engine);
+		return -1;
+	} else {
+
+		jack_port_leave_mix_group (engine, dstport);
+
+		if (dstclient->control->type == ClientDriver) {
+			/* Ignore output connections to drivers for purposes
+			   of sorting. Drivers are executed first in the sort
+			   order anyway, and we don't want to treat graphs
+			   such as driver -> client -> driver as containing
+			   feedback */
+
+			VERBOSE (engine,
+				 "connect %s and %s (output)",
+				 srcport->shared->name,
+				 dstport->shared->name);
+
+			connection->dir = 1;
+
+		} else if (srcclient != dstclient) {
+
+			srcclient->truefeeds = jack_slist_prepend
+						       (srcclient->truefeeds, dstclient);
+
+			dstclient->fedcount++;
+
+			if (jack_client_feeds_transitive (dstclient,
+							  srcclient ) ||
+			    (dstclient->control->type == ClientDriver &&
+			     srcclient->control->type != ClientDriver)) {
+
+				/* dest is running before source so
+				   this is a feedback connection */
+
+				VERBOSE (engine,
+					 "connect %s and %s (feedback)",
+					 srcport->shared->name,
+					 dstport->shared->name);
+
+				dstclient->sortfeeds = jack_slist_prepend
+							       (dstclient->sortfeeds, srcclient);
+
+				connection->dir = -1;
+				engine->feedbackcount++;
+				VERBOSE (engine,
+					 "feedback count up to %d",
+					 engine->feedbackcount);
+
+			} else {
+
+				/* this is not a feedback connection */
+
+				VERBOSE (engine,
+					 "connect %s and %s (forward)",
+					 srcport->shared->name,
+					 dstport->shared->name);
+
+				srcclient->sortfeeds = jack_slist_prepend
+							       (srcclient->sortfeeds, dstclient);
+
+				connection->dir = 1;
+			}
+		} else {
+			/* this is a connection to self */
+
+			VERBOSE (engine,
+				 "connect %s and %s (self)",
+				 srcport->shared->name,
+				 dstport->shared->name);
+
+			connection->dir = 0;
+		}
+
+		dstport->connections =
+			jack_slist_prepend (dstport->connections, connection);
+		srcport->connections =
+			jack_slist_prepend (srcport->connections, connection);
+
+		DEBUG ("actually sorted the graph...");
+
+		jack_send_connection_notification (engine,
+						   srcport->shared->client_id,
+						   src_id, dst_id, TRUE);
+
+
+		jack_send_connection_notification (engine,
+						   dstport->shared->client_id,
+						   dst_id, src_id, TRUE);
+
+		/* send a port connection notification just once to everyone who cares excluding clients involved in the connection */
+
+		jack_notify_all_port_interested_clients (engine, srcport->shared->client_id, dstport->shared->client_id, src_id, dst_id, 1);
+
+		jack_note_latency_edge (engine, srcport, dstport);
+		jack_sort_graph (engine);
+	}
+
+	jack_engine_block_plan_cycles (engine);
+	jack_unlock_graph (engine);
+
+	return 0;
+}
+
+int
+jack_port_disconnect_internal (jack_engine_t *engine,
+			       jack_port_internal_t *srcport,
+			       jack_port_internal_t *dstport )
+
+{
+	JSList *node;
+	jack_connection_internal_t *connect;
+	int ret = -1;
+	jack_port_id_t src_id, dst_id;
+	int check_acyclic = engine->feedbackcount;
+
+	/* call tree **** MUST HOLD **** engine->client_lock. */
+	for (node = srcport->connections; node;
+	     node = jack_slist_next (node)) {
+
+		connect = (jack_connection_internal_t*)node->data;
+
+		if (connect->source == srcport &&
+		    connect->destination == dstport) {
+
+			VERBOSE (engine, "DIS-connect %s and %s",
+				 srcport->shared->name,
+				 dstport->shared->name);
+
+			srcport->connections =
+				jack_slist_remove (srcport->connections,
+						   connect);
+			dstport->connections =
+				jack_slist_remove (dstport->connections,
+						   connect);
+			jack_port_leave_mix_group (engine, dstport);
+
+			src_id = srcport->shared->id;
+			dst_id = dstport->shared->id;
+
+			/* this is a bit harsh, but it basically says
+			   that if we actually do a disconnect, and
+			   its the last one, then make sure that any
+			   input monitoring is turned off on the
+			   srcport. this isn't ideal for all
+			   situations, but it works better for most of
+			   them.
+			 */
+			if (srcport->connections == NULL) {
+				srcport->shared->monitor_requests = 0;
+			}
+
+			jack_engine_allow_plan_cycles (engine);
+
+			jack_send_connection_notification (
+				engine, srcport->shared->client_id, src_id,
+				dst_id, FALSE);
+			jack_send_connection_notification (
+				engine, dstport->shared->client_id, dst_id,
+				src_id, FALSE);
+
+			/* send a port connection notification just once to everyone who cares excluding clients involved in the connection */
+
+			jack_notify_all_port_interested_clients (engine, srcport->shared->client_id, dstport->shared->client_id, src_id, dst_id, 0);
+
+			jack_engine_block_plan_cycles (engine);
+
+			if (connect->dir) {
+
+				jack_client_internal_t *src;
+				jack_client_internal_t *dst;
+
+				src = jack_client_internal_by_id
+					      (engine, srcport->shared->client_id);
+
+				dst =  jack_client_internal_by_id
+					      (engine, dstport->shared->client_id);
+
+				src->truefeeds = jack_slist_remove
+							 (src->truefeeds, dst);
+
+				dst->fedcount--;
+
+				if (connect->dir == 1) {
+					/* normal connection: remove dest from
+					   source's sortfeeds list */
+					src->sortfeeds = jack_slist_remove
+								 (src->sortfeeds, dst);
+				} else {
+					/* feedback connection: remove source
+					   from dest's sortfeeds list */
+					dst->sortfeeds = jack_slist_remove
+								 (dst->sortfeeds, src);
+					engine->feedbackcount--;
+					VERBOSE (engine,
+						 "feedback count down to %d",
+						 engine->feedbackcount);
+
+				}
+			} /* else self-connection: do nothing */
+
+			if (connect->gain_slot >= 0) {
+				jack_connection_gain (engine->control,
+						      connect->gain_slot)->in_use = 0;
+			}
+
+			jack_note_latency_edge (engine, srcport, dstport);
+			free (connect);
+			ret = 0;
+			break;
+		}
+	}
+
+	if (check_acyclic) {
+		jack_check_acyclic (engine);
+	}
+
+	jack_sort_graph (engine);
+
+	return ret;
+}
+
+static int
+jack_port_do_disconnect_all (jack_engine_t *engine,
+			     jack_port_id_t port_id)
+{
+	if (port_id >= engine->control->port_max) {
+		jack_error ("illegal port ID in attempted disconnection [%"
+			    PRIu32 "]", port_id);
+		return -1;
+	}
+
+	VERBOSE (engine, "clear connections for %s",
+		 engine->internal_ports[port_id].shared->name);
+
+	jack_lock_graph (engine);
+	jack_engine_allow_plan_cycles (engine);
+	jack_port_clear_connections (engine, &engine->internal_ports[port_id]);
+	jack_sort_graph (engine);
+	jack_engine_block_plan_cycles (engine);
+	jack_unlock_graph (engine);
+
+	return 0;
+}
+
+static int
+jack_port_do_disconnect (jack_engine_t *engine,
+			 const char *source_port,
+			 const char *destination_port)
+{
+	jack_port_internal_t *srcport, *dstport;
+	int ret = -1;
+
+	if ((srcport = jack_get_port_by_name (engine, source_port)) == NULL) {
+		jack_error ("unknown source port in attempted disconnection"
+			    " [%s]", source_port);
+		return -1;
+	}
+
+	if ((dstport = jack_get_port_by_name (engine, destination_port))
+	    == NULL) {
+		jack_error ("unknown destination port in attempted"
+			    " disconnection [%s]", destination_port);
+		return -1;
+	}
+
+	jack_lock_graph (engine);
+	jack_engine_allow_plan_cycles (engine);
+
+	ret = jack_port_disconnect_internal (engine, srcport, dstport);
+
+	jack_engine_block_plan_cycles (engine);
+	jack_unlock_graph (engine);
+
+	return ret;
+}
+
+/* Apply the operations of a GraphTransaction in order. The caller
+ * holds the request_lock throughout, so no other request gets in
+ * between, and the graph is sorted (and clients told about the new
+ * order) just once at the end.
+ */
+static int
+jack_do_graph_transaction (jack_engine_t *engine, jack_request_t *req,
+			   int internal)
+{
+	jack_graph_op_t *op;
+	jack_request_t *sub;
+	uint32_t i;
+	int failed = 0;
+
+	if ((sub = (jack_request_t*)malloc (sizeof(jack_request_t))) == NULL) {
+		jack_error ("cannot allocate graph transaction request");
+		return -1;
+	}
+
+	VERBOSE (engine, "graph transaction with %" PRIu32 " operations",
+		 req->x.transaction.nops);
+
+	engine->sort_deferred++;
+
+	for (i = 0; i < req->x.transaction.nops; i++) {
+
+		op = &req->x.transaction.ops[i];
+
+		/* the client may not have terminated them */
+		op->a[sizeof(op->a) - 1] = '\0';
+		op->b[sizeof(op->b) - 1] = '\0';
+
+		switch (op->type) {
+		case ConnectPorts:
+			op->status = jack_port_do_connect (engine, op->a, op->b);
+			break;
+
+		case DisconnectPorts:
+			op->status = jack_port_do_disconnect (engine, op->a,
+							      op->b);
+			break;
+
+		case DisconnectPort:
+			op->status = jack_port_do_disconnect_all (engine,
+								  op->port_id);
+			break;
+
+		case RegisterPort:
+			VALGRIND_MEMSET (sub, 0, sizeof(*sub));
+			sub->type = RegisterPort;
+			snprintf (sub->x.port_info.name,
+				  sizeof(sub->x.port_info.name), "%s", op->a);
+			snprintf (sub->x.port_info.type,
+				  sizeof(sub->x.port_info.type), "%s", op->b);
+			sub->x.port_info.flags = op->flags;
+			sub->x.port_info.buffer_size = op->buffer_size;
+			jack_uuid_copy (&sub->x.port_info.client_id,
+					req->x.transaction.client_id);
+			op->status = jack_port_do_register (engine, sub,
+							    internal);
+			op->port_id = sub->x.port_info.port_id;
+			break;
+
+		case UnRegisterPort:
+			VALGRIND_MEMSET (sub, 0, sizeof(*sub));
+			sub->type = UnRegisterPort;
+			sub->x.port_info.port_id = op->port_id;
+			jack_uuid_copy (&sub->x.port_info.client_id,
+					req->x.transaction.client_id);
+			op->status = jack_port_do_unregister (engine, sub);
+			break;
+
+		default:
+			jack_error ("request type %" PRIu32 " cannot be part "
+				    "of a graph transaction", op->type);
+			op->status = -1;
+			break;
+		}
+
+		if (op->status != 0) {
+			failed++;
+		}
+	}
+
+	if (--engine->sort_deferred == 0 && engine->sort_pending) {
+		engine->sort_pending = FALSE;
+		jack_lock_graph (engine);
+		jack_engine_allow_plan_cycles (engine);
+		jack_sort_graph (engine);
+		jack_engine_block_plan_cycles (engine);
+		jack_unlock_graph (engine);
+	}
+
+	free (sub);
+
+	return failed ? -1 : 0;
+}
+
+int
+jack_get_fifo_fd (jack_engine_t *engine, unsigned int which_fifo)
+{
+	/* caller must hold client_lock */
+	char path[PATH_MAX + 1];
+	struct stat statbuf;
+
+	snprintf (path, sizeof(path), "%s-%d", engine->fifo_prefix,
+		  which_fifo);
+
+	DEBUG ("%s", path);
+
+	if (stat (path, &statbuf)) {
+		if (errno == ENOENT) {
+
+			if (mkfifo (path, 0666) < 0) {
+				jack_error ("cannot create inter-client FIFO"
+					    " [%s] (%s)\n", path,
+					    strerror (errno));
+				return -1;
+			}
+
+		} else {
+			jack_error ("cannot check on FIFO %d\n", which_fifo);
+			return -1;
+		}
+	} else {
+		if (!S_ISFIFO (statbuf.st_mode)) {
+			jack_error ("FIFO %d (%s) already exists, but is not"
+				    " a FIFO!\n", which_fifo, path);
+			return -1;
+		}
+	}
+
+	if (which_fifo >= engine->fifo_size) {
+		unsigned int i;
+
+		engine->fifo = (int*)
+			       realloc (engine->fifo,
+					sizeof(int) * (engine->fifo_size + 16));
+		for (i = engine->fifo_size; i < engine->fifo_size + 16; i++)
+			engine->fifo[i] = -1;
+		engine->fifo_size += 16;
+	}
+
+	if (engine->fifo[which_fifo] < 0) {
+		if ((engine->fifo[which_fifo] =
+			     open (path, O_RDWR | O_CREAT | O_NONBLOCK, 0666)) < 0) {
+			jack_error ("cannot open fifo [%s] (%s)", path,
+				    strerror (errno));
+			return -1;
+		}
+		DEBUG ("opened engine->fifo[%d] == %d (%s)",
+		       which_fifo, engine->fifo[which_fifo], path);
+	}
+
+	return engine->fifo[which_fifo];
+}
+
+static void
+jack_clear_fifos (jack_engine_t *engine)
+{
+	/* caller must hold client_lock */
+
+	unsigned int i;
+	char buf[16];
 
-						conn->srcclient->sortfeeds =
-							jack_slist_prepend
-								(conn->srcclient->sortfeeds,
-								conn->dstclient );
-					}
-				}
+	/* this just drains the existing FIFO's of any data left in
+	   them by aborted clients, etc. there is only ever going to
+	   be 0, 1 or 2 bytes in them, but we'll allow for up to 16.
+	 */
+	for (i = 0; i < engine->fifo_size; i++) {
+		if (engine->fifo[i] >= 0) {
+			int nread = read (engine->fifo[i], buf, sizeof(buf));
+
+			if (nread < 0 && errno != EAGAIN) {
+				jack_error ("clear fifo[%d] error: %s",
+					    i, strerror (errno));
 			}
 		}
-		engine->feedbackcount = 0;
 	}
+
+#ifdef JACK_HAVE_FUTEX
+	/* same for the futex chain, but leave pending kicks alone */
+	for (i = 0; i < JACK_GRAPH_FUTEX_MAX; i++) {
+		__atomic_and_fetch (&engine->control->graph_futex[i],
+				    JACK_FUTEX_KICK, __ATOMIC_SEQ_CST);
+	}
+#endif
 }
 
-/**
- * Dumps current engine configuration.
+/* Make the FIFOs of an external client's graph slot, and drain them
+ * and its graph_futex[] words of anything the slot's last user left
+ * behind. Called before the client is in any plan.
  */
-void jack_dump_configuration (jack_engine_t *engine, int take_lock)
+void
+jack_clear_graph_slot (jack_engine_t *engine, int slot)
 {
-	JSList *clientnode, *portnode, *connectionnode;
-	jack_client_internal_t *client;
-	jack_client_control_t *ctl;
-	jack_port_internal_t *port;
-	jack_connection_internal_t* connection;
-	int n, m, o;
+	/* caller must hold client_lock */
 
-	jack_info ("engine.c: <-- dump begins -->");
+	char buf[16];
+	int i, fd;
 
-	if (take_lock) {
-		jack_rdlock_graph (engine);
+	for (i = 2 * slot; i <= 2 * slot + 1; i++) {
+		if ((fd = jack_get_fifo_fd (engine, i)) >= 0) {
+			while (read (fd, buf, sizeof(buf)) > 0) {
+			}
+		}
+#ifdef JACK_HAVE_FUTEX
+		if (i < JACK_GRAPH_FUTEX_MAX) {
+			__atomic_store_n (&engine->control->graph_futex[i], 0,
+					  __ATOMIC_SEQ_CST);
+		}
+#endif
 	}
+}
 
-	for (n = 0, clientnode = engine->clients; clientnode;
-	     clientnode = jack_slist_next (clientnode)) {
-		client = (jack_client_internal_t*)clientnode->data;
-		ctl = client->control;
-
-		jack_info ("client #%d: %s (type: %d, process? %s, thread ? %s"
-			   " start=%d wait=%d",
-			   ++n,
-			   ctl->name,
-			   ctl->type,
-			   ctl->process_cbset ? "yes" : "no",
-			   ctl->thread_cb_cbset ? "yes" : "no",
-			   client->subgraph_start_fd,
-			   client->subgraph_wait_fd);
-
-		for (m = 0, portnode = client->ports; portnode;
-		     portnode = jack_slist_next (portnode)) {
-			port = (jack_port_internal_t*)portnode->data;
-
-			jack_info ("\t port #%d: %s", ++m,
-				   port->shared->name);
+int
+jack_use_driver (jack_engine_t *engine, jack_driver_t *driver)
+{
+	if (engine->driver) {
+		engine->driver->detach (engine->driver, engine);
+		engine->driver = 0;
+	}
 
-			for (o = 0, connectionnode = port->connections;
-			     connectionnode;
-			     connectionnode = jack_slist_next (connectionnode)) {
-				connection = (jack_connection_internal_t*)
-					     connectionnode->data;
+	if (driver) {
+		engine->driver = driver;
 
-				jack_info ("\t\t connection #%d: %s %s",
-					   ++o,
-					   (port->shared->flags
-					    & JackPortIsInput) ? "<-" : "->",
-					   (port->shared->flags & JackPortIsInput) ?
-					   connection->source->shared->name :
-					   connection->destination->shared->name);
-			}
+		if (driver->attach (driver, engine)) {
+			engine->driver = 0;
+			return -1;
 		}
-	}
 
-	if (take_lock) {
-		jack_unlock_graph (engine);
+		engine->rolling_interval =
+			jack_rolling_interval (driver->period_usecs);
 	}
 
-
-	jack_info ("engine.c: <-- dump ends -->");
+	return 0;
 }
 
-static int
-jack_port_do_connect (jack_engine_t *engine,
-		      const char *source_port,
-		      const char *destination_port)
+int
+jack_add_slave_driver (jack_engine_t *engine, jack_driver_t *driver)
 {
-	jack_connection_internal_t *connection;
-	jack_port_internal_t *srcport, *dstport;
-	jack_port_id_t src_id, dst_id;
-	jack_client_internal_t *srcclient, *dstclient;
-	JSList *it;
+	if (driver) {
+		if (driver->attach (driver, engine)) {
+			jack_info ("could not attach slave %s\n", driver->internal_client->control->name);
+			return -1;
+		}
 
-	if ((srcport = jack_get_port_by_name (engine, source_port)) == NULL) {
-		jack_error ("unknown source port in attempted connection [%s]",
-			    source_port);
-		return -1;
+		engine->slave_drivers = jack_slist_append (engine->slave_drivers, driver);
 	}
 
-	if ((dstport = jack_get_port_by_name (engine, destination_port))
-	    == NULL) {
-		jack_error ("unknown destination port in attempted connection"
-			    " [%s]", destination_port);
-		return -1;
-	}
+	return 0;
+}
 
-	if ((dstport->shared->flags & JackPortIsInput) == 0) {
-		jack_error ("destination port in attempted connection of"
-			    " %s and %s is not an input port",
-			    source_port, destination_port);
-		return -1;
-	}
+/* PORT RELATED FUNCTIONS */
 
-	if ((srcport->shared->flags & JackPortIsOutput) == 0) {
-		jack_error ("source port in attempted connection of %s and"
-			    " %s is not an output port",
-			    source_port, destination_port);
-		return -1;
-	}
 
-	if (srcport->shared->ptype_id != dstport->shared->ptype_id) {
-		jack_error ("ports used in attemped connection are not of "
-			    "the same data type");
-		return -1;
-	}
+/* Port name index maintenance, see portindex.h. All of these are
+ * called with the port_lock held.
+ */
+static void
+jack_port_index_insert (jack_engine_t *engine, uint32_t hash,
+			jack_port_id_t id)
+{
+	jack_port_index_slot_t *slots = jack_port_index_slots (engine->control);
+	uint32_t mask = engine->control->port_index_size - 1;
+	uint32_t i;
 
-	if ((srcclient = jack_client_internal_by_id (engine,
-						     srcport->shared->client_id))
-	    == 0) {
-		jack_error ("unknown client set as owner of port - "
-			    "cannot connect");
-		return -1;
+	for (i = hash & mask;; i = (i + 1) & mask) {
+		if (slots[i].id == JACK_PORT_INDEX_EMPTY) {
+			engine->port_index_used++;
+			break;
+		}
+		if (slots[i].id == JACK_PORT_INDEX_DELETED) {
+			engine->port_index_deleted--;
+			engine->port_index_used++;
+			break;
+		}
 	}
 
-	if (!srcclient->control->active) {
-		jack_error ("cannot connect ports owned by inactive clients;"
-			    " \"%s\" is not active", srcclient->control->name);
-		return -1;
-	}
+	__atomic_store_n (&slots[i].hash, hash, __ATOMIC_RELAXED);
+	__atomic_store_n (&slots[i].id, id + 1, __ATOMIC_RELAXED);
+}
 
-	if ((dstclient = jack_client_internal_by_id (engine,
-						     dstport->shared->client_id))
-	    == 0) {
-		jack_error ("unknown client set as owner of port - cannot "
-			    "connect");
-		return -1;
+static void
+jack_port_index_remove (jack_engine_t *engine, uint32_t hash,
+			jack_port_id_t id)
+{
+	jack_port_index_slot_t *slots = jack_port_index_slots (engine->control);
+	uint32_t mask = engine->control->port_index_size - 1;
+	uint32_t i;
+
+	for (i = hash & mask; slots[i].id != JACK_PORT_INDEX_EMPTY;
+	     i = (i + 1) & mask) {
+		if (slots[i].id == id + 1 && slots[i].hash == hash) {
+			__atomic_store_n (&slots[i].id, JACK_PORT_INDEX_DELETED,
+					  __ATOMIC_RELAXED);
+			engine->port_index_used--;
+			engine->port_index_deleted++;
+			return;
+		}
 	}
+}
 
-	if (!dstclient->control->active) {
-		jack_error ("cannot connect ports owned by inactive clients;"
-			    " \"%s\" is not active", dstclient->control->name);
-		return -1;
-	}
+/* Deleted slots only end up in a chain, never end one, so clear
+ * them out once they fill a quarter of the table.
+ */
+static void
+jack_port_index_rebuild (jack_engine_t *engine)
+{
+	jack_port_internal_t *port;
+	jack_port_id_t id;
+	int i;
 
-	for (it = srcport->connections; it; it = it->next) {
-		if (((jack_connection_internal_t*)it->data)->destination
-		    == dstport) {
-			return EEXIST;
+	memset (jack_port_index_slots (engine->control), 0,
+		sizeof(jack_port_index_slot_t)
+		* engine->control->port_index_size);
+
+	engine->port_index_used = 0;
+	engine->port_index_deleted = 0;
+
+	for (id = 0; id < engine->port_max; id++) {
+		port = &engine->internal_ports[id];
+		for (i = 0; i < port->index_nhashes; i++) {
+			jack_port_index_insert (engine, port->index_hash[i], id);
 		}
 	}
+}
 
-	connection = (jack_connection_internal_t*)
-		     malloc (sizeof(jack_connection_internal_t));
-
-	connection->source = srcport;
-	connection->destination = dstport;
-	connection->srcclient = srcclient;
-	connection->dstclient = dstclient;
+/* Bring the index entries for a port in line with its name, aliases
+ * and in_use flag.
+ */
+static void
+jack_port_index_update (jack_engine_t *engine, jack_port_id_t id)
+{
+	jack_control_t *control = engine->control;
+	jack_port_internal_t *port = &engine->internal_ports[id];
+	jack_port_shared_t *shared = &control->ports[id];
+	const char *keys[3];
+	uint32_t hash;
+	int i, j;
+
+	if (control->port_index_size == 0) {
+		return;
+	}
 
-	src_id = srcport->shared->id;
-	dst_id = dstport->shared->id;
+	__atomic_store_n (&control->port_index_seq,
+			  control->port_index_seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
 
-	jack_lock_graph (engine);
+	for (i = 0; i < port->index_nhashes; i++) {
+		jack_port_index_remove (engine, port->index_hash[i], id);
+	}
 
-	if (dstport->connections && !dstport->shared->has_mixdown) {
-		jack_port_type_info_t *port_type =
-			jack_port_type_info (engine, dstport);
-		jack_error ("cannot make multiple connections to a port of"
-			    " type [%s]", port_type->type_name);
-		free (connection);
-		jack_unlock_graph (engine);
-		return -1;
-	} else {
+	port->index_nhashes = 0;
 
-		if (dstclient->control->type == ClientDriver) {
-			/* Ignore output connections to drivers for purposes
-			   of sorting. Drivers are executed first in the sort
-			   order anyway, and we don't want to treat graphs
-			   such as driver -> client -> driver as containing
-			   feedback */
+	if (shared->in_use) {
 
-			VERBOSE (engine,
-				 "connect %s and %s (output)",
-				 srcport->shared->name,
-				 dstport->shared->name);
+		keys[0] = shared->name;
+		keys[1] = shared->alias1;
+		keys[2] = shared->alias2;
 
-			connection->dir = 1;
+		for (i = 0; i < 3; i++) {
+			if (keys[i][0] == '\0') {
+				continue;
+			}
+			hash = jack_port_index_hash (keys[i]);
+			for (j = 0; j < port->index_nhashes; j++) {
+				if (port->index_hash[j] == hash) {
+					break;
+				}
+			}
+			if (j < port->index_nhashes) {
+				continue;
+			}
+			jack_port_index_insert (engine, hash, id);
+			port->index_hash[port->index_nhashes++] = hash;
+		}
+	}
 
-		} else if (srcclient != dstclient) {
+	if (engine->port_index_deleted > control->port_index_size / 4) {
+		jack_port_index_rebuild (engine);
+	}
 
-			srcclient->truefeeds = jack_slist_prepend
-						       (srcclient->truefeeds, dstclient);
+	__atomic_store_n (&control->port_index_seq,
+			  control->port_index_seq + 1, __ATOMIC_RELEASE);
+}
 
-			dstclient->fedcount++;
+/* Free port slots are kept in a two level bitmap: a bit per slot in
+ * port_free, and a bit per port_free word that has any bit set in
+ * port_free_summary. Taking the lowest set bit at both levels gives
+ * the lowest free slot, so the front of ports[] stays densely used.
+ */
+static int
+jack_port_slots_init (jack_engine_t *engine)
+{
+	uint32_t nwords = (engine->port_max + 63) / 64;
+	uint32_t i;
 
-			if (jack_client_feeds_transitive (dstclient,
-							  srcclient ) ||
-			    (dstclient->control->type == ClientDriver &&
-			     srcclient->control->type != ClientDriver)) {
+	engine->port_free = (uint64_t*)calloc (nwords, sizeof(uint64_t));
+	engine->port_free_summary = (uint64_t*)
+				    calloc ((nwords + 63) / 64, sizeof(uint64_t));
 
-				/* dest is running before source so
-				   this is a feedback connection */
+	if (engine->port_free == NULL || engine->port_free_summary == NULL) {
+		return -1;
+	}
 
-				VERBOSE (engine,
-					 "connect %s and %s (feedback)",
-					 srcport->shared->name,
-					 dstport->shared->name);
+	engine->port_free_words = nwords;
 
-				dstclient->sortfeeds = jack_slist_prepend
-							       (dstclient->sortfeeds, srcclient);
+	for (i = 0; i < engine->port_max; i++) {
+		engine->port_free[i / 64] |= 1ULL << (i % 64);
+	}
 
-				connection->dir = -1;
-				engine->feedbackcount++;
-				VERBOSE (engine,
-					 "feedback count up to %d",
-					 engine->feedbackcount);
+	for (i = 0; i < nwords; i++) {
+		engine->port_free_summary[i / 64] |= 1ULL << (i % 64);
+	}
 
-			} else {
+	engine->ports_in_use = 0;
+	engine->ports_in_use_max = 0;
+	engine->port_allocs = 0;
+	engine->port_alloc_failures = 0;
 
-				/* this is not a feedback connection */
+	return 0;
+}
 
-				VERBOSE (engine,
-					 "connect %s and %s (forward)",
-					 srcport->shared->name,
-					 dstport->shared->name);
+/* called with the port_lock held */
+static void
+jack_port_slot_free (jack_engine_t *engine, jack_port_id_t id)
+{
+	engine->port_free[id / 64] |= 1ULL << (id % 64);
+	engine->port_free_summary[id / 4096] |= 1ULL << ((id / 64) % 64);
+	engine->ports_in_use--;
+}
 
-				srcclient->sortfeeds = jack_slist_prepend
-							       (srcclient->sortfeeds, dstclient);
+static jack_port_id_t
+jack_get_free_port (jack_engine_t *engine)
 
-				connection->dir = 1;
-			}
-		} else {
-			/* this is a connection to self */
+{
+	jack_port_id_t id = (jack_port_id_t)-1;
+	uint32_t s, w;
 
-			VERBOSE (engine,
-				 "connect %s and %s (self)",
-				 srcport->shared->name,
-				 dstport->shared->name);
+	pthread_mutex_lock (&engine->port_lock);
 
-			connection->dir = 0;
+	for (s = 0; s < (engine->port_free_words + 63) / 64; s++) {
+		if (engine->port_free_summary[s]) {
+			break;
 		}
+	}
 
-		dstport->connections =
-			jack_slist_prepend (dstport->connections, connection);
-		srcport->connections =
-			jack_slist_prepend (srcport->connections, connection);
+	if (s < (engine->port_free_words + 63) / 64) {
 
-		DEBUG ("actually sorted the graph...");
+		w = s * 64 + __builtin_ctzll (engine->port_free_summary[s]);
+		id = w * 64 + __builtin_ctzll (engine->port_free[w]);
 
-		jack_send_connection_notification (engine,
-						   srcport->shared->client_id,
-						   src_id, dst_id, TRUE);
+		engine->port_free[w] &= engine->port_free[w] - 1;
+		if (engine->port_free[w] == 0) {
+			engine->port_free_summary[s] &=
+				engine->port_free_summary[s] - 1;
+		}
 
+		engine->control->ports[id].in_use = 1;
 
-		jack_send_connection_notification (engine,
-						   dstport->shared->client_id,
-						   dst_id, src_id, TRUE);
+		engine->port_allocs++;
+		if (++engine->ports_in_use > engine->ports_in_use_max) {
+			engine->ports_in_use_max = engine->ports_in_use;
+		}
+	} else {
+		engine->port_alloc_failures++;
+	}
 
-		/* send a port connection notification just once to everyone who cares excluding clients involved in the connection */
+	pthread_mutex_unlock (&engine->port_lock);
 
-		jack_notify_all_port_interested_clients (engine, srcport->shared->client_id, dstport->shared->client_id, src_id, dst_id, 1);
+	return id;
+}
 
-		jack_sort_graph (engine);
-	}
+/* Shared mixdowns.
+ *
+ * When several input ports are fed by exactly the same output ports,
+ * the first of their clients to read one of them in a cycle sums the
+ * sources into a buffer in the port segment, and the others use that
+ * sum, see jack_port_get_buffer(). The groups are rebuilt whenever
+ * the graph is sorted, and a port leaves its group before its clients
+ * hear of a connection change, since a client must never be handed a
+ * sum of a different set of sources than it knows about.
+ *
+ * Groups only change while no cycle is running.
+ */
 
-	jack_unlock_graph (engine);
+typedef struct {
+	uint32_t hash;
+	uint32_t nsources;
+	jack_port_id_t *sources;        /* sorted */
+	jack_port_id_t id;
+} jack_mix_candidate_t;
 
-	return 0;
+static void
+jack_mix_buffer_free (jack_engine_t *engine, jack_port_buffer_info_t *bi)
+{
+	jack_port_buffer_list_t *blist =
+		&engine->port_buffers[JACK_AUDIO_PORT_TYPE];
+
+	pthread_mutex_lock (&blist->lock);
+	blist->freelist = jack_slist_prepend (blist->freelist, bi);
+	pthread_mutex_unlock (&blist->lock);
 }
 
-int
-jack_port_disconnect_internal (jack_engine_t *engine,
-			       jack_port_internal_t *srcport,
-			       jack_port_internal_t *dstport )
+static void
+jack_port_release_mix_buffer (jack_engine_t *engine,
+			      jack_port_internal_t *port)
+{
+	if (port->mix_buffer_info == NULL) {
+		return;
+	}
 
+	jack_mix_buffer_free (engine, port->mix_buffer_info);
+	port->mix_buffer_info = NULL;
+}
+
+/* Make port `id' the leader of a new group, with a mix buffer of its
+ * own. The members are added by the caller.
+ */
+static int
+jack_mix_group_lead (jack_engine_t *engine, jack_port_id_t id)
 {
-	JSList *node;
-	jack_connection_internal_t *connect;
-	int ret = -1;
-	jack_port_id_t src_id, dst_id;
-	int check_acyclic = engine->feedbackcount;
+	jack_port_buffer_list_t *blist =
+		&engine->port_buffers[JACK_AUDIO_PORT_TYPE];
+	jack_port_buffer_info_t *bi;
+	jack_port_shared_t *leader;
 
-	/* call tree **** MUST HOLD **** engine->client_lock. */
-	for (node = srcport->connections; node;
-	     node = jack_slist_next (node)) {
+	pthread_mutex_lock (&blist->lock);
+	if (blist->freelist == NULL) {
+		pthread_mutex_unlock (&blist->lock);
+		return -1;
+	}
+	bi = (jack_port_buffer_info_t*)blist->freelist->data;
+	blist->freelist = jack_slist_remove (blist->freelist, bi);
+	pthread_mutex_unlock (&blist->lock);
 
-		connect = (jack_connection_internal_t*)node->data;
+	engine->internal_ports[id].mix_buffer_info = bi;
 
-		if (connect->source == srcport &&
-		    connect->destination == dstport) {
+	leader = &engine->control->ports[id];
+	leader->mix_offset = bi->offset;
+	leader->mix_ready = 0;
+	leader->mix_claim = 0;
 
-			VERBOSE (engine, "DIS-connect %s and %s",
-				 srcport->shared->name,
-				 dstport->shared->name);
+	return 0;
+}
 
-			srcport->connections =
-				jack_slist_remove (srcport->connections,
-						   connect);
-			dstport->connections =
-				jack_slist_remove (dstport->connections,
-						   connect);
+/* Stop a port whose sources are changing from using its group's sum.
+ * jack_update_mix_groups() then sorts out the group it was in.
+ */
+static void
+jack_port_leave_mix_group (jack_engine_t *engine, jack_port_internal_t *port)
+{
+	int32_t group = port->shared->mix_group;
 
-			src_id = srcport->shared->id;
-			dst_id = dstport->shared->id;
+	if (group >= 0) {
+		port->mix_left = group;
+	}
 
-			/* this is a bit harsh, but it basically says
-			   that if we actually do a disconnect, and
-			   its the last one, then make sure that any
-			   input monitoring is turned off on the
-			   srcport. this isn't ideal for all
-			   situations, but it works better for most of
-			   them.
-			 */
-			if (srcport->connections == NULL) {
-				srcport->shared->monitor_requests = 0;
-			}
+	__atomic_store_n (&port->shared->mix_group, -1, __ATOMIC_RELEASE);
+}
 
-			jack_send_connection_notification (
-				engine, srcport->shared->client_id, src_id,
-				dst_id, FALSE);
-			jack_send_connection_notification (
-				engine, dstport->shared->client_id, dst_id,
-				src_id, FALSE);
+/* Called when a group leader goes away before the groups are next
+ * rebuilt: the other members must stop using its mix buffer before
+ * the buffer goes back on the free list for another port.
+ */
+static void
+jack_port_dissolve_mix_group (jack_engine_t *engine,
+			      jack_port_internal_t *port)
+{
+	jack_port_id_t leader = port->shared->id;
+	jack_port_id_t id;
 
-			/* send a port connection notification just once to everyone who cares excluding clients involved in the connection */
+	if (port->mix_buffer_info == NULL) {
+		return;
+	}
 
-			jack_notify_all_port_interested_clients (engine, srcport->shared->client_id, dstport->shared->client_id, src_id, dst_id, 0);
+	for (id = 0; id < engine->port_max; id++) {
+		if (engine->control->ports[id].mix_group == (int32_t)leader) {
+			__atomic_store_n (&engine->control->ports[id].mix_group,
+					  -1, __ATOMIC_RELEASE);
+		}
+	}
 
-			if (connect->dir) {
+	jack_port_release_mix_buffer (engine, port);
+}
 
-				jack_client_internal_t *src;
-				jack_client_internal_t *dst;
+static int
+jack_port_id_cmp (const void *a, const void *b)
+{
+	jack_port_id_t x = *(const jack_port_id_t*)a;
+	jack_port_id_t y = *(const jack_port_id_t*)b;
 
-				src = jack_client_internal_by_id
-					      (engine, srcport->shared->client_id);
+	return (x > y) - (x < y);
+}
 
-				dst =  jack_client_internal_by_id
-					      (engine, dstport->shared->client_id);
+static int
+jack_mix_candidate_cmp (const void *a, const void *b)
+{
+	const jack_mix_candidate_t *x = (const jack_mix_candidate_t*)a;
+	const jack_mix_candidate_t *y = (const jack_mix_candidate_t*)b;
+	int c;
 
-				src->truefeeds = jack_slist_remove
-							 (src->truefeeds, dst);
+	if (x->hash != y->hash) {
+		return x->hash < y->hash ? -1 : 1;
+	}
+	if (x->nsources != y->nsources) {
+		return x->nsources < y->nsources ? -1 : 1;
+	}
+	if ((c = memcmp (x->sources, y->sources,
+			 x->nsources * sizeof(jack_port_id_t))) != 0) {
+		return c;
+	}
 
-				dst->fedcount--;
+	return (x->id > y->id) - (x->id < y->id);
+}
 
-				if (connect->dir == 1) {
-					/* normal connection: remove dest from
-					   source's sortfeeds list */
-					src->sortfeeds = jack_slist_remove
-								 (src->sortfeeds, dst);
-				} else {
-					/* feedback connection: remove source
-					   from dest's sortfeeds list */
-					dst->sortfeeds = jack_slist_remove
-								 (dst->sortfeeds, src);
-					engine->feedbackcount--;
-					VERBOSE (engine,
-						 "feedback count down to %d",
-						 engine->feedbackcount);
+static int
+jack_mix_candidate_same (const jack_mix_candidate_t *x,
+			 const jack_mix_candidate_t *y)
+{
+	return x->hash == y->hash && x->nsources == y->nsources
+	       && memcmp (x->sources, y->sources,
+			  x->nsources * sizeof(jack_port_id_t)) == 0;
+}
 
-				}
-			} /* else self-connection: do nothing */
+/* An audio input with two or more connections, none of them with a
+ * gain, may share its mixdown with other ports.
+ */
+static int
+jack_port_may_share_mix (jack_engine_t *engine, jack_port_id_t id)
+{
+	jack_port_internal_t *port = &engine->internal_ports[id];
+	jack_port_shared_t *shared = &engine->control->ports[id];
+	JSList *node;
 
-			free (connect);
-			ret = 0;
-			break;
-		}
+	if (!shared->in_use || shared->ptype_id != JACK_AUDIO_PORT_TYPE
+	    || !(shared->flags & JackPortIsInput)
+	    || port->connections == NULL || port->connections->next == NULL) {
+		return FALSE;
 	}
 
-	if (check_acyclic) {
-		jack_check_acyclic (engine);
+	for (node = port->connections; node; node = jack_slist_next (node)) {
+		if (((jack_connection_internal_t*)node->data)->gain_slot >= 0) {
+			return FALSE;
+		}
 	}
 
-	jack_sort_graph (engine);
-
-	return ret;
+	return TRUE;
 }
 
+/* TRUE if ports a and b are fed by the same sources. A port is never
+ * connected to the same source twice.
+ */
 static int
-jack_port_do_disconnect_all (jack_engine_t *engine,
-			     jack_port_id_t port_id)
+jack_mix_same_sources (jack_port_internal_t *a, jack_port_internal_t *b)
 {
-	if (port_id >= engine->control->port_max) {
-		jack_error ("illegal port ID in attempted disconnection [%"
-			    PRIu32 "]", port_id);
-		return -1;
+	jack_port_internal_t *src;
+	JSList *na, *nb;
+
+	if (jack_slist_length (a->connections)
+	    != jack_slist_length (b->connections)) {
+		return FALSE;
 	}
 
-	VERBOSE (engine, "clear connections for %s",
-		 engine->internal_ports[port_id].shared->name);
+	for (na = a->connections; na; na = jack_slist_next (na)) {
+		src = ((jack_connection_internal_t*)na->data)->source;
+		for (nb = b->connections; nb; nb = jack_slist_next (nb)) {
+			if (((jack_connection_internal_t*)nb->data)->source == src) {
+				break;
+			}
+		}
+		if (nb == NULL) {
+			return FALSE;
+		}
+	}
 
-	jack_lock_graph (engine);
-	jack_port_clear_connections (engine, &engine->internal_ports[port_id]);
-	jack_sort_graph (engine);
-	jack_unlock_graph (engine);
+	return TRUE;
+}
 
-	return 0;
+/* Add the ports in `group' that `src' feeds to *members. */
+static void
+jack_mix_add_members (JSList **members, jack_port_internal_t *src,
+		      int32_t group)
+{
+	jack_port_internal_t *dst;
+	JSList *node;
+
+	for (node = src->connections; node; node = jack_slist_next (node)) {
+		dst = ((jack_connection_internal_t*)node->data)->destination;
+		if (dst != src && dst->shared->mix_group == group
+		    && jack_slist_find (*members, dst) == NULL) {
+			*members = jack_slist_prepend (*members, dst);
+		}
+	}
 }
 
-static int
-jack_port_do_disconnect (jack_engine_t *engine,
-			 const char *source_port,
-			 const char *destination_port)
+/* Put the ports in `members', which all have the same sources, in a
+ * new group led by the lowest numbered of them.
+ */
+static void
+jack_mix_form_group (jack_engine_t *engine, JSList *members)
 {
-	jack_port_internal_t *srcport, *dstport;
-	int ret = -1;
+	jack_port_id_t leader = UINT32_MAX;
+	JSList *node;
+	jack_port_id_t id;
 
-	if ((srcport = jack_get_port_by_name (engine, source_port)) == NULL) {
-		jack_error ("unknown source port in attempted disconnection"
-			    " [%s]", source_port);
-		return -1;
+	if (jack_slist_length (members) < 2) {
+		return;
 	}
 
-	if ((dstport = jack_get_port_by_name (engine, destination_port))
-	    == NULL) {
-		jack_error ("unknown destination port in attempted"
-			    " disconnection [%s]", destination_port);
-		return -1;
+	for (node = members; node; node = jack_slist_next (node)) {
+		id = ((jack_port_internal_t*)node->data)->shared->id;
+		if (id < leader) {
+			leader = id;
+		}
+	}
+
+	if (jack_mix_group_lead (engine, leader)) {
+		return;
 	}
 
-	jack_lock_graph (engine);
+	for (node = members; node; node = jack_slist_next (node)) {
+		__atomic_store_n (&((jack_port_internal_t*)node->data)->shared->mix_group,
+				  leader, __ATOMIC_RELEASE);
+	}
+}
 
-	ret = jack_port_disconnect_internal (engine, srcport, dstport);
+/* Bring the groups up to date after the sources of `port' changed, or
+ * one of its connections got a gain; `src' is the source that was
+ * connected or disconnected, if any. Only the group `port' left and
+ * the one it can join now are looked at, both found through the
+ * connections of their sources, so this does not depend on port_max.
+ */
+static void
+jack_port_regroup_mix (jack_engine_t *engine, jack_port_internal_t *port,
+		       jack_port_internal_t *src)
+{
+	jack_port_buffer_info_t *released = NULL;
+	jack_port_internal_t *leader, *other, *first;
+	int32_t group = port->mix_left;
+	JSList *members = NULL, *node;
+	jack_port_id_t id = port->shared->id;
 
-	jack_unlock_graph (engine);
+	port->mix_left = -1;
 
-	return ret;
-}
+	if (group == (int32_t)id) {
 
-int
-jack_get_fifo_fd (jack_engine_t *engine, unsigned int which_fifo)
-{
-	/* caller must hold client_lock */
-	char path[PATH_MAX + 1];
-	struct stat statbuf;
+		/* it led a group. the others still share their sources,
+		   which were those of port: among its sources now and
+		   src. they get a group of their own */
 
-	snprintf (path, sizeof(path), "%s-%d", engine->fifo_prefix,
-		  which_fifo);
+		for (node = port->connections; node; node = jack_slist_next (node)) {
+			jack_mix_add_members (&members, ((jack_connection_internal_t*)
+							 node->data)->source, group);
+		}
+		if (src) {
+			jack_mix_add_members (&members, src, group);
+		}
+		for (node = members; node; node = jack_slist_next (node)) {
+			__atomic_store_n (&((jack_port_internal_t*)node->data)->shared->mix_group,
+					  -1, __ATOMIC_RELEASE);
+		}
 
-	DEBUG ("%s", path);
+		released = port->mix_buffer_info;
+		port->mix_buffer_info = NULL;
 
-	if (stat (path, &statbuf)) {
-		if (errno == ENOENT) {
+		jack_mix_form_group (engine, members);
+		jack_slist_free (members);
+		members = NULL;
 
-			if (mkfifo (path, 0666) < 0) {
-				jack_error ("cannot create inter-client FIFO"
-					    " [%s] (%s)\n", path,
-					    strerror (errno));
-				return -1;
-			}
+	} else if (group >= 0) {
 
-		} else {
-			jack_error ("cannot check on FIFO %d\n", which_fifo);
-			return -1;
+		/* it was in another port's group, which may be down to
+		   the leader alone */
+
+		leader = &engine->internal_ports[group];
+
+		for (node = leader->connections; node; node = jack_slist_next (node)) {
+			jack_mix_add_members (&members, ((jack_connection_internal_t*)
+							 node->data)->source, group);
 		}
-	} else {
-		if (!S_ISFIFO (statbuf.st_mode)) {
-			jack_error ("FIFO %d (%s) already exists, but is not"
-				    " a FIFO!\n", which_fifo, path);
-			return -1;
+
+		if (jack_slist_length (members) < 2) {
+			__atomic_store_n (&leader->shared->mix_group, -1,
+					  __ATOMIC_RELEASE);
+			released = leader->mix_buffer_info;
+			leader->mix_buffer_info = NULL;
 		}
+
+		jack_slist_free (members);
+		members = NULL;
 	}
 
-	if (which_fifo >= engine->fifo_size) {
-		unsigned int i;
+	/* any port it can share with now is fed by its first source */
 
-		engine->fifo = (int*)
-			       realloc (engine->fifo,
-					sizeof(int) * (engine->fifo_size + 16));
-		for (i = engine->fifo_size; i < engine->fifo_size + 16; i++)
-			engine->fifo[i] = -1;
-		engine->fifo_size += 16;
-	}
+	if (jack_port_may_share_mix (engine, id)) {
 
-	if (engine->fifo[which_fifo] < 0) {
-		if ((engine->fifo[which_fifo] =
-			     open (path, O_RDWR | O_CREAT | O_NONBLOCK, 0666)) < 0) {
-			jack_error ("cannot open fifo [%s] (%s)", path,
-				    strerror (errno));
-			return -1;
+		first = ((jack_connection_internal_t*)port->connections->data)->source;
+
+		for (node = first->connections; node; node = jack_slist_next (node)) {
+			other = ((jack_connection_internal_t*)node->data)->destination;
+			if (other == port
+			    || !jack_port_may_share_mix (engine, other->shared->id)
+			    || !jack_mix_same_sources (port, other)) {
+				continue;
+			}
+			if (other->shared->mix_group >= 0) {
+				__atomic_store_n (&port->shared->mix_group,
+						  other->shared->mix_group,
+						  __ATOMIC_RELEASE);
+				break;
+			}
+			members = jack_slist_prepend (members, other);
 		}
-		DEBUG ("opened engine->fifo[%d] == %d (%s)",
-		       which_fifo, engine->fifo[which_fifo], path);
+
+		if (port->shared->mix_group < 0 && members) {
+			members = jack_slist_prepend (members, port);
+			jack_mix_form_group (engine, members);
+		}
+
+		jack_slist_free (members);
 	}
 
-	return engine->fifo[which_fifo];
+	if (released) {
+		/* a plan cycle may still be summing into it */
+		if (engine->plan_cycles_allowed) {
+			jack_engine_wait_plan_cycle (engine);
+		}
+		jack_mix_buffer_free (engine, released);
+	}
 }
 
+/* Called with the client_lock held. With `dst', only the groups that
+ * a change to the sources of dst touches are updated; otherwise all
+ * groups are built again.
+ */
 static void
-jack_clear_fifos (jack_engine_t *engine)
+jack_update_mix_groups (jack_engine_t *engine, jack_port_internal_t *src,
+			jack_port_internal_t *dst)
 {
-	/* caller must hold client_lock */
+	jack_mix_candidate_t *cand;
+	jack_port_id_t *ids;
+	jack_port_internal_t *port;
+	JSList *node;
+	unsigned int id, ncand, nids, i, j, k;
+	unsigned int ngroups = 0;
 
-	unsigned int i;
-	char buf[16];
+	if (dst) {
+		jack_port_regroup_mix (engine, dst, src);
+		return;
+	}
 
-	/* this just drains the existing FIFO's of any data left in
-	   them by aborted clients, etc. there is only ever going to
-	   be 0, 1 or 2 bytes in them, but we'll allow for up to 16.
-	 */
-	for (i = 0; i < engine->fifo_size; i++) {
-		if (engine->fifo[i] >= 0) {
-			int nread = read (engine->fifo[i], buf, sizeof(buf));
+	ncand = 0;
+	nids = 0;
 
-			if (nread < 0 && errno != EAGAIN) {
-				jack_error ("clear fifo[%d] error: %s",
-					    i, strerror (errno));
-			}
-		}
+	for (id = 0; id < engine->port_max; id++) {
+		__atomic_store_n (&engine->control->ports[id].mix_group, -1,
+				  __ATOMIC_RELEASE);
+		engine->internal_ports[id].mix_left = -1;
 	}
-}
 
-int
-jack_use_driver (jack_engine_t *engine, jack_driver_t *driver)
-{
-	if (engine->driver) {
-		engine->driver->detach (engine->driver, engine);
-		engine->driver = 0;
+	/* a plan cycle that started before may still be summing into
+	   the old groups' buffers */
+	if (engine->plan_cycles_allowed) {
+		jack_engine_wait_plan_cycle (engine);
 	}
 
-	if (driver) {
-		engine->driver = driver;
+	for (id = 0; id < engine->port_max; id++) {
 
-		if (driver->attach (driver, engine)) {
-			engine->driver = 0;
-			return -1;
+		port = &engine->internal_ports[id];
+
+		jack_port_release_mix_buffer (engine, port);
+
+		if (!jack_port_may_share_mix (engine, id)) {
+			continue;
 		}
 
-		engine->rolling_interval =
-			jack_rolling_interval (driver->period_usecs);
+		ncand++;
+		nids += jack_slist_length (port->connections);
 	}
 
-	return 0;
-}
+	if (ncand < 2) {
+		return;
+	}
 
-int
-jack_add_slave_driver (jack_engine_t *engine, jack_driver_t *driver)
-{
-	if (driver) {
-		if (driver->attach (driver, engine)) {
-			jack_info ("could not attach slave %s\n", driver->internal_client->control->name);
-			return -1;
-		}
+	cand = (jack_mix_candidate_t*)malloc (ncand * sizeof(*cand));
+	ids = (jack_port_id_t*)malloc (nids * sizeof(*ids));
 
-		engine->slave_drivers = jack_slist_append (engine->slave_drivers, driver);
+	if (cand == NULL || ids == NULL) {
+		jack_error ("cannot allocate mix group scratch space");
+		free (cand);
+		free (ids);
+		return;
 	}
 
-	return 0;
-}
+	for (id = 0, i = 0, k = 0; id < engine->port_max; id++) {
 
-/* PORT RELATED FUNCTIONS */
+		port = &engine->internal_ports[id];
+
+		if (!jack_port_may_share_mix (engine, id)) {
+			continue;
+		}
 
+		cand[i].id = id;
+		cand[i].sources = &ids[k];
+		cand[i].nsources = 0;
 
-static jack_port_id_t
-jack_get_free_port (jack_engine_t *engine)
+		for (node = port->connections; node;
+		     node = jack_slist_next (node)) {
+			ids[k++] = ((jack_connection_internal_t*)
+				    node->data)->source->shared->id;
+			cand[i].nsources++;
+		}
 
-{
-	jack_port_id_t i;
+		qsort (cand[i].sources, cand[i].nsources,
+		       sizeof(jack_port_id_t), jack_port_id_cmp);
 
-	pthread_mutex_lock (&engine->port_lock);
+		cand[i].hash = 2166136261U;
+		for (j = 0; j < cand[i].nsources; j++) {
+			cand[i].hash = (cand[i].hash ^ cand[i].sources[j])
+				       * 16777619U;
+		}
 
-	for (i = 0; i < engine->port_max; i++) {
-		if (engine->control->ports[i].in_use == 0) {
-			engine->control->ports[i].in_use = 1;
+		i++;
+	}
+
+	qsort (cand, ncand, sizeof(*cand), jack_mix_candidate_cmp);
+
+	/* each run of equal source sets with more than one member is a
+	   group, led by its lowest numbered port */
+
+	for (i = 0; i < ncand; i = j) {
+
+		for (j = i + 1; j < ncand
+		     && jack_mix_candidate_same (&cand[i], &cand[j]); j++) {
+		}
+
+		if (j - i < 2) {
+			continue;
+		}
+
+		if (jack_mix_group_lead (engine, cand[i].id)) {
 			break;
 		}
-	}
 
-	pthread_mutex_unlock (&engine->port_lock);
+		for (k = i; k < j; k++) {
+			__atomic_store_n (&engine->control->ports[cand[k].id].mix_group,
+					  cand[i].id, __ATOMIC_RELEASE);
+		}
 
-	if (i == engine->port_max) {
-		return (jack_port_id_t)-1;
+		ngroups++;
 	}
 
-	return i;
+	free (cand);
+	free (ids);
+
+	VERBOSE (engine, "%u shared mixdown groups", ngroups);
 }
 
 void
@@ -4316,14 +6673,18 @@ jack_port_release (jack_engine_t *engine, jack_port_internal_t *port)
 	port->shared->in_use = 0;
 	port->shared->alias1[0] = '\0';
 	port->shared->alias2[0] = '\0';
+	port->shared->mix_group = -1;
+	jack_port_dissolve_mix_group (engine, port);
+	jack_port_index_update (engine, port->shared->id);
+	jack_port_slot_free (engine, port->shared->id);
 
 	if (port->buffer_info) {
 		jack_port_buffer_list_t *blist =
 			jack_port_buffer_list (engine, port);
+		JSList **freelist = jack_port_buffer_freelist
+			(blist, port->buffer_info->size_class);
 		pthread_mutex_lock (&blist->lock);
-		blist->freelist =
-			jack_slist_prepend (blist->freelist,
-					    port->buffer_info);
+		*freelist = jack_slist_prepend (*freelist, port->buffer_info);
 		port->buffer_info = NULL;
 		pthread_mutex_unlock (&blist->lock);
 	}
@@ -4335,6 +6696,13 @@ jack_get_port_internal_by_name (jack_engine_t *engine, const char *name)
 {
 	jack_port_id_t id;
 
+	switch (jack_port_index_lookup (engine->control, name, &id)) {
+	case 1:
+		return &engine->internal_ports[id];
+	case 0:
+		return NULL;
+	}
+
 	pthread_mutex_lock (&engine->port_lock);
 
 	for (id = 0; id < engine->port_max; id++) {
@@ -4449,11 +6817,13 @@ next:
 	shared->ptype_id = engine->control->port_types[i].ptype_id;
 	jack_uuid_copy (&shared->client_id, req->x.port_info.client_id);
 	shared->uuid = jack_port_uuid_generate (port_id);
-	shared->flags = req->x.port_info.flags;
+	shared->flags = req->x.port_info.flags & ~JACK_PORT_REQUEST_CAPACITY;
 	shared->latency = 0;
 	shared->capture_latency.min = shared->capture_latency.max = 0;
 	shared->playback_latency.min = shared->playback_latency.max = 0;
 	shared->monitor_requests = 0;
+	shared->mix_group = -1;
+	shared->silent_cycle = 0;
 
 	port = &engine->internal_ports[port_id];
 
@@ -4461,13 +6831,22 @@ next:
 	port->connections = 0;
 	port->buffer_info = NULL;
 
-	if (jack_port_assign_buffer (engine, port)) {
+	/* buffer_size is ignored unless the port asked for a capacity */
+	if (jack_port_assign_buffer (engine, port,
+				     jack_port_type_has_classes (shared->ptype_id)
+				     && (req->x.port_info.flags
+					 & JACK_PORT_REQUEST_CAPACITY)
+				     ? req->x.port_info.buffer_size : 0)) {
 		jack_error ("cannot assign buffer for port");
 		jack_port_release (engine, &engine->internal_ports[port_id]);
 		jack_unlock_graph (engine);
 		return -1;
 	}
 
+	pthread_mutex_lock (&engine->port_lock);
+	jack_port_index_update (engine, port_id);
+	pthread_mutex_unlock (&engine->port_lock);
+
 	client->ports = jack_slist_prepend (client->ports, port);
 	if ( client->control->active ) {
 		jack_port_registration_notify (engine, port_id, TRUE);
@@ -4482,6 +6861,165 @@ next:
 	return 0;
 }
 
+/* A client changed the name or an alias of a port in shared memory;
+ * catch the name index up with it.
+ */
+static int
+jack_port_do_reindex (jack_engine_t *engine, jack_request_t *req)
+{
+	if (req->x.port_info.port_id >= engine->port_max) {
+		jack_error ("invalid port ID %" PRIu32
+			    " in reindex request",
+			    req->x.port_info.port_id);
+		return -1;
+	}
+
+	pthread_mutex_lock (&engine->port_lock);
+	jack_port_index_update (engine, req->x.port_info.port_id);
+	pthread_mutex_unlock (&engine->port_lock);
+
+	return 0;
+}
+
+/* Set (or, with nothing in `what', just read) the gain and mute of a
+ * connection. The first change gives the connection a slot in the
+ * control segment and tells the client that owns the destination port
+ * about it; from then on changes only touch the slot, and that client
+ * picks them up on its next cycle.
+ */
+static int
+jack_port_do_connection_gain (jack_engine_t *engine, jack_request_t *req)
+{
+	jack_port_internal_t *srcport, *dstport;
+	jack_connection_internal_t *conn = NULL;
+	jack_connection_gain_t *cg;
+	jack_event_t event;
+	JSList *node;
+	uint32_t what = req->x.connection_gain.what;
+	uint32_t slot;
+
+	if ((srcport = jack_get_port_by_name (
+		     engine, req->x.connection_gain.source_port)) == NULL) {
+		jack_error ("unknown source port in connection gain request"
+			    " [%s]", req->x.connection_gain.source_port);
+		return -1;
+	}
+
+	if ((dstport = jack_get_port_by_name (
+		     engine, req->x.connection_gain.destination_port)) == NULL) {
+		jack_error ("unknown destination port in connection gain"
+			    " request [%s]",
+			    req->x.connection_gain.destination_port);
+		return -1;
+	}
+
+	jack_lock_graph (engine);
+
+	for (node = srcport->connections; node; node = jack_slist_next (node)) {
+		if (((jack_connection_internal_t*)node->data)->destination
+		    == dstport) {
+			conn = (jack_connection_internal_t*)node->data;
+			break;
+		}
+	}
+
+	if (conn == NULL) {
+		jack_error ("%s is not connected to %s",
+			    srcport->shared->name, dstport->shared->name);
+		jack_unlock_graph (engine);
+		return -1;
+	}
+
+	if (what == 0) {
+		if (conn->gain_slot < 0) {
+			req->x.connection_gain.gain = 1.0F;
+			req->x.connection_gain.mute = 0;
+		} else {
+			cg = jack_connection_gain (engine->control,
+						   conn->gain_slot);
+			req->x.connection_gain.gain = cg->gain;
+			req->x.connection_gain.mute = cg->mute;
+		}
+		jack_unlock_graph (engine);
+		return 0;
+	}
+
+	if (dstport->shared->ptype_id != JACK_AUDIO_PORT_TYPE) {
+		jack_error ("cannot set the gain of a connection between"
+			    " non-audio ports %s and %s",
+			    srcport->shared->name, dstport->shared->name);
+		jack_unlock_graph (engine);
+		return -1;
+	}
+
+	if (conn->gain_slot >= 0) {
+		slot = conn->gain_slot;
+	} else {
+		for (slot = 0; slot < engine->port_max; slot++) {
+			if (!jack_connection_gain (engine->control,
+						   slot)->in_use) {
+				break;
+			}
+		}
+		if (slot == engine->port_max) {
+			jack_error ("no connection gain slots left (max %u)",
+				    engine->port_max);
+			jack_unlock_graph (engine);
+			return -1;
+		}
+		cg = jack_connection_gain (engine->control, slot);
+		cg->in_use = 1;
+		cg->gain = 1.0F;
+		cg->mute = 0;
+		cg->applied = 1.0F;
+	}
+
+	cg = jack_connection_gain (engine->control, slot);
+
+	if (what & JACK_CONNECTION_SET_GAIN) {
+		cg->gain = req->x.connection_gain.gain;
+	}
+	if (what & JACK_CONNECTION_SET_MUTE) {
+		cg->mute = req->x.connection_gain.mute ? 1 : 0;
+	}
+
+	req->x.connection_gain.gain = cg->gain;
+	req->x.connection_gain.mute = cg->mute;
+
+	if (conn->gain_slot < 0) {
+
+		VERBOSE (engine, "gain slot %" PRIu32 " for %s -> %s", slot,
+			 srcport->shared->name, dstport->shared->name);
+
+		conn->gain_slot = slot;
+
+		/* a port with a gain on any input mixes on its own */
+		jack_port_leave_mix_group (engine, dstport);
+		jack_port_regroup_mix (engine, dstport, NULL);
+
+		VALGRIND_MEMSET (&event, 0, sizeof(event));
+		event.type = ConnectionGain;
+		event.x.self_id = dstport->shared->id;
+		event.y.other_id = srcport->shared->id;
+		event.z.gain_slot = slot;
+
+		jack_engine_allow_plan_cycles (engine);
+
+		if (conn->dstclient->control->active
+		    && jack_deliver_event (engine, conn->dstclient, &event)) {
+			jack_error ("cannot send connection gain notification"
+				    " to client %s",
+				    conn->dstclient->control->name);
+		}
+
+		jack_engine_block_plan_cycles (engine);
+	}
+
+	jack_unlock_graph (engine);
+
+	return 0;
+}
+
 int
 jack_port_do_unregister (jack_engine_t *engine, jack_request_t *req)
 {
@@ -4771,33 +7309,72 @@ jack_property_change_notify (jack_engine_t *engine,
 	}
 }
 
+/* Give an output port a buffer of at least `request' bytes, or of the
+ * type's usual size if that is 0. A port of a type with size classes
+ * gets the smallest free buffer that is big enough.
+ */
 int
-jack_port_assign_buffer (jack_engine_t *engine, jack_port_internal_t *port)
+jack_port_assign_buffer (jack_engine_t *engine, jack_port_internal_t *port,
+			 jack_shmsize_t request)
 {
 	jack_port_buffer_list_t *blist =
 		jack_port_buffer_list (engine, port);
+	jack_port_type_info_t *port_type =
+		jack_port_type_info (engine, port);
 	jack_port_buffer_info_t *bi;
+	jack_shmsize_t one_buffer;
+	JSList **freelist = NULL;
+	int c, first;
+
+	one_buffer = jack_port_type_buffer_size (port_type,
+						 engine->control->buffer_size);
+
+	for (first = 0; first < JACK_PORT_SIZE_CLASSES; first++) {
+		if ((one_buffer << (2 * first)) >= request) {
+			break;
+		}
+	}
+
+	if (request < 0 || first == JACK_PORT_SIZE_CLASSES
+	    || (first > 0 && !jack_port_type_has_classes (port->shared->ptype_id))) {
+		jack_error ("cannot give a %s port a buffer of %d bytes"
+			    " (at most %d)", port_type->type_name, request,
+			    one_buffer << (2 * (JACK_PORT_SIZE_CLASSES - 1)));
+		return -1;
+	}
 
 	if (port->shared->flags & JackPortIsInput) {
+		/* only used to size a client's mix buffer */
 		port->shared->offset = 0;
+		port->shared->buffer_size =
+			jack_port_type_has_classes (port->shared->ptype_id)
+			? one_buffer << (2 * first) : 0;
 		return 0;
 	}
 
 	pthread_mutex_lock (&blist->lock);
 
-	if (blist->freelist == NULL) {
-		jack_port_type_info_t *port_type =
-			jack_port_type_info (engine, port);
-		jack_error ("all %s port buffers in use!",
-			    port_type->type_name);
+	for (c = first; c < JACK_PORT_SIZE_CLASSES; c++) {
+		freelist = jack_port_buffer_freelist (blist, c);
+		if (*freelist) {
+			break;
+		}
+	}
+
+	if (c == JACK_PORT_SIZE_CLASSES) {
+		jack_error ("all %s port buffers of %d bytes or more"
+			    " in use!", port_type->type_name,
+			    one_buffer << (2 * first));
 		pthread_mutex_unlock (&blist->lock);
 		return -1;
 	}
 
-	bi = (jack_port_buffer_info_t*)blist->freelist->data;
-	blist->freelist = jack_slist_remove (blist->freelist, bi);
+	bi = (jack_port_buffer_info_t*)(*freelist)->data;
+	*freelist = jack_slist_remove (*freelist, bi);
 
 	port->shared->offset = bi->offset;
+	port->shared->buffer_size =
+		jack_port_type_has_classes (port->shared->ptype_id) ? bi->size : 0;
 	port->buffer_info = bi;
 
 	pthread_mutex_unlock (&blist->lock);
@@ -4813,6 +7390,13 @@ jack_get_port_by_name (jack_engine_t *engine, const char *name)
 	   elements prevent this from being a problem.
 	 */
 
+	switch (jack_port_index_lookup (engine->control, name, &id)) {
+	case 1:
+		return &engine->internal_ports[id];
+	case 0:
+		return NULL;
+	}
+
 	for (id = 0; id < engine->port_max; id++) {
 		if (engine->control->ports[id].in_use &&
 		    jack_port_name_equals (&engine->control->ports[id], name)) {
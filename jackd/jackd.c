@@ -72,6 +72,14 @@ static int do_unlock = 0;
 static jack_nframes_t frame_time_offset = 0;
 static int nozombies = 0;
 static int timeout_count_threshold = 0;
+static int parallel = 0;
+static int futex_wakeup = 0;
+static int spin_usecs = 0;
+static int flush_denormals = 0;
+static unsigned int midi_class_budget = 25;
+
+/* codes for long options that have no single-letter form */
+#define OPT_MIDI_CLASS_BUDGET 256
 
 extern int sanitycheck(int, int);
 
@@ -306,7 +314,9 @@ jack_main (jack_driver_desc_t * driver_desc, JSList * driver_params, JSList * sl
 				       do_mlock, do_unlock, server_name,
 				       temporary, verbose, client_timeout,
 				       port_max, getpid (), frame_time_offset,
-				       nozombies, timeout_count_threshold, drivers)) == 0) {
+				       nozombies, timeout_count_threshold, parallel,
+				       futex_wakeup, spin_usecs, flush_denormals,
+				       midi_class_budget, drivers)) == 0) {
 		jack_error ("cannot create engine");
 		return -1;
 	}
@@ -676,9 +686,9 @@ main (int argc, char *argv[])
 	int show_version = 0;
 
 #ifdef HAVE_ZITA_BRIDGE_DEPS
-	const char *options = "A:d:P:uvshVrRZTFlI:t:mM:n:Np:c:X:C:";
+	const char *options = "A:d:P:uvshVrRZTFlI:t:mM:n:Np:c:W:X:C:";
 #else
-	const char *options = "d:P:uvshVrRZTFlI:t:mM:n:Np:c:X:C:";
+	const char *options = "d:P:uvshVrRZTFlI:t:mM:n:Np:c:W:X:C:";
 #endif
 	struct option long_options[] =
 	{
@@ -689,13 +699,17 @@ main (int argc, char *argv[])
 #endif
 		{ "clock-source",      1, 0,		     'c' },
 		{ "driver",	       1, 0,		     'd' },
+		{ "flush-denormals",   0, &flush_denormals, 1	 },
+		{ "futex-wakeup",      0, &futex_wakeup,    1	 },
 		{ "help",	       0, 0,		     'h' },
 		{ "tmpdir-location",   0, 0,		     'l' },
 		{ "internal-client",   0, 0,		     'I' },
 		{ "no-mlock",	       0, 0,		     'm' },
 		{ "midi-bufsize",      1, 0,		     'M' },
+		{ "midi-class-budget", 1, 0,		     OPT_MIDI_CLASS_BUDGET },
 		{ "name",	       1, 0,		     'n' },
 		{ "no-sanity-checks",  0, 0,		     'N' },
+		{ "parallel",	       0, &parallel,	     1	 },
 		{ "port-max",	       1, 0,		     'p' },
 		{ "realtime-priority", 1, 0,		     'P' },
 		{ "no-realtime",       0, 0,		     'r' },
@@ -709,6 +723,7 @@ main (int argc, char *argv[])
 		{ "version",	       0, 0,		     'V' },
 		{ "verbose",	       0, 0,		     'v' },
 		{ "slave-driver",      1, 0,		     'X' },
+		{ "spin-usecs",	       1, 0,		     'W' },
 		{ "nozombies",	       0, 0,		     'Z' },
 		{ "timeout-thres",     2, 0,		     'C' },
 		{ 0,		       0, 0,		     0	 }
@@ -881,6 +896,10 @@ main (int argc, char *argv[])
 			show_version = 1;
 			break;
 
+		case 'W':
+			spin_usecs = atoi (optarg);
+			break;
+
 		case 'X':
 			slave_drivers = jack_slist_append (slave_drivers, optarg);
 			break;
@@ -888,6 +907,14 @@ main (int argc, char *argv[])
 			nozombies = 1;
 			break;
 
+		case OPT_MIDI_CLASS_BUDGET:
+			midi_class_budget = (unsigned int)atol (optarg);
+			break;
+
+		case 0:
+			/* a long option that only sets its flag */
+			break;
+
 		default:
 			jack_error ("Unknown option character %c",
 				    optopt);
@@ -75,16 +75,20 @@ jack_sync_poll_deactivate (jack_engine_t *engine,
 
 /* stop polling all the slow-sync clients
  *
- *   precondition: caller holds the graph lock. */
+ *   precondition: caller holds the graph lock, or is in a plan cycle. */
 static void
 jack_sync_poll_stop (jack_engine_t *engine)
 {
-	JSList *node;
+	jack_graph_plan_t *plan;
+	unsigned int i;
 	long poll_count = 0;            /* count sync_poll clients */
 
-	for (node = engine->clients; node; node = jack_slist_next (node)) {
-		jack_client_internal_t *client =
-			(jack_client_internal_t*)node->data;
+	/* the plan has the same clients as engine->clients, in an
+	   order that does not change under a plan cycle */
+	plan = __atomic_load_n (&engine->plan, __ATOMIC_ACQUIRE);
+
+	for (i = 0; plan && i < plan->nentries; i++) {
+		jack_client_internal_t *client = plan->entries[i].client;
 		if (client->control->active_slowsync &&
 		    client->control->sync_poll) {
 			client->control->sync_poll = 0;
@@ -105,16 +109,18 @@ jack_sync_poll_stop (jack_engine_t *engine)
 
 /* start polling all the slow-sync clients
  *
- *   precondition: caller holds the graph lock. */
+ *   precondition: caller holds the graph lock, or is in a plan cycle. */
 static void
 jack_sync_poll_start (jack_engine_t *engine)
 {
-	JSList *node;
+	jack_graph_plan_t *plan;
+	unsigned int i;
 	long sync_count = 0;            /* count slow-sync clients */
 
-	for (node = engine->clients; node; node = jack_slist_next (node)) {
-		jack_client_internal_t *client =
-			(jack_client_internal_t*)node->data;
+	plan = __atomic_load_n (&engine->plan, __ATOMIC_ACQUIRE);
+
+	for (i = 0; plan && i < plan->nentries; i++) {
+		jack_client_internal_t *client = plan->entries[i].client;
 		if (client->control->active_slowsync) {
 			client->control->sync_poll = 1;
 			sync_count++;
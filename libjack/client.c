@@ -53,6 +53,8 @@
 #include "varargs.h"
 #include "intsimd.h"
 #include "messagebuffer.h"
+#include "futex.h"
+#include "denormals.h"
 
 #include <sysdeps/time.h>
 
@@ -91,7 +93,7 @@ int cpu_type = 0;
 static void
 init_cpu ()
 {
-	cpu_type = ((have_3dnow () << 8) | have_sse ());
+	cpu_type = ((have_avx () << 16) | (have_3dnow () << 8) | have_sse ());
 #if 0
 	if (ARCH_X86_HAVE_3DNOW (cpu_type)) {
 		jack_debug ("Enhanced3DNow! detected");
@@ -106,6 +108,17 @@ init_cpu ()
 	jack_port_set_funcs ();
 }
 
+#elif defined(ARCH_ARM64)
+
+int cpu_type = 0;
+
+static void
+init_cpu ()
+{
+	cpu_type = have_neon ();
+	jack_port_set_funcs ();
+}
+
 #else /* ARCH_X86 */
 
 static void
@@ -142,6 +155,39 @@ write_retry(int fd, const void *src, int size)
 	return (error);
 }
 
+/*
+ * Transfers too large for a single read or write on the socket:
+ */
+static int
+read_all(int fd, void *dst, size_t size)
+{
+	size_t done = 0;
+	int n;
+
+	while (done < size) {
+		if ((n = read_retry (fd, (char*)dst + done, size - done)) <= 0) {
+			return -1;
+		}
+		done += n;
+	}
+	return 0;
+}
+
+static int
+write_all(int fd, const void *src, size_t size)
+{
+	size_t done = 0;
+	int n;
+
+	while (done < size) {
+		if ((n = write_retry (fd, (const char*)src + done, size - done)) <= 0) {
+			return -1;
+		}
+		done += n;
+	}
+	return 0;
+}
+
 const char *
 jack_get_tmpdir ()
 {
@@ -274,6 +320,8 @@ oop_client_deliver_request (void *ptr, jack_request_t *req)
 {
 	int wok, rok;
 	jack_client_t *client = (jack_client_t*)ptr;
+	jack_graph_op_t *ops = NULL;
+	size_t opsize = 0;
 
 	wok = (write_retry (client->request_fd, req, sizeof(*req))
 	       == sizeof(*req));
@@ -292,9 +340,29 @@ oop_client_deliver_request (void *ptr, jack_request_t *req)
 		}
 	}
 
+	/* and the operations after a GraphTransaction request, which
+	   come back with their results after the reply */
+
+	if (req->type == GraphTransaction) {
+		ops = req->x.transaction.ops;
+		opsize = sizeof(jack_graph_op_t) * req->x.transaction.nops;
+		if (wok && write_all (client->request_fd, ops, opsize)) {
+			jack_error ("cannot send %u graph operations to server",
+				    req->x.transaction.nops);
+			wok = 0;
+		}
+	}
+
 	rok = (read_retry (client->request_fd, req, sizeof(*req))
 	       == sizeof(*req));
 
+	if (ops) {
+		req->x.transaction.ops = ops;
+		if (rok && read_all (client->request_fd, ops, opsize)) {
+			rok = 0;
+		}
+	}
+
 	if (wok && rok) {               /* everything OK? */
 		return req->status;
 	}
@@ -349,7 +417,11 @@ jack_client_alloc ()
 	client->request_fd = -1;
 	client->event_fd = -1;
 	client->upstream_is_jackd = 0;
-	client->graph_next_fd = -1;
+	client->spin_usecs = -1;
+	client->graph_next_fd[0] = -1;
+	client->graph_next_fd[1] = -1;
+	client->graph_next_slot[0] = -1;
+	client->graph_next_slot[1] = -1;
 	client->ports = NULL;
 	client->ports_ext = NULL;
 	client->engine = NULL;
@@ -388,8 +460,14 @@ jack_client_alloc ()
 	client->request_fd = -1;
 	client->event_fd = -1;
 	client->upstream_is_jackd = 0;
+	client->graph_slot = -1;
+	client->spin_usecs = -1;
+	client->spin_budget = 0;
 	client->graph_wait_fd = -1;
-	client->graph_next_fd = -1;
+	client->graph_next_fd[0] = -1;
+	client->graph_next_fd[1] = -1;
+	client->graph_next_slot[0] = -1;
+	client->graph_next_slot[1] = -1;
 	client->ports = NULL;
 	client->ports_ext = NULL;
 	client->engine = NULL;
@@ -439,6 +517,27 @@ jack_client_free (jack_client_t *client)
 	free (client);
 }
 
+/* An input port mixes into a local buffer if it has more than one
+ * connection, or any connection with a gain.
+ */
+static int
+jack_port_needs_mix_buffer (jack_port_t *port)
+{
+	JSList *node;
+
+	if (jack_slist_length (port->connections) > 1) {
+		return TRUE;
+	}
+
+	for (node = port->connections; node; node = jack_slist_next (node)) {
+		if (((jack_port_t*)node->data)->gain_slot >= 0) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
 void
 jack_client_fix_port_buffers (jack_client_t *client)
 {
@@ -457,12 +556,12 @@ jack_client_fix_port_buffers (jack_client_t *client)
 		if (port->shared->flags & JackPortIsInput) {
 			if (port->mix_buffer) {
 				size_t buffer_size =
-					jack_port_type_buffer_size ( port->type_info,
-								     client->engine->buffer_size );
+					jack_port_buffer_size (port,
+							       client->engine->buffer_size);
 				jack_pool_release (port->mix_buffer);
 				port->mix_buffer = NULL;
 				pthread_mutex_lock (&port->connection_lock);
-				if (jack_slist_length (port->connections) > 1) {
+				if (jack_port_needs_mix_buffer (port)) {
 					port->mix_buffer = jack_pool_alloc (buffer_size);
 					port->fptr.buffer_init (port->mix_buffer,
 								buffer_size,
@@ -474,6 +573,40 @@ jack_client_fix_port_buffers (jack_client_t *client)
 	}
 }
 
+/* Give one of our ports a new connection list, made by the server for
+ * an internal client (see jack_graph_plan_t). The process thread may
+ * be using the old one until the server's grace period is over.
+ */
+void
+jack_port_set_connections (jack_port_t *port, JSList *connections)
+{
+	jack_nframes_t nframes = port->client->engine->buffer_size;
+	JSList *node;
+	int need_mix = (jack_slist_length (connections) > 1);
+
+	for (node = connections; node; node = jack_slist_next (node)) {
+		if (((jack_port_t*)node->data)->gain_slot >= 0) {
+			need_mix = TRUE;
+		}
+	}
+
+	pthread_mutex_lock (&port->connection_lock);
+
+	if ((port->shared->flags & JackPortIsInput) && need_mix
+	    && port->mix_buffer == NULL) {
+		size_t buffer_size = jack_port_buffer_size (port, nframes);
+		port->mix_buffer = jack_pool_alloc (buffer_size);
+		port->fptr.buffer_init (port->mix_buffer, buffer_size,
+					nframes);
+	}
+
+	/* the mix buffer has to be there before the process thread
+	   sees the list */
+	__atomic_store_n (&port->connections, connections, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock (&port->connection_lock);
+}
+
 int
 jack_client_handle_port_connection (jack_client_t *client, jack_event_t *event)
 {
@@ -482,8 +615,11 @@ jack_client_handle_port_connection (jack_client_t *client, jack_event_t *event)
 	JSList *node;
 	int need_free = FALSE;
 
-	if (jack_uuid_compare (client->engine->ports[event->x.self_id].client_id, client->control->uuid) == 0 ||
-	    jack_uuid_compare (client->engine->ports[event->y.other_id].client_id, client->control->uuid) == 0) {
+	/* the server keeps the lists of an internal client itself */
+
+	if (!client->engine_connections &&
+	    (jack_uuid_compare (client->engine->ports[event->x.self_id].client_id, client->control->uuid) == 0 ||
+	     jack_uuid_compare (client->engine->ports[event->y.other_id].client_id, client->control->uuid) == 0)) {
 
 		/* its one of ours */
 
@@ -502,8 +638,8 @@ jack_client_handle_port_connection (jack_client_t *client, jack_event_t *event)
 			    && (control_port->connections != NULL)
 			    && (control_port->mix_buffer == NULL)  ) {
 				size_t buffer_size =
-					jack_port_type_buffer_size ( control_port->type_info,
-								     client->engine->buffer_size );
+					jack_port_buffer_size (control_port,
+							       client->engine->buffer_size);
 				control_port->mix_buffer = jack_pool_alloc (buffer_size);
 				control_port->fptr.buffer_init (control_port->mix_buffer,
 								buffer_size,
@@ -558,6 +694,60 @@ jack_client_handle_port_connection (jack_client_t *client, jack_event_t *event)
 	return 0;
 }
 
+/* The server gave a connection to one of our input ports a gain slot.
+ * From now on the port mixes that connection with the gain in the
+ * slot, even if it is the only one.
+ */
+int
+jack_client_handle_connection_gain (jack_client_t *client, jack_event_t *event)
+{
+	jack_port_t *control_port;
+	jack_port_t *other;
+	JSList *node;
+	int need_free = FALSE;
+
+	if (jack_uuid_compare (client->engine->ports[event->x.self_id].client_id,
+			       client->control->uuid) != 0) {
+		return 0;
+	}
+
+	if ((control_port = jack_port_by_id_int (client, event->x.self_id,
+						 &need_free)) == NULL) {
+		return 0;
+	}
+
+	pthread_mutex_lock (&control_port->connection_lock);
+
+	if (control_port->mix_buffer == NULL) {
+		size_t buffer_size =
+			jack_port_buffer_size (control_port,
+					       client->engine->buffer_size);
+		control_port->mix_buffer = jack_pool_alloc (buffer_size);
+		control_port->fptr.buffer_init (control_port->mix_buffer,
+						buffer_size,
+						client->engine->buffer_size);
+	}
+
+	for (node = control_port->connections; node;
+	     node = jack_slist_next (node)) {
+
+		other = (jack_port_t*)node->data;
+
+		if (other->shared->id == event->y.other_id) {
+			/* the mix buffer has to be there before the
+			   process thread sees the slot */
+			__atomic_store_n (&other->gain_slot,
+					  (int)event->z.gain_slot,
+					  __ATOMIC_RELEASE);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock (&control_port->connection_lock);
+
+	return 0;
+}
+
 int
 jack_client_handle_session_callback (jack_client_t *client, jack_event_t *event)
 {
@@ -746,48 +936,87 @@ jack_handle_reorder (jack_client_t *client, jack_event_t *event)
 
 #else
 
+/* Open the FIFO that control->graph_next[set] names for writing, unless
+ * it is already open.
+ */
 static int
-jack_handle_reorder (jack_client_t *client, jack_event_t *event)
+jack_client_open_next (jack_client_t *client, int set)
 {
 	char path[PATH_MAX + 1];
+	int slot = client->control->graph_next[set];
 
-	DEBUG ("graph reorder\n");
+	if (slot == client->graph_next_slot[set]) {
+		return 0;
+	}
 
-	if (client->graph_wait_fd >= 0) {
-		DEBUG ("closing graph_wait_fd==%d", client->graph_wait_fd);
-		close (client->graph_wait_fd);
-		client->graph_wait_fd = -1;
+	if (client->graph_next_fd[set] >= 0) {
+		DEBUG ("closing graph_next_fd[%d]==%d", set,
+		       client->graph_next_fd[set]);
+		close (client->graph_next_fd[set]);
+		client->graph_next_fd[set] = -1;
+		client->graph_next_slot[set] = -1;
 	}
 
-	if (client->graph_next_fd >= 0) {
-		DEBUG ("closing graph_next_fd==%d", client->graph_next_fd);
-		close (client->graph_next_fd);
-		client->graph_next_fd = -1;
+	if (slot < 0) {
+		return 0;
 	}
 
-	sprintf (path, "%s-%" PRIu32, client->fifo_prefix, event->x.n);
+	sprintf (path, "%s-%d", client->fifo_prefix, slot);
 
-	if ((client->graph_wait_fd = open (path, O_RDONLY | O_NONBLOCK)) < 0) {
-		jack_error ("cannot open specified fifo [%s] for reading (%s)",
+	if ((client->graph_next_fd[set] = open (path, O_WRONLY | O_NONBLOCK)) < 0) {
+		jack_error ("cannot open specified fifo [%s] for writing (%s)",
 			    path, strerror (errno));
 		return -1;
 	}
-	DEBUG ("opened new graph_wait_fd %d (%s)", client->graph_wait_fd, path);
 
-	sprintf (path, "%s-%" PRIu32, client->fifo_prefix, event->x.n + 1);
+	client->graph_next_slot[set] = slot;
 
-	if ((client->graph_next_fd = open (path, O_WRONLY | O_NONBLOCK)) < 0) {
-		jack_error ("cannot open specified fifo [%s] for writing (%s)",
-			    path, strerror (errno));
+	DEBUG ("opened new graph_next_fd[%d] %d (%s)", set,
+	       client->graph_next_fd[set], path);
+
+	return 0;
+}
+
+static int
+jack_handle_reorder (jack_client_t *client, jack_event_t *event)
+{
+	char path[PATH_MAX + 1];
+
+	DEBUG ("graph reorder\n");
+
+	/* we always wait on the same FIFO. where we go next depends on
+	   the plan the server runs, so keep the way for both open */
+
+	if (client->graph_wait_fd < 0 || client->graph_slot != (int)event->x.n) {
+
+		if (client->graph_wait_fd >= 0) {
+			DEBUG ("closing graph_wait_fd==%d", client->graph_wait_fd);
+			close (client->graph_wait_fd);
+			client->graph_wait_fd = -1;
+		}
+
+		sprintf (path, "%s-%" PRIu32, client->fifo_prefix, event->x.n);
+
+		if ((client->graph_wait_fd = open (path, O_RDONLY | O_NONBLOCK)) < 0) {
+			jack_error ("cannot open specified fifo [%s] for reading (%s)",
+				    path, strerror (errno));
+			return -1;
+		}
+		DEBUG ("opened new graph_wait_fd %d (%s)", client->graph_wait_fd, path);
+	}
+
+	if (jack_client_open_next (client, 0)
+	    || jack_client_open_next (client, 1)) {
 		return -1;
 	}
 
 	client->upstream_is_jackd = event->y.n;
+	client->graph_slot = event->x.n;
 	client->pollmax = 2;
 
-	DEBUG ("opened new graph_next_fd %d (%s) (upstream is jackd? %d)",
-	       client->graph_next_fd, path,
-	       client->upstream_is_jackd);
+	DEBUG ("waiting on %d, then fds %d/%d (upstream is jackd? %d)",
+	       client->graph_wait_fd, client->graph_next_fd[0],
+	       client->graph_next_fd[1], client->upstream_is_jackd);
 
 	/* If the client registered its own callback for graph order events,
 	   execute it now.
@@ -1231,10 +1460,17 @@ jack_attach_port_segment (jack_client_t *client, jack_port_type_id_t ptid)
 		jack_release_shm (&client->port_segment[ptid]);
 	}
 
+#ifdef USE_MEMFD_SHM
+	/* the server sent the segment right behind the event */
+	if (jack_shm_recv (client->event_fd, &client->port_segment[ptid])) {
+		return -1;
+	}
+#else
 	/* get the index into the shm registry */
 
 	client->port_segment[ptid].index =
 		client->engine->port_types[ptid].shm_registry_index;
+#endif
 
 	/* attach the relevant segment */
 
@@ -1319,6 +1555,27 @@ jack_client_open_aux (const char *client_name,
 		goto fail;
 	}
 
+#ifdef USE_MEMFD_SHM
+	/* the server follows its reply with the two control segments */
+	client->engine_shm.fd = -1;
+	client->control_shm.fd = -1;
+	if (res.shm_fds != 2
+	    || jack_shm_recv (req_fd, &client->engine_shm)
+	    || jack_shm_recv (req_fd, &client->control_shm)) {
+		jack_error ("Unable to receive shared memory from server"
+			    " (are jackd and libjack in sync?)");
+		*status |= (JackFailure | JackShmFailure);
+		goto fail;
+	}
+#else
+	if (res.shm_fds) {
+		jack_error ("Server passes shared memory this libjack "
+			    "cannot use (are jackd and libjack in sync?)");
+		*status |= (JackFailure | JackShmFailure);
+		goto fail;
+	}
+#endif
+
 	/* attach the engine control/info block */
 	client->engine_shm.index = res.engine_shm_index;
 	if (jack_attach_shm (&client->engine_shm)) {
@@ -1349,6 +1606,15 @@ jack_client_open_aux (const char *client_name,
 	 */
 	jack_destroy_shm (&client->control_shm);
 
+#ifdef JACK_HAVE_FUTEX
+	/* we can follow the futex process chain if the server uses it */
+	client->control->futex_capable = TRUE;
+#endif
+
+	if (getenv ("JACK_SPIN_USECS")) {
+		jack_set_spin_wait (client, atoi (getenv ("JACK_SPIN_USECS")));
+	}
+
 	client->n_port_types = client->engine->n_port_types;
 	if ((client->port_segment = (jack_shm_info_t*)malloc (sizeof(jack_shm_info_t) * client->n_port_types)) == NULL) {
 		goto fail;
@@ -1404,6 +1670,11 @@ fail:
 		jack_release_shm (&client->control_shm);
 		client->control = 0;
 	}
+#ifdef USE_MEMFD_SHM
+	/* close whatever was received but not attached */
+	jack_destroy_shm (&client->engine_shm);
+	jack_destroy_shm (&client->control_shm);
+#endif
 	if (req_fd >= 0) {
 		close (req_fd);
 	}
@@ -1905,6 +2176,11 @@ jack_client_process_events (jack_client_t* client)
 					 (client, &event);
 			break;
 
+		case ConnectionGain:
+			status = jack_client_handle_connection_gain
+					 (client, &event);
+			break;
+
 		case BufferSizeChange:
 			jack_client_fix_port_buffers (client);
 			if (control->bufsize_cbset) {
@@ -1984,9 +2260,28 @@ jack_wake_next_client (jack_client_t* client)
 	int pret = 0;
 	char c = 0;
 
-	if (write_retry (client->graph_next_fd, &c, sizeof(c))
+	/* the server set graph_set before it woke the first of us */
+	int set = __atomic_load_n (&client->engine->graph_set,
+				   __ATOMIC_ACQUIRE) & 1;
+
+#ifdef JACK_HAVE_FUTEX
+	if (client->control->futex_wakeup
+	    && client->control->graph_next[set] >= 0) {
+		/* our own wakeup was consumed in jack_client_futex_wait(),
+		   so there is nothing to clean up */
+		jack_futex_post (&client->engine->graph_futex[client->control->graph_next[set]]);
+		return 0;
+	}
+#endif
+
+	/* normally opened by jack_handle_reorder() already */
+	if (jack_client_open_next (client, set)) {
+		return -1;
+	}
+
+	if (write_retry (client->graph_next_fd[set], &c, sizeof(c))
 	    != sizeof(c)) {
-		DEBUG ("cannot write byte to fd %d", client->graph_next_fd);
+		DEBUG ("cannot write byte to fd %d", client->graph_next_fd[set]);
 		jack_error ("cannot continue execution of the "
 			    "processing graph (%s)",
 			    strerror (errno));
@@ -2088,6 +2383,217 @@ jack_osx_event_thread_work (void* arg)
 
 #else /* !JACK_USE_MACH_THREADS */
 
+#ifdef JACK_HAVE_FUTEX
+
+/* handle every event queued on the event socket, without blocking */
+static int
+jack_client_drain_events (jack_client_t* client)
+{
+	int pret;
+
+	while ((pret = poll (&client->pollfd[EVENT_POLL_INDEX], 1, 0)) != 0) {
+		if (pret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			jack_error ("poll failed in client (%s)",
+				    strerror (errno));
+			return -1;
+		}
+		if (client->pollfd[EVENT_POLL_INDEX].revents & ~POLLIN) {
+			DEBUG ("event pollfd has error status\n");
+			return -1;
+		}
+		if (jack_client_process_events (client)) {
+			DEBUG ("event processing failed\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static inline jack_time_t
+jack_client_spin_limit (jack_client_t* client)
+{
+	return client->spin_usecs >= 0 ?
+	       client->spin_usecs : client->engine->spin_usecs;
+}
+
+/* Busy-wait for up to client->spin_budget usecs for our word to be
+ * posted (or kicked). Returns non-zero if it was.
+ *
+ * Only a post counts as a hit; a kick or an event says nothing about
+ * how long wakeups take. The budget tunes itself: a hit raises it to
+ * twice the time the wakeup actually took if that is more, and a miss
+ * halves it, unless the blocking wait that follows shows that a
+ * slightly longer spin would have caught the wakeup. It never drops
+ * below 1/16 of the limit, so that we keep probing.
+ */
+static int
+jack_client_spin (jack_client_t* client, volatile int32_t *word)
+{
+	jack_client_control_t *control = client->control;
+	jack_time_t start = jack_get_microseconds ();
+	jack_time_t now = start;
+	jack_time_t limit = jack_client_spin_limit (client);
+	int32_t v;
+
+	if (client->spin_budget > limit || client->spin_budget == 0) {
+		client->spin_budget = limit;
+	}
+
+	do {
+		v = __atomic_load_n (word, __ATOMIC_ACQUIRE);
+		if (v & JACK_FUTEX_COUNT_MASK) {
+			control->spin_hits++;
+			if (2 * (now - start) + 1 > client->spin_budget) {
+				client->spin_budget = 2 * (now - start) + 1;
+			}
+			if (client->spin_budget > limit) {
+				client->spin_budget = limit;
+			}
+			return 1;
+		}
+		if (v || control->event_pending) {
+			return 1;
+		}
+		jack_cpu_relax ();
+		now = jack_get_microseconds ();
+	} while (now - start < client->spin_budget);
+
+	control->spin_misses++;
+
+	return 0;
+}
+
+static void
+jack_client_spin_missed (jack_client_t* client, jack_time_t waited)
+{
+	jack_time_t limit = jack_client_spin_limit (client);
+
+	if (waited < 2 * client->spin_budget && waited < limit) {
+		client->spin_budget = 2 * waited;
+	} else {
+		client->spin_budget /= 2;
+	}
+
+	if (client->spin_budget < limit / 16) {
+		client->spin_budget = limit / 16;
+	}
+	if (client->spin_budget > limit) {
+		client->spin_budget = limit;
+	}
+}
+
+/* Wait for our graph_futex[] word instead of poll()ing the FIFO.
+ * The server flags events in control->event_pending and kicks the
+ * word, since we are not looking at the event socket while asleep.
+ *
+ * Returns 1 when it is time to run process(), 0 if the server
+ * switched us back to the FIFOs, and -1 on error.
+ */
+static int
+jack_client_futex_wait (jack_client_t* client)
+{
+	jack_client_control_t *control = client->control;
+	volatile int32_t *word;
+	int32_t v;
+	int ret = -1;
+	int wret;
+	int spinning = (jack_client_spin_limit (client) > 0);
+	jack_time_t then = 0;
+
+	word = &client->engine->graph_futex[client->graph_slot];
+	__atomic_store_n (&control->wait_slot, client->graph_slot,
+			  __ATOMIC_SEQ_CST);
+
+	while (1) {
+
+		if (__atomic_load_n (&control->event_pending,
+				     __ATOMIC_SEQ_CST)) {
+
+			__atomic_store_n (&control->event_pending, 0,
+					  __ATOMIC_SEQ_CST);
+
+			if (jack_client_drain_events (client)) {
+				break;
+			}
+
+			/* a GraphReordered event may have moved us */
+
+			if (!control->futex_wakeup || client->graph_wait_fd < 0) {
+				ret = 0;
+				break;
+			}
+
+			word = &client->engine->graph_futex[client->graph_slot];
+			__atomic_store_n (&control->wait_slot,
+					  client->graph_slot, __ATOMIC_SEQ_CST);
+			continue;
+		}
+
+		if (jack_futex_trytake (word)) {
+			control->awake_at = jack_get_microseconds ();
+			ret = 1;
+			break;
+		}
+
+		v = __atomic_load_n (word, __ATOMIC_ACQUIRE);
+
+		if (v & JACK_FUTEX_KICK) {
+			__atomic_and_fetch (word, ~JACK_FUTEX_KICK,
+					    __ATOMIC_SEQ_CST);
+			continue;
+		}
+
+		if (v & JACK_FUTEX_COUNT_MASK) {
+			continue;
+		}
+
+		if (spinning) {
+			then = jack_get_microseconds ();
+			if (jack_client_spin (client, word)) {
+				continue;
+			}
+		}
+
+		wret = jack_futex_wait (word, v, 1000000);
+
+		if (spinning && wret == 0
+		    && (__atomic_load_n (word, __ATOMIC_ACQUIRE)
+			& JACK_FUTEX_COUNT_MASK)) {
+			jack_client_spin_missed (client,
+						 jack_get_microseconds () - then);
+		}
+
+		if (wret < 0) {
+
+			if (errno != ETIMEDOUT) {
+				jack_error ("futex wait failed in client (%s)",
+					    strerror (errno));
+				break;
+			}
+
+			/* nothing for a second. make sure that the
+			   server is still there */
+
+			pthread_testcancel ();
+
+			if (jack_client_drain_events (client)
+			    || control->dead || !client->engine->engine_ok) {
+				break;
+			}
+		}
+	}
+
+	__atomic_store_n (&control->wait_slot, -1, __ATOMIC_SEQ_CST);
+
+	return ret;
+}
+
+#endif /* JACK_HAVE_FUTEX */
+
 static int
 jack_client_core_wait (jack_client_t* client)
 {
@@ -2100,6 +2606,19 @@ jack_client_core_wait (jack_client_t* client)
 	       "event_fd only");
 
 	while (1) {
+#ifdef JACK_HAVE_FUTEX
+		if (control->futex_wakeup && client->graph_wait_fd >= 0) {
+			int fret = jack_client_futex_wait (client);
+
+			if (fret < 0) {
+				return -1;
+			} else if (fret > 0) {
+				return 0;
+			}
+			continue;
+		}
+#endif
+
 		if (poll (client->pollfd, client->pollmax, 1000) < 0) {
 			if (errno == EINTR) {
 				continue;
@@ -2295,6 +2814,8 @@ jack_nframes_t jack_cycle_wait (jack_client_t* client)
 	control->awake_at = jack_get_microseconds ();
 	client->control->state = Running;
 
+	jack_denormals_begin (client->engine->flush_denormals);
+
 	/* begin preemption checking */
 	CHECK_PREEMPTION (client->engine, TRUE);
 
@@ -2320,6 +2841,10 @@ void jack_cycle_signal (jack_client_t* client, int status)
 	/* end preemption checking */
 	CHECK_PREEMPTION (client->engine, FALSE);
 
+	if (jack_denormals_end ()) {
+		client->control->denormal_cycles++;
+	}
+
 	client->control->finished_at = jack_get_microseconds ();
 	client->control->state = Finished;
 
@@ -2571,8 +3096,12 @@ jack_client_close_aux (jack_client_t *client)
 			close (client->graph_wait_fd);
 		}
 
-		if (client->graph_next_fd >= 0) {
-			close (client->graph_next_fd);
+		if (client->graph_next_fd[0] >= 0) {
+			close (client->graph_next_fd[0]);
+		}
+
+		if (client->graph_next_fd[1] >= 0) {
+			close (client->graph_next_fd[1]);
 		}
 #endif
 
@@ -2586,6 +3115,8 @@ jack_client_close_aux (jack_client_t *client)
 
 	}
 
+	jack_midi_free_spills (client);
+
 	for (node = client->ports; node; node = jack_slist_next (node))
 		free (node->data);
 	jack_slist_free (client->ports);
@@ -2702,6 +3233,87 @@ jack_disconnect (jack_client_t *client, const char *source_port,
 	return jack_client_deliver_request (client, &req);
 }
 
+static int
+jack_connection_gain_request (jack_client_t *client, const char *source_port,
+			      const char *destination_port, uint32_t what,
+			      float *gain, int *mute)
+{
+	jack_request_t req;
+	int ret;
+
+	VALGRIND_MEMSET (&req, 0, sizeof(req));
+
+	req.type = SetConnectionGain;
+
+	snprintf (req.x.connection_gain.source_port,
+		  sizeof(req.x.connection_gain.source_port), "%s", source_port);
+	snprintf (req.x.connection_gain.destination_port,
+		  sizeof(req.x.connection_gain.destination_port),
+		  "%s", destination_port);
+	req.x.connection_gain.what = what;
+	req.x.connection_gain.gain = *gain;
+	req.x.connection_gain.mute = *mute;
+
+	if ((ret = jack_client_deliver_request (client, &req)) == 0) {
+		*gain = req.x.connection_gain.gain;
+		*mute = req.x.connection_gain.mute;
+	}
+
+	return ret;
+}
+
+/* Scale what a connection carries into its destination port. A new
+ * gain is reached over one period. Only audio connections have a
+ * gain.
+ */
+int
+jack_connection_set_gain (jack_client_t *client, const char *source_port,
+			  const char *destination_port, float gain)
+{
+	int mute = 0;
+
+	return jack_connection_gain_request (client, source_port,
+					     destination_port,
+					     JACK_CONNECTION_SET_GAIN,
+					     &gain, &mute);
+}
+
+/* Silence a connection without forgetting its gain. */
+int
+jack_connection_set_mute (jack_client_t *client, const char *source_port,
+			  const char *destination_port, int mute)
+{
+	float gain = 1.0F;
+
+	return jack_connection_gain_request (client, source_port,
+					     destination_port,
+					     JACK_CONNECTION_SET_MUTE,
+					     &gain, &mute);
+}
+
+int
+jack_connection_get_gain (jack_client_t *client, const char *source_port,
+			  const char *destination_port, float *gain,
+			  int *mute)
+{
+	float g = 1.0F;
+	int m = 0;
+	int ret;
+
+	if ((ret = jack_connection_gain_request (client, source_port,
+						 destination_port, 0,
+						 &g, &m)) == 0) {
+		if (gain) {
+			*gain = g;
+		}
+		if (mute) {
+			*mute = m;
+		}
+	}
+
+	return ret;
+}
+
 void
 jack_set_error_function (void (*func)(const char *))
 {
@@ -2917,7 +3529,8 @@ jack_set_session_callback (jack_client_t* client, JackSessionCallback callback,
 int
 jack_get_process_done_fd (jack_client_t *client)
 {
-	return client->graph_next_fd;
+	return client->graph_next_fd[__atomic_load_n (&client->engine->graph_set,
+						      __ATOMIC_ACQUIRE) & 1];
 }
 
 void
@@ -3108,6 +3721,47 @@ jack_reset_max_delayed_usecs (jack_client_t *client)
 	client->engine->max_delayed_usecs =  0.0f;
 }
 
+int
+jack_set_spin_wait (jack_client_t *client, int usecs)
+{
+	/* a negative value means "use the server's default". spinning
+	   only happens while the server runs the futex wakeup chain.
+	 */
+	client->spin_usecs = (usecs < 0 ? -1 : usecs);
+	client->spin_budget = 0;
+	return 0;
+}
+
+int
+jack_get_spin_wait_stats (jack_client_t *client, uint32_t *hits,
+			  uint32_t *misses)
+{
+	if (hits) {
+		*hits = client->control->spin_hits;
+	}
+	if (misses) {
+		*misses = client->control->spin_misses;
+	}
+	return 0;
+}
+
+/* Cycles in which a denormal was met, whether or not it was flushed:
+ * by this client's process thread, and by the server's (which covers
+ * the driver and the internal clients).
+ */
+int
+jack_get_denormal_cycles (jack_client_t *client, uint32_t *client_cycles,
+			  uint32_t *server_cycles)
+{
+	if (client_cycles) {
+		*client_cycles = client->control->denormal_cycles;
+	}
+	if (server_cycles) {
+		*server_cycles = client->engine->denormal_cycles;
+	}
+	return 0;
+}
+
 pthread_t
 jack_client_thread_id (jack_client_t *client)
 {
@@ -3181,6 +3835,8 @@ jack_event_type_name (JackEventType type)
 		return "property change callback";
 	case PortRename:
 		return "port rename";
+	case ConnectionGain:
+		return "connection gain";
 	default:
 		break;
 	}
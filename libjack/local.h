@@ -11,9 +11,13 @@ struct _jack_client {
 
 	struct pollfd*  pollfd;
 	int pollmax;
-	int graph_next_fd;
+	int graph_next_fd[2];           /* per slot set, see jack_handle_reorder() */
+	int graph_next_slot[2];         /* the FIFO each of them is open on */
 	int request_fd;
 	int upstream_is_jackd;
+	int graph_slot;                 /* FIFO and graph_futex[] index we wait on */
+	int spin_usecs;                 /* spin-wait limit, -1 = server's */
+	jack_time_t spin_budget;        /* current self-tuned spin time */
 
 	/* these two are copied from the engine when the
 	 * client is created.
@@ -87,6 +91,10 @@ struct _jack_client {
 	int (*deliver_request)(void*, jack_request_t*); /* JOQ: 64/32 bug! */
 	void *deliver_arg;
 
+	/* internal clients: set by engine, which then sets the
+	 * connection lists of our ports from its execution plan */
+	int engine_connections;
+
 };
 
 extern int jack_client_deliver_request(const jack_client_t *client,
@@ -94,6 +102,9 @@ extern int jack_client_deliver_request(const jack_client_t *client,
 extern jack_port_t *jack_port_new(const jack_client_t *client,
 				  jack_port_id_t port_id,
 				  jack_control_t *control);
+extern void jack_port_free(jack_port_t *port);
+extern void jack_port_set_connections(jack_port_t *port,
+				      JSList *connections);
 
 extern void *jack_zero_filled_buffer;
 
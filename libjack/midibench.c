@@ -0,0 +1,152 @@
+/* -*- mode: c; c-file-style: "bsd"; -*- */
+/*
+    Copyright (C) 2026 the JACK developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+    Times the MIDI port mixdown: one input port connected to many
+    outputs that each hold a dense cycle of events, without a server.
+
+    usage: midibench [ inputs [ events-per-input [ cycles ] ] ]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <config.h>
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include <jack/jslist.h>
+
+#include "internal.h"
+#include "port.h"
+#include "local.h"
+
+#define NFRAMES 1024
+
+extern jack_port_functions_t jack_builtin_midi_functions;
+
+/* jack_get_time() needs a clock source, which only comes with a
+   server connection */
+static double
+now_usecs ()
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int
+main (int argc, char *argv[])
+{
+	int ninputs = argc > 1 ? atoi (argv[1]) : 24;
+	int nevents = argc > 2 ? atoi (argv[2]) : 512;
+	int ncycles = argc > 3 ? atoi (argv[3]) : 10000;
+	size_t in_size, out_size;
+	jack_control_t *engine;
+	jack_client_t client;
+	jack_port_shared_t *shared;
+	jack_port_t *inputs, port;
+	jack_midi_data_t data[3];
+	void *segment;
+	char *base;
+	double start, elapsed;
+	int i, k, e;
+
+	if (ninputs < 1 || nevents < 0 || nevents > NFRAMES || ncycles < 1) {
+		fprintf (stderr, "usage: midibench [ inputs (1 or more) "
+			 "[ events-per-input (0-%d) [ cycles ] ] ]\n", NFRAMES);
+		return 1;
+	}
+
+	/* room for every event as a three byte message, and then some */
+	in_size = 4096 + nevents * 16;
+	out_size = 4096 + (size_t)ninputs * nevents * 16;
+
+	engine = (jack_control_t*)calloc (1, sizeof(jack_control_t));
+	shared = (jack_port_shared_t*)calloc (ninputs, sizeof(*shared));
+	inputs = (jack_port_t*)calloc (ninputs, sizeof(*inputs));
+	base = (char*)malloc (ninputs * in_size);
+	segment = base;
+
+	memset (&client, 0, sizeof(client));
+	client.engine = engine;
+
+	/* the outputs feeding the port, each with an event every
+	   NFRAMES / nevents frames, at different offsets */
+	memset (&port, 0, sizeof(port));
+	for (i = 0; i < ninputs; i++) {
+		void *buf = base + i * in_size;
+
+		shared[i].offset = i * in_size;
+		inputs[i].shared = &shared[i];
+		inputs[i].client_segment_base = &segment;
+		inputs[i].client = &client;
+
+		jack_builtin_midi_functions.buffer_init (buf, in_size, NFRAMES);
+		for (e = 0; e < nevents; e++) {
+			data[0] = 0x90 | (i & 0xf);
+			data[1] = e & 0x7f;
+			data[2] = 0x40;
+			jack_midi_event_write (buf, (e * NFRAMES + i % NFRAMES)
+					       / nevents, data, 3);
+		}
+
+		port.connections = jack_slist_append (port.connections, &inputs[i]);
+	}
+
+	port.client = &client;
+	port.mix_buffer = malloc (out_size);
+	jack_builtin_midi_functions.buffer_init (port.mix_buffer, out_size,
+						 NFRAMES);
+
+	/* warm up */
+	for (k = 0; k < 100; k++) {
+		engine->process_cycle++;
+		jack_builtin_midi_functions.mixdown (&port, NFRAMES);
+	}
+
+	start = now_usecs ();
+	for (k = 0; k < ncycles; k++) {
+		if (++engine->process_cycle == 0) {
+			engine->process_cycle = 1;
+		}
+		jack_builtin_midi_functions.mixdown (&port, NFRAMES);
+	}
+	elapsed = now_usecs () - start;
+
+	if (jack_midi_get_event_count (port.mix_buffer)
+	    != (uint32_t)(ninputs * nevents)
+	    || jack_midi_get_lost_event_count (port.mix_buffer)) {
+		fprintf (stderr, "midibench: mixed %u events, lost %u, "
+			 "expected %d\n",
+			 jack_midi_get_event_count (port.mix_buffer),
+			 jack_midi_get_lost_event_count (port.mix_buffer),
+			 ninputs * nevents);
+		return 1;
+	}
+
+	printf ("%d inputs x %d events: %.2f usecs per mixdown, "
+		"%.1f nsecs per event\n", ninputs, nevents,
+		elapsed / ncycles,
+		nevents ? elapsed * 1000.0 / ncycles / (ninputs * nevents)
+		: 0.0);
+
+	return 0;
+}
@@ -19,13 +19,17 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <jack/jack.h>
 #include <jack/midiport.h>
 
+#include "internal.h"
 #include "port.h"
+#include "local.h"
 
 enum { MIDI_INLINE_MAX = 4 }; /* 4 bytes for default event size */
 
@@ -35,6 +39,7 @@ typedef struct _jack_midi_port_info_private {
 	uint32_t event_count;           /**< Number of events stored in this buffer */
 	jack_nframes_t last_write_loc;  /**< Used for both writing and mixdown */
 	uint32_t events_lost;           /**< Number of events lost in this buffer */
+	uint32_t spill_port;            /**< id + 1 of the port it belongs to, if it may have a spill */
 } POST_PACKED_STRUCTURE jack_midi_port_info_private_t;
 
 typedef struct _jack_midi_port_internal_event {
@@ -46,6 +51,42 @@ typedef struct _jack_midi_port_internal_event {
 	} POST_PACKED_STRUCTURE;
 } POST_PACKED_STRUCTURE jack_midi_port_internal_event_t;
 
+/* Events that did not fit in a port's buffer, kept in the client's
+ * memory for ports that asked for it (jack_midi_port_set_spill()), and
+ * put back at frame 0 when the buffer is cleared for the next cycle.
+ * Only the process thread touches the ring. Records are a 32-bit data
+ * size followed by the data, padded to 4 bytes; SPILL_PAD fills the
+ * space up to the end of the ring when a record does not fit there.
+ */
+#define SPILL_PAD 0xffffffffU
+
+typedef struct _jack_midi_spill {
+	struct _jack_midi_spill *next;
+	struct _jack_midi_spill *retired_next;
+	jack_port_t *port;
+	const jack_client_t *client;
+	jack_midi_data_t *ring;
+	uint32_t size;                  /* bytes, a power of two */
+	uint32_t head;                  /* read position, not wrapped */
+	uint32_t tail;                  /* write position, not wrapped */
+	volatile uint32_t depth;        /* events waiting */
+	volatile uint32_t max_depth;
+	jack_nframes_t last_time;       /* of this cycle's last spilled event */
+} jack_midi_spill_t;
+
+/* every spill of this process, and the ones that were replaced or
+   turned off, which a process thread may still be looking at until
+   their client closes */
+static jack_midi_spill_t *jack_midi_spills = NULL;
+static jack_midi_spill_t *jack_midi_spills_retired = NULL;
+static pthread_mutex_t jack_midi_spill_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the spill of each port, by port id. A buffer's spill_port says
+   which entry to look at, so that finding it takes no search. Made
+   with the first spill and kept until the process exits */
+static jack_midi_spill_t **jack_midi_spill_ports = NULL;
+static uint32_t jack_midi_spill_nports = 0;
+
 size_t
 jack_midi_internal_event_size ()
 {
@@ -79,6 +120,7 @@ jack_midi_buffer_init (void  *port_buffer,
 	info->event_count = 0;
 	info->last_write_loc = 0;
 	info->events_lost = 0;
+	info->spill_port = 0;
 }
 
 
@@ -118,6 +160,75 @@ jack_midi_event_get (jack_midi_event_t *event,
 }
 
 
+/* Events are kept in time order, so the first one at or after `time'
+ * can be found by bisection. Returns the event count if there is none.
+ */
+uint32_t
+jack_midi_event_index_at (void           *port_buffer,
+			  jack_nframes_t time)
+{
+	jack_midi_port_info_private_t *info =
+		(jack_midi_port_info_private_t*)port_buffer;
+	jack_midi_port_internal_event_t *events =
+		(jack_midi_port_internal_event_t*)(info + 1);
+	uint32_t lo = 0;
+	uint32_t hi = info->event_count;
+	uint32_t mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (events[mid].time < time) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+
+int
+jack_midi_event_get_at (jack_midi_event_t *event,
+			void              *port_buffer,
+			jack_nframes_t time)
+{
+	return jack_midi_event_get (event, port_buffer,
+				    jack_midi_event_index_at (port_buffer, time));
+}
+
+
+/* Walk the events in [start, end) of a buffer. The events handed back
+ * point into the buffer, as with jack_midi_event_get().
+ */
+void
+jack_midi_iter_init (jack_midi_iter_t *iter,
+		     void             *port_buffer,
+		     jack_nframes_t start,
+		     jack_nframes_t end)
+{
+	iter->port_buffer = port_buffer;
+	iter->index = jack_midi_event_index_at (port_buffer, start);
+	iter->end = (end > start)
+		    ? jack_midi_event_index_at (port_buffer, end) : iter->index;
+}
+
+
+int
+jack_midi_iter_next (jack_midi_iter_t  *iter,
+		     jack_midi_event_t *event)
+{
+	if (iter->index >= iter->end)
+#ifdef ENODATA
+	{ return ENODATA; }
+#else
+	{ return ENOMSG; }
+#endif
+
+	return jack_midi_event_get (event, iter->port_buffer, iter->index++);
+}
+
+
 size_t
 jack_midi_max_event_size (void           *port_buffer)
 {
@@ -127,9 +238,10 @@ jack_midi_max_event_size (void           *port_buffer)
 		info->buffer_size;
 
 	/* (event_count + 1) below accounts for jack_midi_port_internal_event_t
-	 * which would be needed to store the next event */
+	 * which would be needed to store the next event, and the 1 for the
+	 * last byte of the buffer, which the event data never reaches */
 	size_t used_size = sizeof(jack_midi_port_info_private_t)
-			   + info->last_write_loc
+			   + info->last_write_loc + 1
 			   + ((info->event_count + 1)
 			      * sizeof(jack_midi_port_internal_event_t));
 
@@ -143,10 +255,10 @@ jack_midi_max_event_size (void           *port_buffer)
 }
 
 
-jack_midi_data_t*
-jack_midi_event_reserve (void           *port_buffer,
-			 jack_nframes_t time,
-			 size_t data_size)
+static jack_midi_data_t*
+jack_midi_buffer_reserve (void           *port_buffer,
+			  jack_nframes_t time,
+			  size_t data_size)
 {
 	jack_midi_data_t *retbuf = (jack_midi_data_t*)port_buffer;
 
@@ -158,18 +270,18 @@ jack_midi_event_reserve (void           *port_buffer,
 		info->buffer_size;
 
 	if (time < 0 || time >= info->nframes) {
-		goto failed;
+		return NULL;
 	}
 
 	if (info->event_count > 0 && time < event_buffer[info->event_count - 1].time) {
-		goto failed;
+		return NULL;
 	}
 
 	/* Check if data_size is >0 and there is enough space in the buffer for the event. */
 	if (data_size <= 0) {
-		goto failed; // return NULL?
+		return NULL; // return NULL?
 	} else if (jack_midi_max_event_size (port_buffer) < data_size) {
-		goto failed;
+		return NULL;
 	} else {
 		jack_midi_port_internal_event_t *event = &event_buffer[info->event_count];
 
@@ -186,6 +298,175 @@ jack_midi_event_reserve (void           *port_buffer,
 		info->event_count += 1;
 		return retbuf;
 	}
+}
+
+
+static inline void*
+jack_midi_spill_buffer (jack_midi_spill_t *sp)
+{
+	jack_port_t *port = sp->port;
+
+	return (port->shared->flags & JackPortIsOutput)
+	       ? jack_output_port_buffer (port) : port->mix_buffer;
+}
+
+/* Mark the buffer of one of our MIDI ports as the port's, for
+ * jack_midi_spill_find(). Called whenever a client gets at the buffer,
+ * which may have moved or come from another port since it was last
+ * marked.
+ */
+void
+jack_midi_spill_mark (jack_port_t *port, void *port_buffer)
+{
+	if (jack_midi_spill_ports) {
+		((jack_midi_port_info_private_t*)port_buffer)->spill_port =
+			port->shared->id + 1;
+	}
+}
+
+static jack_midi_spill_t *
+jack_midi_spill_find (void *port_buffer)
+{
+	uint32_t id = ((jack_midi_port_info_private_t*)port_buffer)->spill_port;
+	jack_midi_spill_t *sp;
+
+	if (id == 0) {
+		return NULL;
+	}
+
+	/* the mark may have been left by a port that had the buffer
+	   before, so check that it is still that port's */
+	if (id <= jack_midi_spill_nports) {
+		sp = __atomic_load_n (&jack_midi_spill_ports[id - 1],
+				      __ATOMIC_ACQUIRE);
+		if (sp == NULL || jack_midi_spill_buffer (sp) == port_buffer) {
+			return sp;
+		}
+	}
+
+	/* a port of another server this process is a client of, with
+	   the same id or more ports; rare enough to look through them
+	   all */
+	for (sp = __atomic_load_n (&jack_midi_spills, __ATOMIC_ACQUIRE);
+	     sp; sp = sp->next) {
+		if (jack_midi_spill_buffer (sp) == port_buffer) {
+			return sp;
+		}
+	}
+
+	return NULL;
+}
+
+
+static jack_midi_data_t*
+jack_midi_spill_reserve (jack_midi_spill_t *sp, size_t data_size)
+{
+	uint32_t need = 4 + ((data_size + 3) & ~3U);
+	uint32_t pos = sp->tail & (sp->size - 1);
+	uint32_t room = sp->size - pos;
+	uint32_t used = sp->tail - sp->head;
+
+	if (need > room) {
+		/* no room before the end of the ring: pad, and start
+		   again at the beginning */
+		if (used + room + need > sp->size) {
+			return NULL;
+		}
+		*(uint32_t*)(sp->ring + pos) = SPILL_PAD;
+		sp->tail += room;
+		pos = 0;
+	} else if (used + need > sp->size) {
+		return NULL;
+	}
+
+	*(uint32_t*)(sp->ring + pos) = data_size;
+	sp->tail += need;
+
+	__atomic_store_n (&sp->depth, sp->depth + 1, __ATOMIC_RELAXED);
+	if (sp->depth > sp->max_depth) {
+		__atomic_store_n (&sp->max_depth, sp->depth, __ATOMIC_RELAXED);
+	}
+
+	return sp->ring + pos + 4;
+}
+
+
+/* Move as many spilled events as fit into a freshly cleared buffer.
+ * They belong to earlier cycles, so they all go at frame 0.
+ */
+static void
+jack_midi_spill_drain (jack_midi_spill_t *sp, void *port_buffer)
+{
+	jack_midi_data_t *dst;
+	uint32_t pos, size;
+
+	while (sp->head != sp->tail) {
+		pos = sp->head & (sp->size - 1);
+		size = *(uint32_t*)(sp->ring + pos);
+
+		if (size == SPILL_PAD) {
+			sp->head += sp->size - pos;
+			continue;
+		}
+
+		if ((dst = jack_midi_buffer_reserve (port_buffer, 0, size)) == NULL) {
+			break;
+		}
+
+		memcpy (dst, sp->ring + pos + 4, size);
+		sp->head += 4 + ((size + 3) & ~3U);
+		__atomic_store_n (&sp->depth, sp->depth - 1, __ATOMIC_RELAXED);
+	}
+}
+
+
+/* An event goes to the port's spill, if it has one, when it does not
+ * fit in the buffer, and also while older events are still waiting
+ * there, so that events keep their order. It has to be one that would
+ * fit in an empty buffer, and it must not be earlier than the events
+ * written before it this cycle: that is an error, spill or not.
+ */
+jack_midi_data_t*
+jack_midi_event_reserve (void           *port_buffer,
+			 jack_nframes_t time,
+			 size_t data_size)
+{
+	jack_midi_port_info_private_t *info =
+		(jack_midi_port_info_private_t*)port_buffer;
+	jack_midi_port_internal_event_t *events =
+		(jack_midi_port_internal_event_t*)(info + 1);
+	jack_midi_spill_t *sp = NULL;
+	jack_midi_data_t *retbuf;
+
+	if (jack_midi_spills) {
+		sp = jack_midi_spill_find (port_buffer);
+	}
+
+	if (sp == NULL || sp->depth == 0) {
+		if ((retbuf = jack_midi_buffer_reserve (port_buffer, time,
+							data_size)) != NULL) {
+			return retbuf;
+		}
+		if (sp == NULL) {
+			goto failed;
+		}
+	}
+
+	if (time >= info->nframes || data_size == 0
+	    || (info->event_count > 0
+		&& time < events[info->event_count - 1].time)
+	    || (sp->depth > 0 && time < sp->last_time)
+	    || sizeof(jack_midi_port_info_private_t)
+	    + sizeof(jack_midi_port_internal_event_t) + data_size
+	    >= info->buffer_size) {
+		goto failed;
+	}
+
+	if ((retbuf = jack_midi_spill_reserve (sp, data_size)) != NULL) {
+		sp->last_time = time;
+		return retbuf;
+	}
+
 failed:
 	info->events_lost++;
 	return NULL;
@@ -224,97 +505,135 @@ jack_midi_clear_buffer (void           *port_buffer)
 	info->event_count = 0;
 	info->last_write_loc = 0;
 	info->events_lost = 0;
+
+	if (jack_midi_spills) {
+		jack_midi_spill_t *sp = jack_midi_spill_find (port_buffer);
+		if (sp) {
+			jack_midi_spill_drain (sp, port_buffer);
+			sp->last_time = 0;
+		}
+	}
 }
 
 
+/* One input of a MIDI mixdown, and the next event to take from it.
+ * Inputs are ordered on the time of that event, then on their place in
+ * the port's connection list, so that events with the same time come
+ * out in connection order. key holds both.
+ */
+typedef struct {
+	uint64_t key;
+	jack_midi_port_info_private_t   *info;
+	jack_midi_port_internal_event_t *events;
+	uint32_t next;
+} jack_midi_merge_input_t;
+
+#define MERGE_KEY(time, order) (((uint64_t)(time) << 32) | (order))
+
+static void
+jack_midi_merge_sift_down (jack_midi_merge_input_t *heap, uint32_t n,
+			   uint32_t i)
+{
+	jack_midi_merge_input_t top = heap[i];
+	uint32_t c;
+
+	while ((c = 2 * i + 1) < n) {
+		if (c + 1 < n && heap[c + 1].key < heap[c].key) {
+			c++;
+		}
+		if (top.key <= heap[c].key) {
+			break;
+		}
+		heap[i] = heap[c];
+		i = c;
+	}
+
+	heap[i] = top;
+}
+
 /* jack_midi_port_functions.mixdown */
 static void
 jack_midi_port_mixdown (jack_port_t    *port, jack_nframes_t nframes)
 {
 	JSList         *node;
-	jack_port_t    *input;
 	jack_nframes_t num_events = 0;
 	jack_nframes_t i          = 0;
 	int err        = 0;
 	jack_nframes_t lost_events = 0;
+	uint32_t n = 0;
+	uint32_t order = 0;
 
-	/* The next (single) event to mix in to the buffer */
-	jack_midi_port_info_private_t   *earliest_info;
-	jack_midi_port_internal_event_t *earliest_event;
-	jack_midi_data_t                *earliest_buffer;
-
-	jack_midi_port_info_private_t   *in_info;       /* For finding next event */
-	jack_midi_port_internal_event_t *in_events;     /* Corresponds to in_info */
+	jack_midi_port_info_private_t   *in_info;
+	jack_midi_port_internal_event_t *event;
 	jack_midi_port_info_private_t   *out_info;      /* Output 'buffer' */
+	jack_midi_merge_input_t         *top;
+
+	/* a min-heap of the inputs that still have events to give */
+	jack_midi_merge_input_t heap[jack_slist_length (port->connections) + 1];
+	uint32_t cycle = port->client->engine->process_cycle;
+
+	/* clearing the buffer drains the spill, so a second call in a
+	   cycle would deliver everything twice */
+	if (port->mix_cycle == cycle) {
+		return;
+	}
+	port->mix_cycle = cycle;
 
+	jack_midi_spill_mark (port, port->mix_buffer);
 	jack_midi_clear_buffer (port->mix_buffer);
 
 	out_info = (jack_midi_port_info_private_t*)port->mix_buffer;
 
-	/* This function uses jack_midi_port_info_private_t.last_write_loc of the
-	 * source ports to store indices of the last event read from that buffer
-	 * so far.  This is OK because last_write_loc is used when writing events
-	 * to a buffer, which at this stage is already complete so the value
-	 * can be safely smashed. */
-
 	/* Iterate through all connections to see how many events we need to mix,
-	 * and initialise their 'last event read' (last_write_loc) to 0 */
+	 * and put each input that has any in the heap */
 	for (node = port->connections; node; node = jack_slist_next (node)) {
-		input = (jack_port_t*)node->data;
-		in_info =
-			(jack_midi_port_info_private_t*)jack_output_port_buffer (input);
+		in_info = (jack_midi_port_info_private_t*)
+			  jack_output_port_buffer (((jack_port_t*)node->data));
 		num_events += in_info->event_count;
 		lost_events += in_info->events_lost;
-		in_info->last_write_loc = 0;
+		if (in_info->event_count) {
+			heap[n].info = in_info;
+			heap[n].events = (jack_midi_port_internal_event_t*)(in_info + 1);
+			heap[n].next = 0;
+			heap[n].key = MERGE_KEY (heap[n].events[0].time, order);
+			n++;
+		}
+		order++;
+	}
+
+	for (i = n / 2; i-- > 0; ) {
+		jack_midi_merge_sift_down (heap, n, i);
 	}
 
 	/* Write the events in the order of their timestamps */
-	for (i = 0; i < num_events; ++i) {
-		earliest_info = NULL;
-		earliest_event = NULL;
-		earliest_buffer = NULL;
-
-		/* Find the earliest unread event, to mix next
-		 * (search for an event earlier than earliest_event) */
-		for (node = port->connections; node; node = jack_slist_next (node)) {
-			in_info = (jack_midi_port_info_private_t*)
-				  jack_output_port_buffer (((jack_port_t*)node->data));
-			in_events = (jack_midi_port_internal_event_t*)(in_info + 1);
-
-			/* If there are unread events left in this port.. */
-			if (in_info->event_count > in_info->last_write_loc) {
-				/* .. and this event is the new earliest .. */
-				/* NOTE: that's why we compare time with <, not <= */
-				if (earliest_info == NULL
-				    || in_events[in_info->last_write_loc].time
-				    < earliest_event->time) {
-					/* .. then set this event as the next earliest */
-					earliest_info = in_info;
-					earliest_event = (jack_midi_port_internal_event_t*)
-							 (&in_events[in_info->last_write_loc]);
-				}
-			}
+	for (i = 0; n > 0; ++i) {
+		top = &heap[0];
+		event = &top->events[top->next];
+
+		err = jack_midi_event_write (
+			jack_port_buffer (port),
+			event->time,
+			jack_midi_event_data (top->info, event),
+			event->size);
+
+		if (err) {
+			out_info->events_lost = num_events - i;
+			break;
 		}
 
-		if (earliest_info && earliest_event) {
-			earliest_buffer = (jack_midi_data_t*)earliest_info;
-
-			/* Write event to output */
-			err = jack_midi_event_write (
-				jack_port_buffer (port),
-				earliest_event->time,
-				jack_midi_event_data (earliest_buffer, earliest_event),
-				earliest_event->size);
-
-			earliest_info->last_write_loc++;
-
-			if (err) {
-				out_info->events_lost = num_events - i;
-				break;
-			}
+		if (++top->next == top->info->event_count) {
+			heap[0] = heap[--n];
+		} else {
+			top->key = MERGE_KEY (top->events[top->next].time,
+					      (uint32_t)top->key);
+		}
+		if (n > 1) {
+			jack_midi_merge_sift_down (heap, n, 0);
 		}
 	}
-	assert (out_info->event_count == num_events - out_info->events_lost);
+	/* the count is off by whatever went to or came from a spill */
+	assert (jack_midi_spills
+		|| out_info->event_count == num_events - out_info->events_lost);
 
 	// inherit total lost events count from all connected ports.
 	out_info->events_lost += lost_events;
@@ -327,6 +646,186 @@ jack_midi_get_lost_event_count (void           *port_buffer)
 	return ((jack_midi_port_info_private_t*)port_buffer)->events_lost;
 }
 
+
+/* Point the table entry for port `id' at a spill of a port with that
+ * id, if any is left. Called with jack_midi_spill_lock held.
+ */
+static void
+jack_midi_spill_index (jack_port_id_t id)
+{
+	jack_midi_spill_t *sp;
+
+	if (id >= jack_midi_spill_nports) {
+		return;
+	}
+
+	for (sp = jack_midi_spills; sp; sp = sp->next) {
+		if (sp->port->shared->id == id) {
+			break;
+		}
+	}
+
+	__atomic_store_n (&jack_midi_spill_ports[id], sp, __ATOMIC_RELEASE);
+}
+
+
+/* Keep events that do not fit in this port's buffer, up to `bytes' of
+ * them, and hand them on in the next cycle instead of dropping them.
+ * For an output port that covers the client's own writes; for an
+ * input port, the mixdown of its connections. 0 turns it off, and
+ * throws away anything still waiting.
+ */
+int
+jack_midi_port_set_spill (jack_port_t *port, size_t bytes)
+{
+	jack_midi_spill_t *sp, *old, **prev;
+	uint32_t size = 256;
+
+	if (port->shared->ptype_id != JACK_MIDI_PORT_TYPE) {
+		jack_error ("%s is not a MIDI port", port->shared->name);
+		return -1;
+	}
+
+	if (jack_uuid_compare (port->shared->client_id,
+			       port->client->control->uuid) != 0) {
+		jack_error ("cannot set the spill of %s, which belongs to"
+			    " another client", port->shared->name);
+		return -1;
+	}
+
+	if (bytes > 0x40000000) {
+		jack_error ("MIDI spill of %zu bytes is too big", bytes);
+		return -1;
+	}
+
+	sp = NULL;
+
+	if (bytes) {
+		while (size < bytes) {
+			size <<= 1;
+		}
+		if ((sp = (jack_midi_spill_t*)calloc (1, sizeof(*sp))) == NULL
+		    || (sp->ring = (jack_midi_data_t*)malloc (size)) == NULL) {
+			jack_error ("cannot allocate MIDI spill for %s",
+				    port->shared->name);
+			free (sp);
+			return -1;
+		}
+		sp->port = port;
+		sp->client = port->client;
+		sp->size = size;
+	}
+
+	pthread_mutex_lock (&jack_midi_spill_lock);
+
+	if (sp && jack_midi_spill_ports == NULL) {
+		jack_midi_spill_nports = port->client->engine->port_max;
+		if ((jack_midi_spill_ports = (jack_midi_spill_t**)
+		     calloc (jack_midi_spill_nports, sizeof(*jack_midi_spill_ports)))
+		    == NULL) {
+			jack_midi_spill_nports = 0;
+			pthread_mutex_unlock (&jack_midi_spill_lock);
+			jack_error ("cannot allocate MIDI spill table");
+			free (sp->ring);
+			free (sp);
+			return -1;
+		}
+	}
+
+	for (prev = &jack_midi_spills; (old = *prev) != NULL; prev = &old->next) {
+		if (old->port == port) {
+			/* leave old->next alone for a reader standing
+			   on it */
+			__atomic_store_n (prev, old->next, __ATOMIC_RELEASE);
+			break;
+		}
+	}
+
+	if (sp) {
+		sp->next = jack_midi_spills;
+		__atomic_store_n (&jack_midi_spills, sp, __ATOMIC_RELEASE);
+	}
+
+	jack_midi_spill_index (port->shared->id);
+
+	if (sp && (port->shared->flags & JackPortIsOutput)) {
+		jack_midi_spill_mark (port, jack_output_port_buffer (port));
+	}
+
+	if (old) {
+		old->retired_next = jack_midi_spills_retired;
+		jack_midi_spills_retired = old;
+	}
+
+	pthread_mutex_unlock (&jack_midi_spill_lock);
+
+	return 0;
+}
+
+
+int
+jack_midi_port_get_spill_depth (jack_port_t *port, uint32_t *depth,
+				uint32_t *max_depth)
+{
+	jack_midi_spill_t *sp;
+
+	pthread_mutex_lock (&jack_midi_spill_lock);
+
+	for (sp = jack_midi_spills; sp; sp = sp->next) {
+		if (sp->port == port) {
+			break;
+		}
+	}
+
+	if (sp) {
+		if (depth) {
+			*depth = sp->depth;
+		}
+		if (max_depth) {
+			*max_depth = sp->max_depth;
+		}
+	}
+
+	pthread_mutex_unlock (&jack_midi_spill_lock);
+
+	return sp ? 0 : -1;
+}
+
+
+/* Free the spills of a client that is closing, whose process thread
+ * has stopped.
+ */
+void
+jack_midi_free_spills (const jack_client_t *client)
+{
+	jack_midi_spill_t *sp, **prev;
+
+	pthread_mutex_lock (&jack_midi_spill_lock);
+
+	for (prev = &jack_midi_spills; (sp = *prev) != NULL; ) {
+		if (sp->client == client) {
+			*prev = sp->next;
+			sp->retired_next = jack_midi_spills_retired;
+			jack_midi_spills_retired = sp;
+			jack_midi_spill_index (sp->port->shared->id);
+		} else {
+			prev = &sp->next;
+		}
+	}
+
+	for (prev = &jack_midi_spills_retired; (sp = *prev) != NULL; ) {
+		if (sp->client == client) {
+			*prev = sp->retired_next;
+			free (sp->ring);
+			free (sp);
+		} else {
+			prev = &sp->retired_next;
+		}
+	}
+
+	pthread_mutex_unlock (&jack_midi_spill_lock);
+}
+
 jack_port_functions_t jack_builtin_midi_functions = {
 	.buffer_init	= jack_midi_buffer_init,
 	.mixdown	= jack_midi_port_mixdown,
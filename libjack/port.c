@@ -37,6 +37,7 @@
 #include "pool.h"
 #include "port.h"
 #include "intsimd.h"
+#include "portindex.h"
 
 #include "local.h"
 
@@ -46,6 +47,13 @@ static void    jack_generic_buffer_init(void *port_buffer,
 
 static void    jack_audio_port_mixdown(jack_port_t *port,
 				       jack_nframes_t nframes);
+static void    jack_audio_port_mix_into(jack_port_t *port,
+					jack_default_audio_sample_t *buffer,
+					jack_nframes_t nframes);
+static int     jack_port_sources_silent(jack_port_t *port);
+
+static void   *jack_audio_port_shared_mixdown(jack_port_t *port,
+					      jack_nframes_t nframes);
 
 /* These function pointers are local to each address space.  For
  * internal clients they reside within jackd; for external clients in
@@ -76,16 +84,15 @@ jack_port_type_info_t jack_builtin_port_types[] = {
 
 #ifdef USE_DYNSIMD
 
-static void (*opt_copy)(float *, const float *, int);
-static void (*opt_mix)(float *, const float *, int);
+jack_simd_funcs_t jack_simd_funcs;
 
-static void
+void
 gen_copyf (float *dest, const float *src, int length)
 {
 	memcpy (dest, src, length * sizeof(float));
 }
 
-static void
+void
 gen_mixf (float *dest, const float *src, int length)
 {
 	int n;
@@ -97,19 +104,94 @@ gen_mixf (float *dest, const float *src, int length)
 	        fpDest[iSample] += fpSrc[iSample];*/
 }
 
+/* the reference for the vector conversions: clamp to [-1, 1] (a NaN
+   becomes -1), scale, round to nearest */
+void
+gen_f2i (int *dest, const float *src, int length, float scale)
+{
+	float f;
+
+	while (length--) {
+		f = *src++;
+		if (!(f >= -1.0F)) {
+			f = -1.0F;
+		} else if (f > 1.0F) {
+			f = 1.0F;
+		}
+		f *= scale;
+		*dest++ = (int)lrintf (f);
+	}
+}
+
+void
+gen_i2f (float *dest, const int *src, int length, float scale)
+{
+	while (length--)
+		*dest++ = (float)*src++ * scale;
+}
+
 #ifdef ARCH_X86
 
 void jack_port_set_funcs ()
 {
-	if (ARCH_X86_HAVE_SSE2 (cpu_type)) {
-		opt_copy = x86_sse_copyf;
-		opt_mix = x86_sse_add2f;
+	if (ARCH_X86_HAVE_AVX512 (cpu_type)) {
+		jack_simd_funcs.copyf = x86_avx512_copyf;
+		jack_simd_funcs.add2f = x86_avx512_add2f;
+		jack_simd_funcs.f2i = x86_avx512_f2i;
+		jack_simd_funcs.i2f = x86_avx512_i2f;
+		jack_simd_funcs.mixnf = x86_avx512_mixnf;
+		jack_simd_funcs.scalef = x86_avx512_scalef;
+	} else if (ARCH_X86_HAVE_AVX2 (cpu_type)) {
+		jack_simd_funcs.copyf = x86_avx2_copyf;
+		jack_simd_funcs.add2f = x86_avx2_add2f;
+		jack_simd_funcs.f2i = x86_avx2_f2i;
+		jack_simd_funcs.i2f = x86_avx2_i2f;
+		jack_simd_funcs.mixnf = x86_avx2_mixnf;
+		jack_simd_funcs.scalef = x86_avx2_scalef;
+	} else if (ARCH_X86_HAVE_SSE2 (cpu_type)) {
+		/* x86_sse_f2i() and x86_sse_i2f() need aligned
+		   buffers and a multiple of 4 samples */
+		jack_simd_funcs.copyf = x86_sse_copyf;
+		jack_simd_funcs.add2f = x86_sse_add2f;
+		jack_simd_funcs.f2i = gen_f2i;
+		jack_simd_funcs.i2f = gen_i2f;
+		jack_simd_funcs.mixnf = x86_sse_mixnf;
+		jack_simd_funcs.scalef = x86_sse_scalef;
 	} else if (ARCH_X86_HAVE_3DNOW (cpu_type)) {
-		opt_copy = x86_3dnow_copyf;
-		opt_mix = x86_3dnow_add2f;
+		jack_simd_funcs.copyf = x86_3dnow_copyf;
+		jack_simd_funcs.add2f = x86_3dnow_add2f;
+		jack_simd_funcs.f2i = gen_f2i;
+		jack_simd_funcs.i2f = gen_i2f;
+		jack_simd_funcs.mixnf = gen_mixnf;
+		jack_simd_funcs.scalef = gen_scalef;
 	} else {
-		opt_copy = gen_copyf;
-		opt_mix = gen_mixf;
+		jack_simd_funcs.copyf = gen_copyf;
+		jack_simd_funcs.add2f = gen_mixf;
+		jack_simd_funcs.f2i = gen_f2i;
+		jack_simd_funcs.i2f = gen_i2f;
+		jack_simd_funcs.mixnf = gen_mixnf;
+		jack_simd_funcs.scalef = gen_scalef;
+	}
+}
+
+#elif defined(ARCH_ARM64)
+
+void jack_port_set_funcs ()
+{
+	if (cpu_type) {
+		jack_simd_funcs.copyf = arm64_neon_copyf;
+		jack_simd_funcs.add2f = arm64_neon_add2f;
+		jack_simd_funcs.f2i = arm64_neon_f2i;
+		jack_simd_funcs.i2f = arm64_neon_i2f;
+		jack_simd_funcs.mixnf = arm64_neon_mixnf;
+		jack_simd_funcs.scalef = arm64_neon_scalef;
+	} else {
+		jack_simd_funcs.copyf = gen_copyf;
+		jack_simd_funcs.add2f = gen_mixf;
+		jack_simd_funcs.f2i = gen_f2i;
+		jack_simd_funcs.i2f = gen_i2f;
+		jack_simd_funcs.mixnf = gen_mixnf;
+		jack_simd_funcs.scalef = gen_scalef;
 	}
 }
 
@@ -117,8 +199,12 @@ void jack_port_set_funcs ()
 
 void jack_port_set_funcs ()
 {
-	opt_copy = gen_copyf;
-	opt_mix = gen_mixf;
+	jack_simd_funcs.copyf = gen_copyf;
+	jack_simd_funcs.add2f = gen_mixf;
+	jack_simd_funcs.f2i = gen_f2i;
+	jack_simd_funcs.i2f = gen_i2f;
+	jack_simd_funcs.mixnf = gen_mixnf;
+	jack_simd_funcs.scalef = gen_scalef;
 }
 
 #endif  /* ARCH_X86 */
@@ -190,6 +276,9 @@ jack_port_new (const jack_client_t *client, jack_port_id_t port_id,
 	pthread_mutex_init (&port->connection_lock, NULL);
 	port->connections = 0;
 	port->tied = NULL;
+	port->client = client;
+	port->gain_slot = -1;
+	port->mix_cycle = 0;
 
 	if (jack_uuid_compare (client->control->uuid, port->shared->client_id) == 0) {
 
@@ -218,6 +307,16 @@ jack_port_new (const jack_client_t *client, jack_port_id_t port_id,
 	return port;
 }
 
+/* Free a port made by jack_port_new() that has no connections or mix
+ * buffer of its own, such as the far end of a connection.
+ */
+void
+jack_port_free (jack_port_t *port)
+{
+	pthread_mutex_destroy (&port->connection_lock);
+	free (port);
+}
+
 size_t
 jack_port_type_get_buffer_size (jack_client_t *client, const char *port_type)
 {
@@ -235,12 +334,12 @@ jack_port_type_get_buffer_size (jack_client_t *client, const char *port_type)
 	return jack_port_type_buffer_size (&(client->engine->port_types[i]), client->engine->buffer_size);
 }
 
-jack_port_t *
-jack_port_register (jack_client_t *client,
-		    const char *port_name,
-		    const char *port_type,
-		    unsigned long flags,
-		    unsigned long buffer_size)
+static jack_port_t *
+jack_port_request_register (jack_client_t *client,
+			    const char *port_name,
+			    const char *port_type,
+			    unsigned long flags,
+			    unsigned long buffer_size)
 {
 	jack_request_t req;
 	jack_port_t *port = 0;
@@ -288,11 +387,44 @@ jack_port_register (jack_client_t *client,
 	return port;
 }
 
+jack_port_t *
+jack_port_register (jack_client_t *client,
+		    const char *port_name,
+		    const char *port_type,
+		    unsigned long flags,
+		    unsigned long buffer_size)
+{
+	return jack_port_request_register (client, port_name, port_type,
+					   flags & ~JACK_PORT_REQUEST_CAPACITY,
+					   buffer_size);
+}
+
+/* Register a MIDI port whose buffer holds at least `capacity' bytes,
+ * rather than the server's MIDI buffer size. 0 gives the usual size;
+ * more than the largest buffer the server has fails.
+ */
+jack_port_t *
+jack_midi_port_register (jack_client_t *client,
+			 const char *port_name,
+			 unsigned long flags,
+			 size_t capacity)
+{
+	return jack_port_request_register (client, port_name,
+					   JACK_DEFAULT_MIDI_TYPE,
+					   flags | JACK_PORT_REQUEST_CAPACITY,
+					   capacity);
+}
+
 int
 jack_port_unregister (jack_client_t *client, jack_port_t *port)
 {
 	jack_request_t req;
 
+	/* its buffer may go to another port */
+	if (port->shared->ptype_id == JACK_MIDI_PORT_TYPE) {
+		jack_midi_port_set_spill (port, 0);
+	}
+
 	VALGRIND_MEMSET (&req, 0, sizeof(req));
 
 
@@ -500,6 +632,15 @@ jack_port_by_name_int (jack_client_t *client, const char *port_name, int* free)
 
 	unsigned long i, limit;
 	jack_port_shared_t *port;
+	jack_port_id_t id;
+
+	switch (jack_port_index_lookup (client->engine, port_name, &id)) {
+	case 1:
+		*free = TRUE;
+		return jack_port_new (client, id, client->engine);
+	case 0:
+		return NULL;
+	}
 
 	limit = client->engine->port_max;
 	port = &client->engine->ports[0];
@@ -574,6 +715,7 @@ void *
 jack_port_get_buffer (jack_port_t *port, jack_nframes_t nframes)
 {
 	JSList *node, *next;
+	void *buffer;
 
 	/* Output port.  The buffer was assigned by the engine
 	   when the port was registered.
@@ -587,7 +729,13 @@ jack_port_get_buffer (jack_port_t *port, jack_nframes_t nframes)
 			return NULL;
 		}
 
-		return jack_output_port_buffer (port);
+		buffer = jack_output_port_buffer (port);
+
+		if (port->shared->ptype_id == JACK_MIDI_PORT_TYPE) {
+			jack_midi_spill_mark (port, buffer);
+		}
+
+		return buffer;
 	}
 
 	/* Input port.  Since this can only be called from the
@@ -608,10 +756,18 @@ jack_port_get_buffer (jack_port_t *port, jack_nframes_t nframes)
 	if ((next = jack_slist_next (node)) == NULL) {
 
 		/* one connection: use zero-copy mode - just pass
-		   the buffer of the connected (output) port.
+		   the buffer of the connected (output) port, unless
+		   the connection has a gain to apply.
 		 */
-		return jack_port_get_buffer (((jack_port_t*)node->data),
-					     nframes);
+		if (__atomic_load_n (&((jack_port_t*)node->data)->gain_slot,
+				     __ATOMIC_ACQUIRE) < 0
+		    || port->mix_buffer == NULL) {
+			return jack_port_get_buffer (((jack_port_t*)node->data),
+						     nframes);
+		}
+
+		jack_audio_port_mix_into (port, port->mix_buffer, nframes);
+		return (void*)port->mix_buffer;
 	}
 
 	/* Multiple connections.  Use a local buffer and mix the
@@ -623,10 +779,65 @@ jack_port_get_buffer (jack_port_t *port, jack_nframes_t nframes)
 		jack_error ( "internal jack error: mix_buffer not allocated" );
 		return NULL;
 	}
+	if ((buffer = jack_audio_port_shared_mixdown (port, nframes)) != NULL) {
+		return buffer;
+	}
 	port->fptr.mixdown (port, nframes);
 	return (void*)port->mix_buffer;
 }
 
+/* Fill the buffer of one of our output ports with silence and say so,
+ * for this cycle, to whoever reads it. Call it from the process
+ * callback instead of writing the buffer.
+ */
+int
+jack_port_set_silent (jack_port_t *port, jack_nframes_t nframes)
+{
+	void *buffer;
+
+	if (!(port->shared->flags & JackPortIsOutput) || port->tied) {
+		jack_error ("cannot mark port %s silent: not an output, or tied",
+			    port->shared->name);
+		return -1;
+	}
+
+	if ((buffer = jack_port_get_buffer (port, nframes)) == NULL) {
+		return -1;
+	}
+
+	port->fptr.buffer_init (buffer, jack_port_buffer_size (port, nframes),
+				nframes);
+
+	__atomic_store_n (&port->shared->silent_cycle,
+			  __atomic_load_n (&port->client->engine->process_cycle,
+					   __ATOMIC_ACQUIRE),
+			  __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/* Whether jack_port_get_buffer() gives, or would give, nothing but
+ * silence in this cycle: an unconnected input, an input whose sources
+ * are all silent, or an output that its owner made silent. Only
+ * meaningful in the process callback, and for an output port, once
+ * its owner has run.
+ */
+int
+jack_port_is_silent (jack_port_t *port)
+{
+	if (port->shared->flags & JackPortIsOutput) {
+		if (port->tied) {
+			return jack_port_is_silent (port->tied);
+		}
+		return __atomic_load_n (&port->shared->silent_cycle,
+					__ATOMIC_ACQUIRE)
+		       == __atomic_load_n (&port->client->engine->process_cycle,
+					   __ATOMIC_ACQUIRE);
+	}
+
+	return jack_port_sources_silent (port);
+}
+
 size_t
 jack_port_type_buffer_size (jack_port_type_info_t* port_type_info, jack_nframes_t nframes)
 {
@@ -639,6 +850,19 @@ jack_port_type_buffer_size (jack_port_type_info_t* port_type_info, jack_nframes_
 	       * nframes;
 }
 
+/* The size of this port's buffers, which for a MIDI port may be larger
+ * than the type's if it asked for that when registering.
+ */
+size_t
+jack_port_buffer_size (jack_port_t *port, jack_nframes_t nframes)
+{
+	if (port->shared->buffer_size > 0) {
+		return port->shared->buffer_size;
+	}
+
+	return jack_port_type_buffer_size (port->type_info, nframes);
+}
+
 int
 jack_port_tie (jack_port_t *src, jack_port_t *dst)
 
@@ -836,6 +1060,22 @@ jack_port_rename (jack_client_t* client, jack_port_t *port, const char *new_name
 
 	return ret;
 }
+/* Names and aliases are changed in shared memory by the client, so
+ * tell the server to update its port name index.
+ */
+static void
+jack_port_reindex (jack_port_t *port)
+{
+	jack_request_t req;
+
+	VALGRIND_MEMSET (&req, 0, sizeof(req));
+
+	req.type = ReindexPort;
+	req.x.port_info.port_id = port->shared->id;
+
+	(void)jack_client_deliver_request (port->client, &req);
+}
+
 int
 jack_port_set_name (jack_port_t *port, const char *new_name)
 {
@@ -850,7 +1090,7 @@ jack_port_set_name (jack_port_t *port, const char *new_name)
 	len = sizeof(port->shared->name) -
 	      ((int)(colon - port->shared->name)) - 2;
 	snprintf (colon + 1, len, "%s", new_name);
-
+	jack_port_reindex (port);
 
 	return 0;
 }
@@ -866,6 +1106,8 @@ jack_port_set_alias (jack_port_t *port, const char *alias)
 		return -1;
 	}
 
+	jack_port_reindex (port);
+
 	return 0;
 }
 
@@ -880,6 +1122,8 @@ jack_port_unset_alias (jack_port_t *port, const char *alias)
 		return -1;
 	}
 
+	jack_port_reindex (port);
+
 	return 0;
 }
 
@@ -930,22 +1174,130 @@ static inline float f_max (float x, float a)
 	return x;
 }
 
+/* Sum up to JACK_MIX_FANIN source buffers into dest in one pass, or
+ * add them to what dest already holds if accumulate is set. The
+ * additions happen in source order, so the result is the same as
+ * adding the sources one at a time.
+ */
+void
+gen_mixnf (float *dest, const float **src, int nsrc, int length,
+	   int accumulate)
+{
+	int i, k;
+	float acc;
+
+	for (i = 0; i < length; i++) {
+		if (accumulate) {
+			acc = dest[i];
+			k = 0;
+		} else {
+			acc = src[0][i];
+			k = 1;
+		}
+		for (; k < nsrc; k++) {
+			acc += src[k][i];
+		}
+		dest[i] = acc;
+	}
+}
+
+/* Add src times a gain that moves from g0 by step per sample, or
+ * store it if accumulate is not set. Sample i gets g0 + step * (i + 1),
+ * so that the last one of a ramp gets the target gain. Multiplies and
+ * adds stay unfused, as in the vector versions.
+ */
+__attribute__((optimize ("fp-contract=off"))) void
+gen_scalef (float *dest, const float *src, int length, float g0,
+	    float step, int accumulate)
+{
+	float g;
+	int i;
+
+	for (i = 0; i < length; i++) {
+		g = g0 + step * (float)(i + 1);
+		dest[i] = accumulate ? dest[i] + src[i] * g : src[i] * g;
+	}
+}
+
+/* Mix one input that has a gain set on its connection. A change of
+ * gain or mute since the last cycle is ramped in over this one.
+ */
 static void
-jack_audio_port_mixdown (jack_port_t *port, jack_nframes_t nframes)
+jack_audio_port_mix_gain (jack_port_t *input, int32_t slot,
+			  jack_port_t *port, jack_default_audio_sample_t *buffer,
+			  jack_nframes_t nframes, int accumulate)
 {
+	jack_connection_gain_t *cg =
+		jack_connection_gain (port->client->engine, slot);
+	float target = cg->mute ? 0.0F : cg->gain;
+	float from = cg->applied;
+
+	if (accumulate && target == 0.0F && from == 0.0F) {
+		return;
+	}
+
+#ifndef USE_DYNSIMD
+	gen_scalef (buffer, jack_output_port_buffer (input), nframes, from,
+		    (target - from) / nframes, accumulate);
+#else   /* USE_DYNSIMD */
+	jack_simd_funcs.scalef (buffer, jack_output_port_buffer (input),
+				nframes, from, (target - from) / nframes,
+				accumulate);
+#endif /* USE_DYNSIMD */
+
+	cg->applied = target;
+}
+
+/* Whether `input' gives `port' nothing but silence in this cycle:
+ * its owner said so, or the connection is muted (or at zero gain)
+ * and done ramping down.
+ */
+static int
+jack_port_source_silent (jack_port_t *input, jack_port_t *port,
+			 uint32_t cycle)
+{
+	jack_connection_gain_t *cg;
+	int32_t slot;
+
+	if ((slot = __atomic_load_n (&input->gain_slot, __ATOMIC_ACQUIRE)) >= 0) {
+		cg = jack_connection_gain (port->client->engine, slot);
+		if ((cg->mute || cg->gain == 0.0F) && cg->applied == 0.0F) {
+			return TRUE;
+		}
+	}
+
+	return __atomic_load_n (&input->shared->silent_cycle, __ATOMIC_ACQUIRE)
+	       == cycle;
+}
+
+static int
+jack_port_sources_silent (jack_port_t *port)
+{
+	uint32_t cycle = __atomic_load_n (&port->client->engine->process_cycle,
+					  __ATOMIC_ACQUIRE);
 	JSList *node;
-	jack_port_t *input;
 
-#ifndef ARCH_X86
-	jack_nframes_t n;
-	jack_default_audio_sample_t *dst, *src;
-#endif
-	jack_default_audio_sample_t *buffer;
+	for (node = port->connections; node; node = jack_slist_next (node)) {
+		if (!jack_port_source_silent ((jack_port_t*)node->data, port,
+					      cycle)) {
+			return FALSE;
+		}
+	}
 
-	/* by the time we've called this, we've already established
-	   the existence of more than one connection to this input
-	   port and allocated a mix_buffer.
-	 */
+	return TRUE;
+}
+
+static void
+jack_audio_port_mix_into (jack_port_t *port,
+			  jack_default_audio_sample_t *buffer,
+			  jack_nframes_t nframes)
+{
+	JSList *node;
+	jack_port_t *input;
+	const jack_default_audio_sample_t *src[JACK_MIX_FANIN];
+	int32_t slot;
+	int nsrc = 0;
+	int accumulate = FALSE;
 
 	/* no need to take connection lock, since this is called
 	   from the process() callback, and the jack server
@@ -953,32 +1305,109 @@ jack_audio_port_mixdown (jack_port_t *port, jack_nframes_t nframes)
 	   during this time.
 	 */
 
-	node = port->connections;
-	input = (jack_port_t*)node->data;
-	buffer = port->mix_buffer;
+	if (jack_port_sources_silent (port)) {
+		memset (buffer, 0, sizeof(jack_default_audio_sample_t) * nframes);
+		return;
+	}
 
-#ifndef USE_DYNSIMD
-	memcpy (buffer, jack_output_port_buffer (input),
-		sizeof(jack_default_audio_sample_t) * nframes);
-#else   /* USE_DYNSIMD */
-	opt_copy (buffer, jack_output_port_buffer (input), nframes);
-#endif /* USE_DYNSIMD */
+	/* take the inputs JACK_MIX_FANIN at a time, so that the mix
+	   buffer is written once per group rather than once per
+	   input. inputs with a gain are added on their own as they
+	   come; their slot is read once, since a ConnectionGain event
+	   may change it while we are here. */
 
-	for (node = jack_slist_next (node); node;
-	     node = jack_slist_next (node)) {
+	for (node = port->connections; node; node = jack_slist_next (node)) {
 
 		input = (jack_port_t*)node->data;
 
-#ifndef USE_DYNSIMD
-		n = nframes;
-		dst = buffer;
-		src = jack_output_port_buffer (input);
+		if ((slot = __atomic_load_n (&input->gain_slot,
+					     __ATOMIC_ACQUIRE)) >= 0) {
+			jack_audio_port_mix_gain (input, slot, port, buffer,
+						  nframes, accumulate);
+			accumulate = TRUE;
+			continue;
+		}
 
-		while (n--)
-			*dst++ += *src++;
+		src[nsrc++] = jack_output_port_buffer (input);
 
+		if (nsrc == JACK_MIX_FANIN) {
+#ifndef USE_DYNSIMD
+			gen_mixnf (buffer, src, nsrc, nframes, accumulate);
 #else           /* USE_DYNSIMD */
-		opt_mix (buffer, jack_output_port_buffer (input), nframes);
+			jack_simd_funcs.mixnf (buffer, src, nsrc, nframes,
+					       accumulate);
 #endif /* USE_DYNSIMD */
+			accumulate = TRUE;
+			nsrc = 0;
+		}
+	}
+
+	if (nsrc) {
+#ifndef USE_DYNSIMD
+		gen_mixnf (buffer, src, nsrc, nframes, accumulate);
+#else   /* USE_DYNSIMD */
+		jack_simd_funcs.mixnf (buffer, src, nsrc, nframes, accumulate);
+#endif /* USE_DYNSIMD */
+	}
+}
+
+static void
+jack_audio_port_mixdown (jack_port_t *port, jack_nframes_t nframes)
+{
+	/* by the time we've called this, we've already established
+	   the existence of more than one connection to this input
+	   port and allocated a mix_buffer.
+	 */
+
+	jack_audio_port_mix_into (port, port->mix_buffer, nframes);
+}
+
+/* If the server put this port in a mix group, return the group's
+ * sum for this cycle, working it out first if nobody has yet. Returns
+ * NULL if another client is busy summing, in which case the caller
+ * mixes privately rather than wait.
+ */
+static void *
+jack_audio_port_shared_mixdown (jack_port_t *port, jack_nframes_t nframes)
+{
+	jack_control_t *engine = port->client->engine;
+	jack_port_shared_t *leader;
+	jack_default_audio_sample_t *buffer;
+	int32_t group = port->shared->mix_group;
+	uint32_t cycle, claim;
+
+	if (group < 0 || (uint32_t)group >= engine->port_max
+	    || port->fptr.mixdown != jack_audio_port_mixdown) {
+		return NULL;
 	}
+
+	leader = &engine->ports[group];
+
+	/* the leader was released since the server grouped us */
+	if (!leader->in_use
+	    || __atomic_load_n (&leader->mix_group, __ATOMIC_ACQUIRE) != group) {
+		return NULL;
+	}
+
+	cycle = __atomic_load_n (&engine->process_cycle, __ATOMIC_ACQUIRE);
+	buffer = (jack_default_audio_sample_t*)
+		 (*port->client_segment_base + leader->mix_offset);
+
+	if (__atomic_load_n (&leader->mix_ready, __ATOMIC_ACQUIRE) == cycle) {
+		return buffer;
+	}
+
+	claim = __atomic_load_n (&leader->mix_claim, __ATOMIC_RELAXED);
+
+	if (claim == cycle
+	    || !__atomic_compare_exchange_n (&leader->mix_claim, &claim, cycle,
+					     FALSE, __ATOMIC_ACQUIRE,
+					     __ATOMIC_RELAXED)) {
+		return NULL;
+	}
+
+	jack_audio_port_mix_into (port, buffer, nframes);
+	__atomic_store_n (&leader->mix_ready, cycle, __ATOMIC_RELEASE);
+
+	return buffer;
 }
@@ -0,0 +1,151 @@
+/* -*- mode: c; c-file-style: "bsd"; -*- */
+/*
+    Copyright (C) 2026 the JACK developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+    Measures ringbuffer throughput with one writer and one reader
+    thread, for each kind of ringbuffer, and checks that the data
+    arrives intact.
+
+    usage: ringbench [ chunk-bytes [ megabytes ] ]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include <config.h>
+
+#include <jack/ringbuffer.h>
+
+#include "internal.h"
+
+#define RING_SIZE (64 * 1024)
+
+typedef struct {
+	jack_ringbuffer_t *rb;
+	size_t total;
+	size_t chunk;
+} bench_t;
+
+static double
+now_secs ()
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *
+writer (void *arg)
+{
+	bench_t *b = (bench_t*)arg;
+	char *buf = malloc (b->chunk);
+	size_t sent = 0, n, done, i;
+
+	while (sent < b->total) {
+		n = b->total - sent < b->chunk ? b->total - sent : b->chunk;
+		for (i = 0; i < n; i++) {
+			buf[i] = (char)(sent + i);
+		}
+		for (done = 0; done < n; ) {
+			size_t k = jack_ringbuffer_write (b->rb, buf + done,
+							  n - done);
+			if (k == 0) {
+				sched_yield ();
+			}
+			done += k;
+		}
+		sent += n;
+	}
+
+	free (buf);
+	return NULL;
+}
+
+/* Returns the number of bytes that came out wrong. */
+
+static size_t
+run (const char *name, jack_ringbuffer_t *rb, size_t chunk, size_t total)
+{
+	bench_t b = { rb, total, chunk };
+	char *buf = malloc (chunk);
+	size_t got = 0, bad = 0, k, i;
+	pthread_t thread;
+	double start, secs;
+
+	if (rb == NULL) {
+		printf ("%-10s not available\n", name);
+		free (buf);
+		return 0;
+	}
+
+	start = now_secs ();
+	pthread_create (&thread, NULL, writer, &b);
+
+	while (got < total) {
+		if ((k = jack_ringbuffer_read (rb, buf, chunk)) == 0) {
+			sched_yield ();
+			continue;
+		}
+		for (i = 0; i < k; i++) {
+			if (buf[i] != (char)(got + i)) {
+				bad++;
+			}
+		}
+		got += k;
+	}
+
+	pthread_join (thread, NULL);
+	secs = now_secs () - start;
+
+	printf ("%-10s %8.0f MB/s%s\n", name, total / secs / 1e6,
+		bad ? "  DATA CORRUPTED" : "");
+
+	jack_ringbuffer_free (rb);
+	free (buf);
+	return bad;
+}
+
+int
+main (int argc, char *argv[])
+{
+	size_t chunk = argc > 1 ? (size_t)atol (argv[1]) : 256;
+	size_t total = (argc > 2 ? (size_t)atol (argv[2]) : 256) << 20;
+	size_t bad = 0;
+
+	if (chunk < 1 || chunk >= RING_SIZE || total < 1) {
+		fprintf (stderr, "usage: ringbench [ chunk-bytes (1-%d) "
+			 "[ megabytes ] ]\n", RING_SIZE - 1);
+		return 1;
+	}
+
+	printf ("%zu byte chunks through a %d byte ringbuffer\n", chunk,
+		RING_SIZE);
+
+	bad += run ("classic", jack_ringbuffer_create (RING_SIZE),
+		    chunk, total);
+	bad += run ("padded", jack_ringbuffer_create_padded (RING_SIZE),
+		    chunk, total);
+	bad += run ("mirrored", jack_ringbuffer_create_mirrored (RING_SIZE),
+		    chunk, total);
+
+	return bad ? 1 : 0;
+}
@@ -17,18 +17,115 @@
    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 
    ISO/POSIX C version of Paul Davis's lock free ringbuffer C++ code.
-   This is safe for the case of one read thread and one write thread.
+   This is safe for the case of one read thread and one write thread,
+   or, through the jack_ringbuffer_mpsc_* calls, of several writers.
  */
 
 #include <config.h>
 
+/* Required for memfd_create() */
+#if defined(HAVE_MEMFD_CREATE) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#ifdef USE_MLOCK
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
 #include <sys/mman.h>
-#endif /* USE_MLOCK */
 #include <jack/ringbuffer.h>
 
+#include "internal.h"
+#include "futex.h"
+
+/* jack_ringbuffer_create() makes the classic layout, where write_ptr
+   and read_ptr in the public structure are the indices, so programs
+   that look at them keep working.
+
+   jack_ringbuffer_create_padded(), and the mirrored and MPSC
+   constructors built on it, put the write and read indices on cache
+   lines of their own, after the public structure, so that the writer
+   and the reader do not keep taking the same line away from each
+   other. Each side also keeps the other side's index as it last saw
+   it, and only looks at the real one when that says there is not
+   enough data or space. These indices run freely and are masked on
+   use. write_ptr and read_ptr in the public structure are not used;
+   write_ptr holds RB_PADDED, which no classic ringbuffer can have,
+   and which routes every call to the right code.
+
+   The writer publishes its index with a release store after copying
+   the data, and the reader loads it with acquire before copying it
+   out, and the other way round for the space. That holds for both
+   layouts.
+ */
+
+#define RB_PADDED ((size_t)-1)
+
+/* two lines: some CPUs fetch lines in pairs */
+#define RB_LINE 128
+
+typedef struct {
+	jack_ringbuffer_t rb;
+	size_t mirrored;                /* see jack_ringbuffer_create_mirrored() */
+	int mpsc;                       /* see jack_ringbuffer_create_mpsc() */
+
+	struct {
+		volatile size_t ptr;
+		size_t read_cache;              /* r.ptr, as last seen */
+	} w __attribute__((aligned (RB_LINE)));
+
+	struct {
+		volatile size_t ptr;
+		size_t write_cache;             /* w.ptr, as last seen */
+	} r __attribute__((aligned (RB_LINE)));
+
+	/* for jack_ringbuffer_wait_read() and _wait_write(). `used' is
+	   set by the first waiter ever, and until then neither side
+	   pays more than a load of it to notify. */
+	struct {
+		volatile int32_t used;
+		volatile int32_t data_seq;      /* futex: data came */
+		volatile int32_t data_waiters;
+		volatile int32_t space_seq;     /* futex: space came */
+		volatile int32_t space_waiters;
+	} wait __attribute__((aligned (RB_LINE)));
+
+} jack_ringbuffer_padded_t;
+
+#define RB_IS_PADDED(rb) ((rb)->write_ptr == RB_PADDED)
+#define RB_PADDED_OF(rb) ((jack_ringbuffer_padded_t*)(rb))
+#define RB_IS_MIRRORED(rb) (RB_IS_PADDED (rb) && RB_PADDED_OF (rb)->mirrored)
+
+/* Wake whoever waits on `seq', if anybody does. Called after the index
+   that the waiter looks at has been stored. */
+
+static inline void
+rb_notify (jack_ringbuffer_padded_t * prb, volatile int32_t *seq,
+	   volatile int32_t *waiters)
+{
+	if (!__atomic_load_n (&prb->wait.used, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	/* pairs with the waiter's increment of *waiters: either we see
+	   it, or it sees what we stored */
+	__atomic_thread_fence (__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n (waiters, __ATOMIC_RELAXED)) {
+		__atomic_add_fetch (seq, 1, __ATOMIC_SEQ_CST);
+#ifdef JACK_HAVE_FUTEX
+		jack_futex_wake (seq, INT_MAX);
+#endif
+	}
+}
+
+#define RB_NOTIFY_DATA(prb) \
+	rb_notify ((prb), &(prb)->wait.data_seq, &(prb)->wait.data_waiters)
+#define RB_NOTIFY_SPACE(prb) \
+	rb_notify ((prb), &(prb)->wait.space_seq, &(prb)->wait.space_waiters)
+
 /* Create a new ringbuffer to hold at least `sz' bytes of data. The
    actual buffer size is rounded up to the next power of two.  */
 
@@ -58,6 +155,139 @@ jack_ringbuffer_create (size_t sz)
 	return rb;
 }
 
+/* The padded state for a ringbuffer of `size' bytes, with no data
+   block yet. */
+
+static jack_ringbuffer_padded_t *
+rb_alloc_padded (size_t size)
+{
+	jack_ringbuffer_padded_t *prb;
+	void *mem;
+
+	if (posix_memalign (&mem, RB_LINE, sizeof(jack_ringbuffer_padded_t))) {
+		return NULL;
+	}
+
+	prb = (jack_ringbuffer_padded_t*)mem;
+	memset (prb, 0, sizeof(*prb));
+
+	prb->rb.size = size;
+	prb->rb.size_mask = size - 1;
+	prb->rb.write_ptr = RB_PADDED;
+	prb->rb.read_ptr = 0;
+	prb->rb.mlocked = 0;
+
+	return prb;
+}
+
+/* Like jack_ringbuffer_create(), but with the indices on cache lines
+   of their own, which is faster when the reader and the writer run
+   on different cores. write_ptr and read_ptr of the result do not
+   follow the data; use the functions. This is also the only kind
+   that jack_ringbuffer_wait_read() and _wait_write() work with.  */
+
+jack_ringbuffer_t *
+jack_ringbuffer_create_padded (size_t sz)
+{
+	jack_ringbuffer_padded_t *prb;
+	size_t size;
+
+	for (size = 2; size < sz; size <<= 1) ;
+
+	if ((prb = rb_alloc_padded (size)) == NULL) {
+		return NULL;
+	}
+
+	if ((prb->rb.buf = malloc (size)) == NULL) {
+		free (prb);
+		return NULL;
+	}
+
+	return &prb->rb;
+}
+
+/* Map `size' bytes of fresh shared memory twice, back to back, so that
+   buf[i] and buf[i + size] are the same byte. */
+
+static char *
+rb_map_mirrored (size_t size)
+{
+	char *buf;
+	int fd;
+
+#ifdef HAVE_MEMFD_CREATE
+	if ((fd = memfd_create ("jack-ringbuffer", MFD_CLOEXEC)) < 0) {
+		return NULL;
+	}
+#else
+	char name[64];
+
+	snprintf (name, sizeof(name), "/jack-ringbuffer-%d-%p", (int)getpid (),
+		  (void*)&name);
+	if ((fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+		return NULL;
+	}
+	shm_unlink (name);
+#endif
+
+	if (ftruncate (fd, size) < 0) {
+		close (fd);
+		return NULL;
+	}
+
+	/* reserve room for both views, then put the file over it twice */
+
+	if ((buf = mmap (NULL, 2 * size, PROT_NONE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		close (fd);
+		return NULL;
+	}
+
+	if (mmap (buf, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+		  fd, 0) == MAP_FAILED
+	    || mmap (buf + size, size, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap (buf, 2 * size);
+		close (fd);
+		return NULL;
+	}
+
+	close (fd);
+
+	return buf;
+}
+
+/* Like jack_ringbuffer_create_padded(), but with the data mapped
+   twice in a row, so that the vectors returned by
+   jack_ringbuffer_get_read_vector() and
+   jack_ringbuffer_get_write_vector() are always in one part. The
+   size is also rounded up to a whole number of pages. Returns NULL if
+   the system cannot do this, in which case
+   jack_ringbuffer_create_padded() still can.  */
+
+jack_ringbuffer_t *
+jack_ringbuffer_create_mirrored (size_t sz)
+{
+	jack_ringbuffer_padded_t *prb;
+	long page = sysconf (_SC_PAGESIZE);
+	size_t size;
+
+	for (size = (page > 0 ? page : 4096); size < sz; size <<= 1) ;
+
+	if ((prb = rb_alloc_padded (size)) == NULL) {
+		return NULL;
+	}
+
+	if ((prb->rb.buf = rb_map_mirrored (size)) == NULL) {
+		free (prb);
+		return NULL;
+	}
+
+	prb->mirrored = 1;
+
+	return &prb->rb;
+}
+
 /* Free all data associated with the ringbuffer `rb'. */
 
 void
@@ -65,10 +295,14 @@ jack_ringbuffer_free (jack_ringbuffer_t * rb)
 {
 #ifdef USE_MLOCK
 	if (rb->mlocked) {
-		munlock (rb->buf, rb->size);
+		munlock (rb->buf, RB_IS_MIRRORED (rb) ? 2 * rb->size : rb->size);
 	}
 #endif  /* USE_MLOCK */
-	free (rb->buf);
+	if (RB_IS_MIRRORED (rb)) {
+		munmap (rb->buf, 2 * rb->size);
+	} else {
+		free (rb->buf);
+	}
 	free (rb);
 }
 
@@ -78,7 +312,8 @@ int
 jack_ringbuffer_mlock (jack_ringbuffer_t * rb)
 {
 #ifdef USE_MLOCK
-	if (mlock (rb->buf, rb->size)) {
+	/* both views of a mirrored buffer, so that neither faults */
+	if (mlock (rb->buf, RB_IS_MIRRORED (rb) ? 2 * rb->size : rb->size)) {
 		return -1;
 	}
 #endif  /* USE_MLOCK */
@@ -92,10 +327,119 @@ jack_ringbuffer_mlock (jack_ringbuffer_t * rb)
 void
 jack_ringbuffer_reset (jack_ringbuffer_t * rb)
 {
+	if (RB_IS_PADDED (rb)) {
+		jack_ringbuffer_padded_t *prb = RB_PADDED_OF (rb);
+		prb->w.ptr = 0;
+		prb->w.read_cache = 0;
+		prb->r.ptr = 0;
+		prb->r.write_cache = 0;
+		return;
+	}
+
 	rb->read_ptr = 0;
 	rb->write_ptr = 0;
 }
 
+/* Either side may ask for either space, so these do not use the
+   caches. */
+
+static inline size_t
+rb_padded_read_space (const jack_ringbuffer_padded_t * prb)
+{
+	size_t r = __atomic_load_n (&prb->r.ptr, __ATOMIC_ACQUIRE);
+
+	return __atomic_load_n (&prb->w.ptr, __ATOMIC_ACQUIRE) - r;
+}
+
+static inline size_t
+rb_padded_write_space (const jack_ringbuffer_padded_t * prb)
+{
+	size_t w = __atomic_load_n (&prb->w.ptr, __ATOMIC_ACQUIRE);
+
+	return prb->rb.size - 1
+	       - (w - __atomic_load_n (&prb->r.ptr, __ATOMIC_ACQUIRE));
+}
+
+/* For the reader: at least `want' bytes readable, if there are. */
+
+static inline size_t
+rb_padded_readable (jack_ringbuffer_padded_t * prb, size_t r, size_t want)
+{
+	size_t avail = prb->r.write_cache - r;
+
+	if (avail < want) {
+		prb->r.write_cache = __atomic_load_n (&prb->w.ptr,
+						      __ATOMIC_ACQUIRE);
+		avail = prb->r.write_cache - r;
+	}
+
+	return avail;
+}
+
+/* For the writer: at least `want' bytes writable, if there are. */
+
+static inline size_t
+rb_padded_writable (jack_ringbuffer_padded_t * prb, size_t w, size_t want)
+{
+	size_t avail = prb->rb.size - 1 - (w - prb->w.read_cache);
+
+	if (avail < want) {
+		prb->w.read_cache = __atomic_load_n (&prb->r.ptr,
+						     __ATOMIC_ACQUIRE);
+		avail = prb->rb.size - 1 - (w - prb->w.read_cache);
+	}
+
+	return avail;
+}
+
+/* Copy `cnt' bytes out of the buffer from index `r', wrapping. */
+
+static inline void
+rb_copy_out (const jack_ringbuffer_t * rb, char *dest, size_t r, size_t cnt)
+{
+	size_t pos = r & rb->size_mask;
+	size_t n1 = rb->size - pos;
+
+	if (n1 >= cnt || RB_IS_MIRRORED (rb)) {
+		memcpy (dest, &(rb->buf[pos]), cnt);
+	} else {
+		memcpy (dest, &(rb->buf[pos]), n1);
+		memcpy (dest + n1, rb->buf, cnt - n1);
+	}
+}
+
+/* Zero `cnt' bytes of the buffer from index `r', wrapping. */
+
+static inline void
+rb_zero (jack_ringbuffer_t * rb, size_t r, size_t cnt)
+{
+	size_t pos = r & rb->size_mask;
+	size_t n1 = rb->size - pos;
+
+	if (n1 >= cnt) {
+		memset (&(rb->buf[pos]), 0, cnt);
+	} else {
+		memset (&(rb->buf[pos]), 0, n1);
+		memset (rb->buf, 0, cnt - n1);
+	}
+}
+
+/* Copy `cnt' bytes into the buffer at index `w', wrapping. */
+
+static inline void
+rb_copy_in (jack_ringbuffer_t * rb, const char *src, size_t w, size_t cnt)
+{
+	size_t pos = w & rb->size_mask;
+	size_t n1 = rb->size - pos;
+
+	if (n1 >= cnt || RB_IS_MIRRORED (rb)) {
+		memcpy (&(rb->buf[pos]), src, cnt);
+	} else {
+		memcpy (&(rb->buf[pos]), src, n1);
+		memcpy (rb->buf, src + n1, cnt - n1);
+	}
+}
+
 /* Return the number of bytes available for reading.  This is the
    number of bytes in front of the read pointer and behind the write
    pointer.  */
@@ -105,8 +449,12 @@ jack_ringbuffer_read_space (const jack_ringbuffer_t * rb)
 {
 	size_t w, r;
 
-	w = rb->write_ptr;
-	r = rb->read_ptr;
+	if (RB_IS_PADDED (rb)) {
+		return rb_padded_read_space (RB_PADDED_OF (rb));
+	}
+
+	w = __atomic_load_n (&rb->write_ptr, __ATOMIC_ACQUIRE);
+	r = __atomic_load_n (&rb->read_ptr, __ATOMIC_ACQUIRE);
 
 	if (w > r) {
 		return w - r;
@@ -124,8 +472,12 @@ jack_ringbuffer_write_space (const jack_ringbuffer_t * rb)
 {
 	size_t w, r;
 
-	w = rb->write_ptr;
-	r = rb->read_ptr;
+	if (RB_IS_PADDED (rb)) {
+		return rb_padded_write_space (RB_PADDED_OF (rb));
+	}
+
+	w = __atomic_load_n (&rb->write_ptr, __ATOMIC_ACQUIRE);
+	r = __atomic_load_n (&rb->read_ptr, __ATOMIC_ACQUIRE);
 
 	if (w > r) {
 		return ((r - w + rb->size) & rb->size_mask) - 1;
@@ -147,6 +499,19 @@ jack_ringbuffer_read (jack_ringbuffer_t * rb, char *dest, size_t cnt)
 	size_t to_read;
 	size_t n1, n2;
 
+	if (RB_IS_PADDED (rb)) {
+		jack_ringbuffer_padded_t *prb = RB_PADDED_OF (rb);
+		size_t r = prb->r.ptr;
+
+		free_cnt = rb_padded_readable (prb, r, cnt);
+		to_read = cnt > free_cnt ? free_cnt : cnt;
+		rb_copy_out (rb, dest, r, to_read);
+		__atomic_store_n (&prb->r.ptr, r + to_read, __ATOMIC_RELEASE);
+		RB_NOTIFY_SPACE (prb);
+
+		return to_read;
+	}
+
 	if ((free_cnt = jack_ringbuffer_read_space (rb)) == 0) {
 		return 0;
 	}
@@ -164,13 +529,14 @@ jack_ringbuffer_read (jack_ringbuffer_t * rb, char *dest, size_t cnt)
 	}
 
 	memcpy (dest, &(rb->buf[rb->read_ptr]), n1);
-	rb->read_ptr = (rb->read_ptr + n1) & rb->size_mask;
 
 	if (n2) {
-		memcpy (dest + n1, &(rb->buf[rb->read_ptr]), n2);
-		rb->read_ptr = (rb->read_ptr + n2) & rb->size_mask;
+		memcpy (dest + n1, rb->buf, n2);
 	}
 
+	__atomic_store_n (&rb->read_ptr, (rb->read_ptr + to_read) & rb->size_mask,
+			  __ATOMIC_RELEASE);
+
 	return to_read;
 }
 
@@ -187,6 +553,17 @@ jack_ringbuffer_peek (jack_ringbuffer_t * rb, char *dest, size_t cnt)
 	size_t n1, n2;
 	size_t tmp_read_ptr;
 
+	if (RB_IS_PADDED (rb)) {
+		jack_ringbuffer_padded_t *prb = RB_PADDED_OF (rb);
+		size_t r = prb->r.ptr;
+
+		free_cnt = rb_padded_readable (prb, r, cnt);
+		to_read = cnt > free_cnt ? free_cnt : cnt;
+		rb_copy_out (rb, dest, r, to_read);
+
+		return to_read;
+	}
+
 	tmp_read_ptr = rb->read_ptr;
 
 	if ((free_cnt = jack_ringbuffer_read_space (rb)) == 0) {
@@ -227,6 +604,19 @@ jack_ringbuffer_write (jack_ringbuffer_t * rb, const char *src, size_t cnt)
 	size_t to_write;
 	size_t n1, n2;
 
+	if (RB_IS_PADDED (rb)) {
+		jack_ringbuffer_padded_t *prb = RB_PADDED_OF (rb);
+		size_t w = prb->w.ptr;
+
+		free_cnt = rb_padded_writable (prb, w, cnt);
+		to_write = cnt > free_cnt ? free_cnt : cnt;
+		rb_copy_in (rb, src, w, to_write);
+		__atomic_store_n (&prb->w.ptr, w + to_write, __ATOMIC_RELEASE);
+		RB_NOTIFY_DATA (prb);
+
+		return to_write;
+	}
+
 	if ((free_cnt = jack_ringbuffer_write_space (rb)) == 0) {
 		return 0;
 	}
@@ -244,13 +634,14 @@ jack_ringbuffer_write (jack_ringbuffer_t * rb, const char *src, size_t cnt)
 	}
 
 	memcpy (&(rb->buf[rb->write_ptr]), src, n1);
-	rb->write_ptr = (rb->write_ptr + n1) & rb->size_mask;
 
 	if (n2) {
-		memcpy (&(rb->buf[rb->write_ptr]), src + n1, n2);
-		rb->write_ptr = (rb->write_ptr + n2) & rb->size_mask;
+		memcpy (rb->buf, src + n1, n2);
 	}
 
+	__atomic_store_n (&rb->write_ptr, (rb->write_ptr + to_write) & rb->size_mask,
+			  __ATOMIC_RELEASE);
+
 	return to_write;
 }
 
@@ -259,9 +650,17 @@ jack_ringbuffer_write (jack_ringbuffer_t * rb, const char *src, size_t cnt)
 void
 jack_ringbuffer_read_advance (jack_ringbuffer_t * rb, size_t cnt)
 {
-	size_t tmp = (rb->read_ptr + cnt) & rb->size_mask;
+	size_t tmp;
+
+	if (RB_IS_PADDED (rb)) {
+		jack_ringbuffer_padded_t *prb = RB_PADDED_OF (rb);
+		__atomic_store_n (&prb->r.ptr, prb->r.ptr + cnt, __ATOMIC_RELEASE);
+		RB_NOTIFY_SPACE (prb);
+		return;
+	}
 
-	rb->read_ptr = tmp;
+	tmp = (rb->read_ptr + cnt) & rb->size_mask;
+	__atomic_store_n (&rb->read_ptr, tmp, __ATOMIC_RELEASE);
 }
 
 /* Advance the write pointer `cnt' places. */
@@ -269,9 +668,17 @@ jack_ringbuffer_read_advance (jack_ringbuffer_t * rb, size_t cnt)
 void
 jack_ringbuffer_write_advance (jack_ringbuffer_t * rb, size_t cnt)
 {
-	size_t tmp = (rb->write_ptr + cnt) & rb->size_mask;
+	size_t tmp;
 
-	rb->write_ptr = tmp;
+	if (RB_IS_PADDED (rb)) {
+		jack_ringbuffer_padded_t *prb = RB_PADDED_OF (rb);
+		__atomic_store_n (&prb->w.ptr, prb->w.ptr + cnt, __ATOMIC_RELEASE);
+		RB_NOTIFY_DATA (prb);
+		return;
+	}
+
+	tmp = (rb->write_ptr + cnt) & rb->size_mask;
+	__atomic_store_n (&rb->write_ptr, tmp, __ATOMIC_RELEASE);
 }
 
 /* The non-copying data reader.  `vec' is an array of two places.  Set
@@ -287,18 +694,28 @@ jack_ringbuffer_get_read_vector (const jack_ringbuffer_t * rb,
 	size_t cnt2;
 	size_t w, r;
 
-	w = rb->write_ptr;
-	r = rb->read_ptr;
+	if (RB_IS_PADDED (rb)) {
+		jack_ringbuffer_padded_t *prb = RB_PADDED_OF (rb);
 
-	if (w > r) {
-		free_cnt = w - r;
+		/* all there is, so never mind the cache */
+		prb->r.write_cache = __atomic_load_n (&prb->w.ptr,
+						      __ATOMIC_ACQUIRE);
+		r = prb->r.ptr & rb->size_mask;
+		free_cnt = prb->r.write_cache - prb->r.ptr;
 	} else {
-		free_cnt = (w - r + rb->size) & rb->size_mask;
+		w = __atomic_load_n (&rb->write_ptr, __ATOMIC_ACQUIRE);
+		r = rb->read_ptr;
+
+		if (w > r) {
+			free_cnt = w - r;
+		} else {
+			free_cnt = (w - r + rb->size) & rb->size_mask;
+		}
 	}
 
 	cnt2 = r + free_cnt;
 
-	if (cnt2 > rb->size) {
+	if (cnt2 > rb->size && !RB_IS_MIRRORED (rb)) {
 
 		/* Two part vector: the rest of the buffer after the current write
 		   ptr, plus some from the start of the buffer. */
@@ -331,20 +748,29 @@ jack_ringbuffer_get_write_vector (const jack_ringbuffer_t * rb,
 	size_t cnt2;
 	size_t w, r;
 
-	w = rb->write_ptr;
-	r = rb->read_ptr;
+	if (RB_IS_PADDED (rb)) {
+		jack_ringbuffer_padded_t *prb = RB_PADDED_OF (rb);
 
-	if (w > r) {
-		free_cnt = ((r - w + rb->size) & rb->size_mask) - 1;
-	} else if (w < r) {
-		free_cnt = (r - w) - 1;
+		prb->w.read_cache = __atomic_load_n (&prb->r.ptr,
+						     __ATOMIC_ACQUIRE);
+		w = prb->w.ptr & rb->size_mask;
+		free_cnt = rb->size - 1 - (prb->w.ptr - prb->w.read_cache);
 	} else {
-		free_cnt = rb->size - 1;
+		w = rb->write_ptr;
+		r = __atomic_load_n (&rb->read_ptr, __ATOMIC_ACQUIRE);
+
+		if (w > r) {
+			free_cnt = ((r - w + rb->size) & rb->size_mask) - 1;
+		} else if (w < r) {
+			free_cnt = (r - w) - 1;
+		} else {
+			free_cnt = rb->size - 1;
+		}
 	}
 
 	cnt2 = w + free_cnt;
 
-	if (cnt2 > rb->size) {
+	if (cnt2 > rb->size && !RB_IS_MIRRORED (rb)) {
 
 		/* Two part vector: the rest of the buffer after the current write
 		   ptr, plus some from the start of the buffer. */
@@ -359,3 +785,234 @@ jack_ringbuffer_get_write_vector (const jack_ringbuffer_t * rb,
 		vec[1].len = 0;
 	}
 }
+
+/* Multi-producer, single-consumer use.
+
+   A ringbuffer made by jack_ringbuffer_create_mpsc() carries whole
+   messages, each behind a 32-bit header and padded to 8 bytes, so a
+   header never wraps. A producer claims room by moving the write
+   index with a compare-and-swap, copies its message in, and then
+   stores the header, which is what makes the message visible. The
+   reader takes messages in the order their room was claimed, and
+   zeroes each header before it gives the room back. A producer that
+   stalls between its claim and its header holds up the reader, but
+   never the other producers.
+
+   Only jack_ringbuffer_mpsc_write(), jack_ringbuffer_mpsc_read(),
+   the two _wait functions, and _free may be used on such a ringbuffer.
+ */
+
+#define RB_MPSC_HEADER 8
+#define RB_MPSC_READY  0x80000000U
+#define RB_MPSC_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+jack_ringbuffer_t *
+jack_ringbuffer_create_mpsc (size_t sz)
+{
+	jack_ringbuffer_t *rb;
+
+	if ((rb = jack_ringbuffer_create_padded (sz)) == NULL) {
+		return NULL;
+	}
+
+	/* headers start out as "not written yet" */
+	memset (rb->buf, 0, rb->size);
+	RB_PADDED_OF (rb)->mpsc = 1;
+
+	return rb;
+}
+
+/* Write one message of `cnt' bytes, all or nothing. Safe to call from
+   any number of threads at once. Returns 0, or -1 if there is not
+   room for it now (or ever). */
+
+int
+jack_ringbuffer_mpsc_write (jack_ringbuffer_t * rb, const char *src,
+			    size_t cnt)
+{
+	jack_ringbuffer_padded_t *prb = RB_PADDED_OF (rb);
+	size_t need = RB_MPSC_HEADER + RB_MPSC_ALIGN (cnt);
+	size_t w, r;
+
+	if (cnt == 0 || cnt >= RB_MPSC_READY || need > rb->size) {
+		return -1;
+	}
+
+	w = __atomic_load_n (&prb->w.ptr, __ATOMIC_RELAXED);
+
+	do {
+		r = __atomic_load_n (&prb->r.ptr, __ATOMIC_ACQUIRE);
+		if (rb->size - (w - r) < need) {
+			return -1;
+		}
+	} while (!__atomic_compare_exchange_n (&prb->w.ptr, &w, w + need,
+					       1, __ATOMIC_ACQUIRE,
+					       __ATOMIC_RELAXED));
+
+	rb_copy_in (rb, src, w + RB_MPSC_HEADER, cnt);
+	__atomic_store_n ((uint32_t*)&rb->buf[w & rb->size_mask],
+			  (uint32_t)cnt | RB_MPSC_READY, __ATOMIC_RELEASE);
+
+	RB_NOTIFY_DATA (prb);
+
+	return 0;
+}
+
+/* Read the next message into `dest'. Returns its size, 0 if there is
+   none yet, or -1 if it is longer than `cnt', in which case it is
+   left where it is. Only one thread may read. */
+
+ssize_t
+jack_ringbuffer_mpsc_read (jack_ringbuffer_t * rb, char *dest, size_t cnt)
+{
+	jack_ringbuffer_padded_t *prb = RB_PADDED_OF (rb);
+	size_t r = prb->r.ptr;
+	uint32_t *header = (uint32_t*)&rb->buf[r & rb->size_mask];
+	uint32_t h = __atomic_load_n (header, __ATOMIC_ACQUIRE);
+	size_t len;
+
+	if (!(h & RB_MPSC_READY)) {
+		return 0;
+	}
+
+	len = h & ~RB_MPSC_READY;
+
+	if (len > cnt) {
+		return -1;
+	}
+
+	rb_copy_out (rb, dest, r + RB_MPSC_HEADER, len);
+
+	/* give the room back zeroed, since a later header may fall
+	   anywhere in it */
+	rb_zero (rb, r, RB_MPSC_HEADER + RB_MPSC_ALIGN (len));
+
+	__atomic_store_n (&prb->r.ptr, r + RB_MPSC_HEADER + RB_MPSC_ALIGN (len),
+			  __ATOMIC_RELEASE);
+
+	RB_NOTIFY_SPACE (prb);
+
+	return len;
+}
+
+/* Blocking waits, for a thread that must not poll. They sleep on a
+   futex, where there is one, and otherwise nap for a millisecond at a
+   time. The other side only makes a system call to wake them while
+   somebody waits. timeout_usecs < 0 waits for ever. Each returns 0
+   once the condition holds, -1 on timeout. Only for ringbuffers made
+   by jack_ringbuffer_create_padded(), _mirrored() or _mpsc(). */
+
+static int
+rb_ready (jack_ringbuffer_padded_t * prb, size_t cnt, int for_data)
+{
+	jack_ringbuffer_t *rb = &prb->rb;
+
+	if (prb->mpsc) {
+		if (for_data) {
+			uint32_t *header = (uint32_t*)
+					   &rb->buf[prb->r.ptr & rb->size_mask];
+			return (__atomic_load_n (header, __ATOMIC_ACQUIRE)
+				& RB_MPSC_READY) != 0;
+		}
+		return rb->size - (__atomic_load_n (&prb->w.ptr, __ATOMIC_ACQUIRE)
+				   - __atomic_load_n (&prb->r.ptr, __ATOMIC_ACQUIRE))
+		       >= RB_MPSC_HEADER + RB_MPSC_ALIGN (cnt);
+	}
+
+	return (for_data ? rb_padded_read_space (prb)
+		: rb_padded_write_space (prb)) >= cnt;
+}
+
+static int
+rb_wait (jack_ringbuffer_padded_t * prb, size_t cnt, int for_data,
+	 long timeout_usecs)
+{
+	volatile int32_t *seq = for_data ? &prb->wait.data_seq
+				: &prb->wait.space_seq;
+	volatile int32_t *waiters = for_data ? &prb->wait.data_waiters
+				    : &prb->wait.space_waiters;
+	jack_time_t then = jack_get_microseconds ();
+	jack_time_t elapsed;
+	long nap;
+	int32_t v;
+	int ret = 0;
+	int first = 0;
+
+	if (rb_ready (prb, cnt, for_data)) {
+		return 0;
+	}
+
+	if (!__atomic_load_n (&prb->wait.used, __ATOMIC_RELAXED)) {
+		__atomic_store_n (&prb->wait.used, 1, __ATOMIC_SEQ_CST);
+		first = 1;
+	}
+
+	__atomic_add_fetch (waiters, 1, __ATOMIC_SEQ_CST);
+
+	while (1) {
+		v = __atomic_load_n (seq, __ATOMIC_SEQ_CST);
+
+		if (rb_ready (prb, cnt, for_data)) {
+			break;
+		}
+
+		elapsed = jack_get_microseconds () - then;
+
+		if (timeout_usecs >= 0 && elapsed >= (jack_time_t)timeout_usecs) {
+			ret = -1;
+			break;
+		}
+
+		nap = timeout_usecs < 0 ? -1 : (long)(timeout_usecs - elapsed);
+
+		/* the other side may not see `used' at once, so the very
+		   first sleep is short */
+#ifdef JACK_HAVE_FUTEX
+		if (first && (nap < 0 || nap > 1000)) {
+			nap = 1000;
+		}
+		first = 0;
+
+		if (jack_futex_wait (seq, v, nap) < 0 && errno != ETIMEDOUT) {
+			ret = -1;
+			break;
+		}
+#else
+		(void)v;
+		(void)first;
+		usleep (nap < 0 || nap > 1000 ? 1000 : nap);
+#endif
+	}
+
+	__atomic_sub_fetch (waiters, 1, __ATOMIC_SEQ_CST);
+
+	return ret;
+}
+
+/* Wait until `cnt' bytes can be read or, for an MPSC ringbuffer, until
+   a message can. */
+
+int
+jack_ringbuffer_wait_read (jack_ringbuffer_t * rb, size_t cnt,
+			   long timeout_usecs)
+{
+	if (!RB_IS_PADDED (rb)) {
+		return -1;
+	}
+
+	return rb_wait (RB_PADDED_OF (rb), cnt, 1, timeout_usecs);
+}
+
+/* Wait until `cnt' bytes can be written or, for an MPSC ringbuffer, a
+   message of `cnt' bytes can. */
+
+int
+jack_ringbuffer_wait_write (jack_ringbuffer_t * rb, size_t cnt,
+			    long timeout_usecs)
+{
+	if (!RB_IS_PADDED (rb)) {
+		return -1;
+	}
+
+	return rb_wait (RB_PADDED_OF (rb), cnt, 0, timeout_usecs);
+}
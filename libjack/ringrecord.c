@@ -0,0 +1,169 @@
+/*
+   Copyright (C) 2026 the JACK developers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation; either version 2.1 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+   Variable length records on top of a jack_ringbuffer_t, for one
+   writer and one reader.
+ */
+
+/* Each record is a header followed by its payload, padded so that the
+   next header starts on a multiple of RR_ALIGN. A record is never
+   split at the end of the buffer: when it does not fit in what is
+   left there, the writer puts a skip marker in the tail and starts
+   the record at the beginning. The writer fills the payload in place
+   between jack_ringbuffer_record_reserve() and _commit(), and the
+   reader uses it in place between _peek() and _consume(), so each
+   record costs one index update on either side and no copies.
+
+   Only the public ringbuffer calls are used, so this works with any
+   ringbuffer, and never needs a skip with a mirrored one. The same
+   ringbuffer must not also be used with the byte stream calls.
+ */
+
+#include <config.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <jack/ringbuffer.h>
+
+#include "internal.h"
+
+#define RR_ALIGN 8
+#define RR_SKIP  0xffffffffU
+
+typedef struct {
+	uint32_t size;                  /* of the payload, or RR_SKIP */
+	uint32_t unused;
+} jack_ringbuffer_record_header_t;
+
+#define RR_HEADER sizeof(jack_ringbuffer_record_header_t)
+#define RR_SPACE(size) \
+	(RR_HEADER + (((size) + RR_ALIGN - 1) & ~(size_t)(RR_ALIGN - 1)))
+
+/* Where a record of `size' bytes goes, and how much of the tail has
+   to be skipped to get there. The reader only ever makes the vector
+   longer, so reserve and commit find the same place. */
+
+static char *
+rr_place (jack_ringbuffer_t *rb, size_t size, size_t *skip)
+{
+	jack_ringbuffer_data_t vec[2];
+	size_t need = RR_SPACE (size);
+
+	jack_ringbuffer_get_write_vector (rb, vec);
+
+	if (vec[0].len >= need) {
+		*skip = 0;
+		return vec[0].buf;
+	}
+
+	/* vec[1] is only there when vec[0] runs to the end of the
+	   buffer, so skipping it puts the record at the start */
+	if (vec[1].len >= need) {
+		*skip = vec[0].len;
+		return vec[1].buf;
+	}
+
+	return NULL;
+}
+
+/* Get `size' contiguous bytes to write a record into. Returns NULL if
+   there is not room for it now. Nothing is visible to the reader
+   until jack_ringbuffer_record_commit(). */
+
+void *
+jack_ringbuffer_record_reserve (jack_ringbuffer_t *rb, size_t size)
+{
+	size_t skip;
+	char *rec;
+
+	if (size >= RR_SKIP || (rec = rr_place (rb, size, &skip)) == NULL) {
+		return NULL;
+	}
+
+	return rec + RR_HEADER;
+}
+
+/* Publish the record last reserved, which must have been reserved
+   with the same `size'. */
+
+void
+jack_ringbuffer_record_commit (jack_ringbuffer_t *rb, size_t size)
+{
+	jack_ringbuffer_record_header_t *hdr;
+	size_t skip;
+	char *rec;
+
+	if ((rec = rr_place (rb, size, &skip)) == NULL) {
+		return;
+	}
+
+	if (skip) {
+		hdr = (jack_ringbuffer_record_header_t*)
+		      (rb->buf + rb->size - skip);
+		hdr->size = RR_SKIP;
+	}
+
+	hdr = (jack_ringbuffer_record_header_t*)rec;
+	hdr->size = size;
+
+	jack_ringbuffer_write_advance (rb, skip + RR_SPACE (size));
+}
+
+/* The next record, used in place; its size goes in *size. Returns
+   NULL if there is none. It stays in the ringbuffer until
+   jack_ringbuffer_record_consume(). */
+
+void *
+jack_ringbuffer_record_peek (jack_ringbuffer_t *rb, size_t *size)
+{
+	jack_ringbuffer_data_t vec[2];
+	jack_ringbuffer_record_header_t *hdr;
+
+	jack_ringbuffer_get_read_vector (rb, vec);
+
+	if (vec[0].len < RR_HEADER) {
+		return NULL;
+	}
+
+	hdr = (jack_ringbuffer_record_header_t*)vec[0].buf;
+
+	if (hdr->size == RR_SKIP) {
+		/* the record after it is at the start */
+		jack_ringbuffer_read_advance (rb, vec[0].len);
+
+		if (vec[1].len < RR_HEADER) {
+			return NULL;
+		}
+		hdr = (jack_ringbuffer_record_header_t*)vec[1].buf;
+	}
+
+	*size = hdr->size;
+
+	return (char*)hdr + RR_HEADER;
+}
+
+/* Drop the record that jack_ringbuffer_record_peek() returned. */
+
+void
+jack_ringbuffer_record_consume (jack_ringbuffer_t *rb)
+{
+	size_t size;
+
+	if (jack_ringbuffer_record_peek (rb, &size) != NULL) {
+		jack_ringbuffer_read_advance (rb, RR_SPACE (size));
+	}
+}
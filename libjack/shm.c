@@ -1,13 +1,14 @@
 /* This module provides a set of abstract shared memory interfaces
- * with support using both System V and POSIX shared memory
- * implementations.  The code is divided into three sections:
+ * with support using System V, POSIX and memfd shared memory
+ * implementations.  The code is divided into four sections:
  *
- *	- common (interface-independent) code
+ *	- common (interface-independent) registry code
+ *	- memfd implementation, which needs no registry
  *	- POSIX implementation
  *	- System V implementation
  *
- * The implementation used is determined by whether USE_POSIX_SHM was
- * set in the ./configure step.
+ * The implementation used is determined by whether USE_MEMFD_SHM or
+ * USE_POSIX_SHM was set in the ./configure step.
  */
 
 /*
@@ -31,6 +32,11 @@
 
 #include <config.h>
 
+/* Required for memfd_create() and file sealing */
+#if defined(USE_MEMFD_SHM) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -46,11 +52,19 @@
 #include <sys/shm.h>
 #include <sys/sem.h>
 #include <sysdeps/ipc.h>
+#ifdef USE_MEMFD_SHM
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
 #include "shm.h"
 #include "internal.h"
 #include "version.h"
 
+#ifndef USE_MEMFD_SHM
+
 #ifdef USE_POSIX_SHM
 static jack_shmtype_t jack_shmtype = shm_POSIX;
 #else
@@ -526,12 +540,15 @@ jack_cleanup_shm ()
 	return TRUE;
 }
 
+#endif /* !USE_MEMFD_SHM */
+
 /* resize a shared memory segment
  *
  * There is no way to resize a System V shm segment.  Resizing is
  * possible with POSIX shm, but not with the non-conformant Mac OS X
  * implementation.  Since POSIX shm is mainly used on that platform,
- * it's simpler to treat them both the same.
+ * it's simpler to treat them both the same.  A memfd segment is
+ * sealed at its size, so it is no different.
  *
  * So, we always resize by deleting and reallocating.  This is
  * tricky, because the old segment will not disappear until
@@ -556,7 +573,388 @@ jack_resize_shm (jack_shm_info_t* si, jack_shmsize_t size)
 	return jack_attach_shm (si);
 }
 
-#ifdef USE_POSIX_SHM
+#if defined(USE_MEMFD_SHM)
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+* memfd interface-dependent functions
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* Each segment is an anonymous memfd, sealed at its size when it is
+ * created, which the server hands to a client over the client's
+ * socket (jack_shm_send() and jack_shm_recv()).  Nothing is named, so
+ * there is no registry to lock or to clean up after a crash: a
+ * segment goes away when the last process mapping it does.
+ *
+ * The registry array is private to the server and only holds the
+ * segments it allocated.  A client keeps a received fd in the
+ * jack_shm_info_t it passed to jack_shm_recv(), never in anything
+ * shared, because one process may be several clients of one or more
+ * servers, each receiving on its own thread; jack_attach_shm() maps
+ * the fd and closes it.
+ */
+
+#define JACK_SHM_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+static jack_shm_registry_t jack_shm_registry[MAX_SHM_ID];
+static pthread_mutex_t jack_shm_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* held while this process is the named server */
+static int jack_server_lock_fd = -1;
+
+static void
+jack_release_shm_entry (jack_shm_registry_index_t index)
+{
+	/* the registry must be locked */
+	jack_shm_registry_t *registry = &jack_shm_registry[index];
+
+	if (registry->size) {
+		close (registry->id);
+	}
+	memset (registry, 0, sizeof(*registry));
+}
+
+int
+jack_initialize_shm (const char *server_name)
+{
+	return 0;               /* nothing to attach */
+}
+
+/* Claim server_name for this process by binding an abstract socket
+ * named after it, which the kernel releases when the process exits
+ * however it does.
+ *
+ * returns 0 if successful
+ *	   EEXIST if server_name was already active for this user
+ *	   ENOMEM if the name could not be claimed for another reason
+ */
+int
+jack_register_server (const char *server_name, int new_registry)
+{
+	struct sockaddr_un addr;
+	socklen_t len;
+	int rc;
+
+	jack_info ("JACK compiled with %s SHM support.", JACK_SHM_TYPE);
+
+	if (jack_server_lock_fd >= 0) {
+		return 0;               /* it's me */
+	}
+
+	if ((jack_server_lock_fd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		jack_error ("cannot create server lock socket (%s)",
+			    strerror (errno));
+		return ENOMEM;
+	}
+
+	fcntl (jack_server_lock_fd, F_SETFD, FD_CLOEXEC);
+
+	memset (&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf (addr.sun_path + 1, sizeof(addr.sun_path) - 1,
+		  "jack-%d:%s", getuid (), server_name);
+	len = offsetof (struct sockaddr_un, sun_path) + 1
+	      + strlen (addr.sun_path + 1);
+
+	if (bind (jack_server_lock_fd, (struct sockaddr*)&addr, len) < 0) {
+		rc = (errno == EADDRINUSE) ? EEXIST : ENOMEM;
+		if (rc == ENOMEM) {
+			jack_error ("cannot bind server lock socket (%s)",
+				    strerror (errno));
+		}
+		close (jack_server_lock_fd);
+		jack_server_lock_fd = -1;
+		return rc;
+	}
+
+	return 0;
+}
+
+/* release server_name registration */
+void
+jack_unregister_server (const char *server_name /* unused */)
+{
+	if (jack_server_lock_fd >= 0) {
+		close (jack_server_lock_fd);
+		jack_server_lock_fd = -1;
+	}
+}
+
+/* called for server startup and termination.  A previous instance
+ * cannot have left anything behind, so this only drops the segments
+ * this process still holds.
+ */
+int
+jack_cleanup_shm ()
+{
+	int i;
+
+	pthread_mutex_lock (&jack_shm_registry_lock);
+	for (i = 0; i < MAX_SHM_ID; i++) {
+		jack_release_shm_entry (i);
+	}
+	pthread_mutex_unlock (&jack_shm_registry_lock);
+
+	return TRUE;
+}
+
+/* true if si is a segment this process allocated, rather than one it
+ * received */
+static int
+jack_shm_is_ours (jack_shm_info_t* si)
+{
+	/* the registry must be locked */
+	return si->index >= 0 && si->index < MAX_SHM_ID
+	       && jack_shm_registry[si->index].size != 0
+	       && jack_shm_registry[si->index].id == si->fd;
+}
+
+void
+jack_destroy_shm (jack_shm_info_t* si)
+{
+	if (si->index == JACK_SHM_NULL_INDEX || si->fd < 0) {
+		return;                 /* not allocated, or already mapped */
+	}
+
+	pthread_mutex_lock (&jack_shm_registry_lock);
+	if (jack_shm_is_ours (si)) {
+		jack_release_shm_entry (si->index);
+	} else {
+		close (si->fd);         /* received but never attached */
+	}
+	pthread_mutex_unlock (&jack_shm_registry_lock);
+
+	si->fd = -1;
+}
+
+void
+jack_release_shm (jack_shm_info_t* si)
+{
+	if (si->attached_at != MAP_FAILED) {
+		munmap (si->attached_at, si->size);
+	}
+}
+
+/* allocate a memfd shared memory segment */
+int
+jack_shmalloc (jack_shmsize_t size, jack_shm_info_t* si)
+{
+	jack_shm_registry_t* registry;
+	char name[32];
+	int i;
+	int shm_fd;
+	int rc = -1;
+
+	pthread_mutex_lock (&jack_shm_registry_lock);
+
+	for (i = 0; i < MAX_SHM_ID; ++i) {
+		if (jack_shm_registry[i].size == 0) {
+			break;
+		}
+	}
+
+	if (i == MAX_SHM_ID) {
+		jack_error ("too many shm segments");
+		goto unlock;
+	}
+
+	registry = &jack_shm_registry[i];
+
+	/* the name only shows up in /proc, it need not be unique */
+	snprintf (name, sizeof(name), "jack-%d", i);
+
+	if ((shm_fd = memfd_create (name, MFD_CLOEXEC | MFD_ALLOW_SEALING))
+	    < 0) {
+		jack_error ("cannot create shm segment %s (%s)",
+			    name, strerror (errno));
+		goto unlock;
+	}
+
+	/* once sealed, nobody can shrink the segment under another
+	   process' mapping */
+	if (ftruncate (shm_fd, size) < 0
+	    || fcntl (shm_fd, F_ADD_SEALS, JACK_SHM_SEALS) < 0) {
+		jack_error ("cannot set size of shm segment %s (%s)",
+			    name, strerror (errno));
+		close (shm_fd);
+		goto unlock;
+	}
+
+	registry->index = i;
+	registry->allocator = getpid ();
+	registry->size = size;
+	registry->id = shm_fd;
+	si->index = i;
+	si->fd = shm_fd;
+	si->size = size;
+	si->attached_at = MAP_FAILED;   /* not attached */
+	rc = 0;
+
+unlock:
+	pthread_mutex_unlock (&jack_shm_registry_lock);
+	return rc;
+}
+
+int
+jack_attach_shm (jack_shm_info_t* si)
+{
+	int ours;
+
+	if (si->fd < 0) {
+		jack_error ("shm segment %d was never received", si->index);
+		return -1;
+	}
+
+	if ((si->attached_at = mmap (0, si->size, PROT_READ | PROT_WRITE,
+				     MAP_SHARED, si->fd, 0)) == MAP_FAILED) {
+		jack_error ("cannot mmap shm segment %d (%s)",
+			    si->index, strerror (errno));
+		return -1;
+	}
+
+	pthread_mutex_lock (&jack_shm_registry_lock);
+	ours = jack_shm_is_ours (si);
+	pthread_mutex_unlock (&jack_shm_registry_lock);
+
+	/* a received segment is mapped once; the mapping keeps it */
+	if (!ours) {
+		close (si->fd);
+		si->fd = -1;
+	}
+
+	return 0;
+}
+
+/* Pass segment `index' to the other end of sock, which calls
+ * jack_shm_recv() to get it.
+ *
+ * returns: 0 if successful
+ */
+int
+jack_shm_send (int sock, jack_shm_registry_index_t index)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE (sizeof(int))];
+	} ctl;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	ssize_t n;
+	int shm_fd = -1;
+
+	pthread_mutex_lock (&jack_shm_registry_lock);
+	if (index >= 0 && index < MAX_SHM_ID
+	    && jack_shm_registry[index].size != 0) {
+		shm_fd = jack_shm_registry[index].id;
+	}
+	pthread_mutex_unlock (&jack_shm_registry_lock);
+
+	if (shm_fd < 0) {
+		jack_error ("cannot send unallocated shm segment %d", index);
+		return -1;
+	}
+
+	iov.iov_base = &index;
+	iov.iov_len = sizeof(index);
+
+	memset (&msg, 0, sizeof(msg));
+	memset (&ctl, 0, sizeof(ctl));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+
+	cmsg = CMSG_FIRSTHDR (&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN (sizeof(int));
+	memcpy (CMSG_DATA (cmsg), &shm_fd, sizeof(int));
+
+	while ((n = sendmsg (sock, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+		;
+
+	if (n != sizeof(index)) {
+		jack_error ("cannot send shm segment %d (%s)", index,
+			    strerror (errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Receive a segment sent by jack_shm_send() into si, ready for
+ * jack_attach_shm().  A previous segment in si must have been
+ * attached or destroyed.
+ *
+ * returns: 0 if successful
+ */
+int
+jack_shm_recv (int sock, jack_shm_info_t* si)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE (sizeof(int))];
+	} ctl;
+	jack_shm_registry_index_t index;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	struct stat st;
+	ssize_t n;
+	int shm_fd;
+	int seals;
+
+	iov.iov_base = &index;
+	iov.iov_len = sizeof(index);
+
+	memset (&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+
+	while ((n = recvmsg (sock, &msg, MSG_CMSG_CLOEXEC)) < 0
+	       && errno == EINTR)
+		;
+
+	if (n != sizeof(index)) {
+		jack_error ("cannot receive shm segment (%s)",
+			    n < 0 ? strerror (errno) : "short message");
+		return -1;
+	}
+
+	if ((cmsg = CMSG_FIRSTHDR (&msg)) == NULL
+	    || cmsg->cmsg_level != SOL_SOCKET
+	    || cmsg->cmsg_type != SCM_RIGHTS
+	    || cmsg->cmsg_len != CMSG_LEN (sizeof(int))) {
+		jack_error ("shm segment %d arrived without its descriptor",
+			    index);
+		return -1;
+	}
+
+	memcpy (&shm_fd, CMSG_DATA (cmsg), sizeof(int));
+
+	/* only map what cannot shrink under us, or a server could make
+	   us fault at will */
+	if (index < 0 || index >= MAX_SHM_ID
+	    || (seals = fcntl (shm_fd, F_GET_SEALS)) < 0
+	    || (seals & (F_SEAL_SHRINK | F_SEAL_GROW))
+	    != (F_SEAL_SHRINK | F_SEAL_GROW)
+	    || fstat (shm_fd, &st) < 0 || st.st_size == 0) {
+		jack_error ("shm segment %d is not a sealed memfd", index);
+		close (shm_fd);
+		return -1;
+	}
+
+	si->index = index;
+	si->fd = shm_fd;
+	si->size = st.st_size;
+	si->attached_at = MAP_FAILED;   /* not attached */
+
+	return 0;
+}
+
+#elif defined(USE_POSIX_SHM)
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
 * POSIX interface-dependent functions
@@ -924,4 +1322,4 @@ jack_attach_shm (jack_shm_info_t* si)
 	return 0;
 }
 
-#endif /* !USE_POSIX_SHM */
+#endif /* SHM type */
@@ -26,6 +26,8 @@
 
 #ifdef ARCH_X86
 
+#include <immintrin.h>
+
 int
 have_3dnow ()
 {
@@ -410,7 +412,514 @@ sse_nonalign:
 	}
 }
 
+/* The mixnf kernels sum nsrc (at most JACK_MIX_FANIN) buffers into
+ * dest, or onto it if accumulate is set, keeping the running sum in a
+ * register. They add in source order, like repeated add2f calls.
+ */
+__attribute__((target ("sse2"))) void
+x86_sse_mixnf (float *dest, const float **src, int nsrc, int length,
+	       int accumulate)
+{
+	__m128 acc;
+	float f;
+	int i, k;
+
+	for (i = 0; i + 4 <= length; i += 4) {
+		if (accumulate) {
+			acc = _mm_loadu_ps (dest + i);
+			k = 0;
+		} else {
+			acc = _mm_loadu_ps (src[0] + i);
+			k = 1;
+		}
+		for (; k < nsrc; k++) {
+			acc = _mm_add_ps (acc, _mm_loadu_ps (src[k] + i));
+		}
+		_mm_storeu_ps (dest + i, acc);
+	}
+	for (; i < length; i++) {
+		f = accumulate ? dest[i] : src[0][i];
+		for (k = accumulate ? 0 : 1; k < nsrc; k++) {
+			f += src[k][i];
+		}
+		dest[i] = f;
+	}
+}
+
+/* The scalef kernels add src to dest (or store it there, if accumulate
+ * is not set) times a gain that starts at g0 and moves by step every
+ * sample, so that sample i gets g0 + step * (i + 1). They work the
+ * gain out afresh for each sample rather than add step up, and must
+ * not have multiplies and adds fused, so that they match gen_scalef().
+ */
+__attribute__((target ("sse2"), optimize ("fp-contract=off"))) void
+x86_sse_scalef (float *dest, const float *src, int length, float g0,
+		float step, int accumulate)
+{
+	__m128 idx = _mm_setr_ps (1.0F, 2.0F, 3.0F, 4.0F);
+	__m128 four = _mm_set1_ps (4.0F);
+	__m128 vg0 = _mm_set1_ps (g0);
+	__m128 vstep = _mm_set1_ps (step);
+	__m128 x;
+	float g;
+	int i;
+
+	for (i = 0; i + 4 <= length; i += 4) {
+		x = _mm_mul_ps (_mm_loadu_ps (src + i),
+				_mm_add_ps (vg0, _mm_mul_ps (vstep, idx)));
+		if (accumulate) {
+			x = _mm_add_ps (_mm_loadu_ps (dest + i), x);
+		}
+		_mm_storeu_ps (dest + i, x);
+		idx = _mm_add_ps (idx, four);
+	}
+	for (; i < length; i++) {
+		g = g0 + step * (float)(i + 1);
+		dest[i] = accumulate ? dest[i] + src[i] * g : src[i] * g;
+	}
+}
+
+/* The AVX kernels are compiled for their instruction set function by
+ * function, so that the rest of the file does not depend on it. They
+ * work on unaligned buffers and finish off odd lengths one sample at
+ * a time. The conversions clamp to [-1, 1] and round to nearest, like
+ * x86_sse_f2i().
+ */
+
+/* 0 without AVX2, 1 with AVX2, 2 with AVX-512F as well */
+int
+have_avx ()
+{
+	__builtin_cpu_init ();
+
+	if (!__builtin_cpu_supports ("avx2")) {
+		return 0;
+	}
+	if (!__builtin_cpu_supports ("avx512f")) {
+		return 1;
+	}
+	return 2;
+}
+
+__attribute__((target ("avx2"))) void
+x86_avx2_copyf (float *dest, const float *src, int length)
+{
+	int i;
+
+	for (i = 0; i + 16 <= length; i += 16) {
+		__m256 a = _mm256_loadu_ps (src + i);
+		__m256 b = _mm256_loadu_ps (src + i + 8);
+		_mm256_storeu_ps (dest + i, a);
+		_mm256_storeu_ps (dest + i + 8, b);
+	}
+	for (; i < length; i++) {
+		dest[i] = src[i];
+	}
+}
+
+__attribute__((target ("avx2"))) void
+x86_avx2_add2f (float *dest, const float *src, int length)
+{
+	int i;
+
+	for (i = 0; i + 16 <= length; i += 16) {
+		__m256 a = _mm256_add_ps (_mm256_loadu_ps (dest + i),
+					  _mm256_loadu_ps (src + i));
+		__m256 b = _mm256_add_ps (_mm256_loadu_ps (dest + i + 8),
+					  _mm256_loadu_ps (src + i + 8));
+		_mm256_storeu_ps (dest + i, a);
+		_mm256_storeu_ps (dest + i + 8, b);
+	}
+	for (; i < length; i++) {
+		dest[i] += src[i];
+	}
+}
+
+__attribute__((target ("avx2"))) void
+x86_avx2_f2i (int *dest, const float *src, int length, float scale)
+{
+	__m256 lo = _mm256_set1_ps (-1.0F);
+	__m256 hi = _mm256_set1_ps (1.0F);
+	__m256 s = _mm256_set1_ps (scale);
+	__m256 x;
+	int i;
+
+	for (i = 0; i + 8 <= length; i += 8) {
+		x = _mm256_max_ps (_mm256_loadu_ps (src + i), lo);
+		x = _mm256_mul_ps (_mm256_min_ps (x, hi), s);
+		_mm256_storeu_si256 ((__m256i*)(dest + i), _mm256_cvtps_epi32 (x));
+	}
+	for (; i < length; i++) {
+		x = _mm256_max_ps (_mm256_set1_ps (src[i]), lo);
+		x = _mm256_mul_ps (_mm256_min_ps (x, hi), s);
+		dest[i] = _mm_cvtsi128_si32 (_mm256_castsi256_si128 (
+						     _mm256_cvtps_epi32 (x)));
+	}
+}
+
+__attribute__((target ("avx2"))) void
+x86_avx2_i2f (float *dest, const int *src, int length, float scale)
+{
+	__m256 s = _mm256_set1_ps (scale);
+	int i;
+
+	for (i = 0; i + 8 <= length; i += 8) {
+		__m256i x = _mm256_loadu_si256 ((const __m256i*)(src + i));
+		_mm256_storeu_ps (dest + i,
+				  _mm256_mul_ps (_mm256_cvtepi32_ps (x), s));
+	}
+	for (; i < length; i++) {
+		dest[i] = (float)src[i] * scale;
+	}
+}
+
+__attribute__((target ("avx2"))) void
+x86_avx2_mixnf (float *dest, const float **src, int nsrc, int length,
+		int accumulate)
+{
+	__m256 acc;
+	float f;
+	int i, k;
+
+	for (i = 0; i + 8 <= length; i += 8) {
+		if (accumulate) {
+			acc = _mm256_loadu_ps (dest + i);
+			k = 0;
+		} else {
+			acc = _mm256_loadu_ps (src[0] + i);
+			k = 1;
+		}
+		for (; k < nsrc; k++) {
+			acc = _mm256_add_ps (acc, _mm256_loadu_ps (src[k] + i));
+		}
+		_mm256_storeu_ps (dest + i, acc);
+	}
+	for (; i < length; i++) {
+		f = accumulate ? dest[i] : src[0][i];
+		for (k = accumulate ? 0 : 1; k < nsrc; k++) {
+			f += src[k][i];
+		}
+		dest[i] = f;
+	}
+}
+
+__attribute__((target ("avx2"), optimize ("fp-contract=off"))) void
+x86_avx2_scalef (float *dest, const float *src, int length, float g0,
+		 float step, int accumulate)
+{
+	__m256 idx = _mm256_setr_ps (1.0F, 2.0F, 3.0F, 4.0F,
+				     5.0F, 6.0F, 7.0F, 8.0F);
+	__m256 eight = _mm256_set1_ps (8.0F);
+	__m256 vg0 = _mm256_set1_ps (g0);
+	__m256 vstep = _mm256_set1_ps (step);
+	__m256 x;
+	float g;
+	int i;
+
+	for (i = 0; i + 8 <= length; i += 8) {
+		x = _mm256_mul_ps (_mm256_loadu_ps (src + i),
+				   _mm256_add_ps (vg0,
+						  _mm256_mul_ps (vstep, idx)));
+		if (accumulate) {
+			x = _mm256_add_ps (_mm256_loadu_ps (dest + i), x);
+		}
+		_mm256_storeu_ps (dest + i, x);
+		idx = _mm256_add_ps (idx, eight);
+	}
+	for (; i < length; i++) {
+		g = g0 + step * (float)(i + 1);
+		dest[i] = accumulate ? dest[i] + src[i] * g : src[i] * g;
+	}
+}
+
+/* AVX-512 handles the tail with a masked load and store instead of a
+ * scalar loop.
+ */
+#define AVX512_TAIL(n) ((__mmask16)((1U << (n)) - 1))
+
+__attribute__((target ("avx512f"))) void
+x86_avx512_copyf (float *dest, const float *src, int length)
+{
+	int i;
+
+	for (i = 0; i + 16 <= length; i += 16) {
+		_mm512_storeu_ps (dest + i, _mm512_loadu_ps (src + i));
+	}
+	if (i < length) {
+		__mmask16 m = AVX512_TAIL (length - i);
+		_mm512_mask_storeu_ps (dest + i, m,
+				       _mm512_maskz_loadu_ps (m, src + i));
+	}
+}
+
+__attribute__((target ("avx512f"))) void
+x86_avx512_add2f (float *dest, const float *src, int length)
+{
+	int i;
+
+	for (i = 0; i + 16 <= length; i += 16) {
+		_mm512_storeu_ps (dest + i,
+				  _mm512_add_ps (_mm512_loadu_ps (dest + i),
+						 _mm512_loadu_ps (src + i)));
+	}
+	if (i < length) {
+		__mmask16 m = AVX512_TAIL (length - i);
+		_mm512_mask_storeu_ps (dest + i, m,
+				       _mm512_add_ps (_mm512_maskz_loadu_ps (m, dest + i),
+						      _mm512_maskz_loadu_ps (m, src + i)));
+	}
+}
+
+__attribute__((target ("avx512f"))) void
+x86_avx512_f2i (int *dest, const float *src, int length, float scale)
+{
+	__m512 lo = _mm512_set1_ps (-1.0F);
+	__m512 hi = _mm512_set1_ps (1.0F);
+	__m512 s = _mm512_set1_ps (scale);
+	__mmask16 m = AVX512_TAIL (16);
+	__m512 x;
+	int i;
+
+	for (i = 0; i < length; i += 16) {
+		if (length - i < 16) {
+			m = AVX512_TAIL (length - i);
+		}
+		x = _mm512_max_ps (_mm512_maskz_loadu_ps (m, src + i), lo);
+		x = _mm512_mul_ps (_mm512_min_ps (x, hi), s);
+		_mm512_mask_storeu_epi32 (dest + i, m, _mm512_cvtps_epi32 (x));
+	}
+}
+
+__attribute__((target ("avx512f"))) void
+x86_avx512_i2f (float *dest, const int *src, int length, float scale)
+{
+	__m512 s = _mm512_set1_ps (scale);
+	__mmask16 m = AVX512_TAIL (16);
+	__m512i x;
+	int i;
+
+	for (i = 0; i < length; i += 16) {
+		if (length - i < 16) {
+			m = AVX512_TAIL (length - i);
+		}
+		x = _mm512_maskz_loadu_epi32 (m, src + i);
+		_mm512_mask_storeu_ps (dest + i, m,
+				       _mm512_mul_ps (_mm512_cvtepi32_ps (x), s));
+	}
+}
+
+__attribute__((target ("avx512f"))) void
+x86_avx512_mixnf (float *dest, const float **src, int nsrc, int length,
+		  int accumulate)
+{
+	__mmask16 m = AVX512_TAIL (16);
+	__m512 acc;
+	int i, k;
+
+	for (i = 0; i < length; i += 16) {
+		if (length - i < 16) {
+			m = AVX512_TAIL (length - i);
+		}
+		if (accumulate) {
+			acc = _mm512_maskz_loadu_ps (m, dest + i);
+			k = 0;
+		} else {
+			acc = _mm512_maskz_loadu_ps (m, src[0] + i);
+			k = 1;
+		}
+		for (; k < nsrc; k++) {
+			acc = _mm512_add_ps (acc,
+					     _mm512_maskz_loadu_ps (m, src[k] + i));
+		}
+		_mm512_mask_storeu_ps (dest + i, m, acc);
+	}
+}
+
+__attribute__((target ("avx512f"), optimize ("fp-contract=off"))) void
+x86_avx512_scalef (float *dest, const float *src, int length, float g0,
+		   float step, int accumulate)
+{
+	__mmask16 m = AVX512_TAIL (16);
+	__m512 idx = _mm512_setr_ps (1.0F, 2.0F, 3.0F, 4.0F, 5.0F, 6.0F,
+				     7.0F, 8.0F, 9.0F, 10.0F, 11.0F, 12.0F,
+				     13.0F, 14.0F, 15.0F, 16.0F);
+	__m512 sixteen = _mm512_set1_ps (16.0F);
+	__m512 vg0 = _mm512_set1_ps (g0);
+	__m512 vstep = _mm512_set1_ps (step);
+	__m512 x;
+	int i;
+
+	for (i = 0; i < length; i += 16) {
+		if (length - i < 16) {
+			m = AVX512_TAIL (length - i);
+		}
+		x = _mm512_mul_ps (_mm512_maskz_loadu_ps (m, src + i),
+				   _mm512_add_ps (vg0,
+						  _mm512_mul_ps (vstep, idx)));
+		if (accumulate) {
+			x = _mm512_add_ps (_mm512_maskz_loadu_ps (m, dest + i),
+					   x);
+		}
+		_mm512_mask_storeu_ps (dest + i, m, x);
+		idx = _mm512_add_ps (idx, sixteen);
+	}
+}
+
 #endif  /* ARCH_X86 */
 
-#endif  /* USE_DYNSIMD */
+#ifdef ARCH_ARM64
+
+#include <math.h>
+#include <arm_neon.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+/* Advanced SIMD is part of the base ARMv8-A architecture, but ask
+ * the kernel anyway rather than trust it.
+ */
+int
+have_neon ()
+{
+#if defined(__linux__) && defined(HWCAP_ASIMD)
+	return (getauxval (AT_HWCAP) & HWCAP_ASIMD) ? 1 : 0;
+#else
+	return 1;
+#endif
+}
+
+void
+arm64_neon_copyf (float *dest, const float *src, int length)
+{
+	int i;
+
+	for (i = 0; i + 8 <= length; i += 8) {
+		float32x4_t a = vld1q_f32 (src + i);
+		float32x4_t b = vld1q_f32 (src + i + 4);
+		vst1q_f32 (dest + i, a);
+		vst1q_f32 (dest + i + 4, b);
+	}
+	for (; i < length; i++) {
+		dest[i] = src[i];
+	}
+}
 
+void
+arm64_neon_add2f (float *dest, const float *src, int length)
+{
+	int i;
+
+	for (i = 0; i + 8 <= length; i += 8) {
+		float32x4_t a = vaddq_f32 (vld1q_f32 (dest + i),
+					   vld1q_f32 (src + i));
+		float32x4_t b = vaddq_f32 (vld1q_f32 (dest + i + 4),
+					   vld1q_f32 (src + i + 4));
+		vst1q_f32 (dest + i, a);
+		vst1q_f32 (dest + i + 4, b);
+	}
+	for (; i < length; i++) {
+		dest[i] += src[i];
+	}
+}
+
+/* vmaxnmq and fmaxf() turn a NaN into -1, as maxps does in
+ * x86_sse_f2i(), and vcvtnq rounds to nearest even, as lrintf() does
+ * by default.
+ */
+void
+arm64_neon_f2i (int *dest, const float *src, int length, float scale)
+{
+	float32x4_t lo = vdupq_n_f32 (-1.0F);
+	float32x4_t hi = vdupq_n_f32 (1.0F);
+	float32x4_t x;
+	float f;
+	int i;
+
+	for (i = 0; i + 4 <= length; i += 4) {
+		x = vmaxnmq_f32 (vld1q_f32 (src + i), lo);
+		x = vmulq_n_f32 (vminq_f32 (x, hi), scale);
+		vst1q_s32 (dest + i, vcvtnq_s32_f32 (x));
+	}
+	for (; i < length; i++) {
+		f = fmaxf (src[i], -1.0F);
+		f = (f > 1.0F ? 1.0F : f) * scale;
+		dest[i] = (int)lrintf (f);
+	}
+}
+
+void
+arm64_neon_i2f (float *dest, const int *src, int length, float scale)
+{
+	int i;
+
+	for (i = 0; i + 4 <= length; i += 4) {
+		vst1q_f32 (dest + i,
+			   vmulq_n_f32 (vcvtq_f32_s32 (vld1q_s32 (src + i)),
+					scale));
+	}
+	for (; i < length; i++) {
+		dest[i] = (float)src[i] * scale;
+	}
+}
+
+void
+arm64_neon_mixnf (float *dest, const float **src, int nsrc, int length,
+		  int accumulate)
+{
+	float32x4_t acc;
+	float f;
+	int i, k;
+
+	for (i = 0; i + 4 <= length; i += 4) {
+		if (accumulate) {
+			acc = vld1q_f32 (dest + i);
+			k = 0;
+		} else {
+			acc = vld1q_f32 (src[0] + i);
+			k = 1;
+		}
+		for (; k < nsrc; k++) {
+			acc = vaddq_f32 (acc, vld1q_f32 (src[k] + i));
+		}
+		vst1q_f32 (dest + i, acc);
+	}
+	for (; i < length; i++) {
+		f = accumulate ? dest[i] : src[0][i];
+		for (k = accumulate ? 0 : 1; k < nsrc; k++) {
+			f += src[k][i];
+		}
+		dest[i] = f;
+	}
+}
+
+__attribute__((optimize ("fp-contract=off"))) void
+arm64_neon_scalef (float *dest, const float *src, int length, float g0,
+		   float step, int accumulate)
+{
+	static const float first[4] = { 1.0F, 2.0F, 3.0F, 4.0F };
+	float32x4_t idx = vld1q_f32 (first);
+	float32x4_t four = vdupq_n_f32 (4.0F);
+	float32x4_t vg0 = vdupq_n_f32 (g0);
+	float32x4_t x;
+	float g;
+	int i;
+
+	for (i = 0; i + 4 <= length; i += 4) {
+		x = vmulq_f32 (vld1q_f32 (src + i),
+			       vaddq_f32 (vg0, vmulq_n_f32 (idx, step)));
+		if (accumulate) {
+			x = vaddq_f32 (vld1q_f32 (dest + i), x);
+		}
+		vst1q_f32 (dest + i, x);
+		idx = vaddq_f32 (idx, four);
+	}
+	for (; i < length; i++) {
+		g = g0 + step * (float)(i + 1);
+		dest[i] = accumulate ? dest[i] + src[i] * g : src[i] * g;
+	}
+}
+
+#endif  /* ARCH_ARM64 */
+
+#endif  /* USE_DYNSIMD */
@@ -0,0 +1,256 @@
+/* -*- mode: c; c-file-style: "bsd"; -*- */
+/*
+    Copyright (C) 2026 the JACK developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 2.1 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+    Checks every vector sample kernel this CPU can run against the
+    plain C version, bit for bit, for all lengths up to MAX_LEN and,
+    where the kernel allows it, with buffers that are not vector
+    aligned.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "intsimd.h"
+
+#ifdef USE_DYNSIMD
+
+#define MAX_LEN 133
+#define PAD     16              /* floats around each buffer */
+
+typedef struct {
+	const char *name;
+	void (*copyf)(float *, const float *, int);
+	void (*add2f)(float *, const float *, int);
+	void (*f2i)(int *, const float *, int, float);
+	void (*i2f)(float *, const int *, int, float);
+	void (*mixnf)(float *, const float **, int, int, int);
+	void (*scalef)(float *, const float *, int, float, float, int);
+	int step;       /* f2i and i2f lengths must be a multiple of this */
+	int aligned;    /* buffers must be 16 byte aligned, as port buffers are */
+} kernel_set_t;
+
+#define ALIGNED __attribute__((aligned (64)))
+
+static float in[JACK_MIX_FANIN][MAX_LEN + 2 * PAD] ALIGNED;
+static float ref[MAX_LEN + 2 * PAD] ALIGNED;
+static float out[MAX_LEN + 2 * PAD] ALIGNED;
+static int iref[MAX_LEN + 2 * PAD] ALIGNED;
+static int iout[MAX_LEN + 2 * PAD] ALIGNED;
+static int iin[MAX_LEN + 2 * PAD] ALIGNED;
+
+static unsigned int seed = 22222;
+static int failures = 0;
+
+static float
+rand_sample ()
+{
+	seed = (seed * 96314165) + 907633515;
+	return (float)(seed >> 8) / (float)(1 << 23) - 1.0F;
+}
+
+/* Samples mostly in [-1.5, 1.5], with the values that sit on the
+ * edges of the conversions mixed in. NaNs are only used for f2i, where
+ * the result does not depend on which NaN comes out.
+ */
+static void
+fill (float *buf, int n, int with_nan)
+{
+	static const float special[] = {
+		1.0F, -1.0F, 0.0F, -0.0F, 1e-40F, -1e-40F, 1.5F, -7.0F,
+		0.5F / 32767.0F, 1.5F / 32767.0F, 0.5F / 8388607.0F,
+		INFINITY, -INFINITY, NAN
+	};
+	int nspecial = sizeof(special) / sizeof(special[0]) - (with_nan ? 0 : 1);
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if ((i % 7) == 3) {
+			buf[i] = special[(i / 7) % nspecial];
+		} else {
+			buf[i] = rand_sample () * 1.5F;
+		}
+	}
+}
+
+static void
+check (const char *set, const char *kernel, int len, int off,
+       const void *a, const void *b)
+{
+	if (memcmp (a, b, (MAX_LEN + 2 * PAD) * sizeof(float)) != 0) {
+		fprintf (stderr, "%s %s differs from the plain C version "
+			 "(length %d, offset %d)\n", set, kernel, len, off);
+		failures++;
+	}
+}
+
+static void
+test_set (const kernel_set_t *k)
+{
+	const float *src[JACK_MIX_FANIN];
+	static const float scales[] = { 32767.0F, 8388607.0F };
+	static const float gains[][2] = {
+		{ 1.0F, 0.0F }, { 0.5F, 0.001F }, { 1.0F, -1.0F / 133 }
+	};
+	int len, off, i, n, acc;
+
+	for (len = 0; len <= MAX_LEN; len++) {
+		for (off = k->aligned ? PAD : PAD - 3; off <= PAD; off++) {
+
+			for (i = 0; i < JACK_MIX_FANIN; i++) {
+				fill (in[i], MAX_LEN + 2 * PAD, 0);
+				src[i] = in[i] + off;
+			}
+
+			if (k->copyf) {
+				fill (ref, MAX_LEN + 2 * PAD, 0);
+				memcpy (out, ref, sizeof(out));
+				gen_copyf (ref + off, in[0] + off, len);
+				k->copyf (out + off, in[0] + off, len);
+				check (k->name, "copyf", len, off, ref, out);
+			}
+
+			if (k->add2f) {
+				fill (ref, MAX_LEN + 2 * PAD, 0);
+				memcpy (out, ref, sizeof(out));
+				gen_mixf (ref + off, in[0] + off, len);
+				k->add2f (out + off, in[0] + off, len);
+				check (k->name, "add2f", len, off, ref, out);
+			}
+
+			for (n = 1; k->mixnf && n <= JACK_MIX_FANIN; n++) {
+				for (acc = 0; acc <= 1; acc++) {
+					fill (ref, MAX_LEN + 2 * PAD, 0);
+					memcpy (out, ref, sizeof(out));
+					gen_mixnf (ref + off, src, n, len, acc);
+					k->mixnf (out + off, src, n, len, acc);
+					check (k->name, "mixnf", len, off, ref, out);
+				}
+			}
+
+			for (i = 0; k->scalef && i < 3; i++) {
+				for (acc = 0; acc <= 1; acc++) {
+					fill (ref, MAX_LEN + 2 * PAD, 0);
+					memcpy (out, ref, sizeof(out));
+					gen_scalef (ref + off, in[0] + off, len,
+						    gains[i][0], gains[i][1], acc);
+					k->scalef (out + off, in[0] + off, len,
+						   gains[i][0], gains[i][1], acc);
+					check (k->name, "scalef", len, off, ref, out);
+				}
+			}
+
+			if (len % k->step) {
+				continue;
+			}
+
+			for (i = 0; k->f2i && i < 2; i++) {
+				fill (in[0], MAX_LEN + 2 * PAD, 1);
+				memset (iref, 0, sizeof(iref));
+				memset (iout, 0, sizeof(iout));
+				gen_f2i (iref + off, in[0] + off, len, scales[i]);
+				k->f2i (iout + off, in[0] + off, len, scales[i]);
+				check (k->name, "f2i", len, off, iref, iout);
+			}
+
+			for (i = 0; k->i2f && i < 2; i++) {
+				for (n = 0; n < MAX_LEN + 2 * PAD; n++) {
+					seed = (seed * 96314165) + 907633515;
+					iin[n] = (int)seed >> (i ? 8 : 16);
+				}
+				fill (ref, MAX_LEN + 2 * PAD, 0);
+				memcpy (out, ref, sizeof(out));
+				gen_i2f (ref + off, iin + off, len, 1.0F / scales[i]);
+				k->i2f (out + off, iin + off, len, 1.0F / scales[i]);
+				check (k->name, "i2f", len, off, ref, out);
+			}
+		}
+	}
+
+	printf ("%s: checked\n", k->name);
+}
+
+int
+main ()
+{
+	int tested = 0;
+
+#ifdef ARCH_X86
+	int sse = have_sse ();
+	int avx = have_avx ();
+
+	if (have_3dnow ()) {
+		kernel_set_t k = { "3dnow", x86_3dnow_copyf, x86_3dnow_add2f,
+				   NULL, NULL, NULL, NULL, 1, 1 };
+		test_set (&k);
+		tested++;
+	}
+	if (sse >= 2) {
+		kernel_set_t k = { "sse", x86_sse_copyf, x86_sse_add2f,
+				   x86_sse_f2i, x86_sse_i2f, x86_sse_mixnf,
+				   x86_sse_scalef, 4, 1 };
+		test_set (&k);
+		tested++;
+	}
+	if (avx >= 1) {
+		kernel_set_t k = { "avx2", x86_avx2_copyf, x86_avx2_add2f,
+				   x86_avx2_f2i, x86_avx2_i2f, x86_avx2_mixnf,
+				   x86_avx2_scalef, 1, 0 };
+		test_set (&k);
+		tested++;
+	}
+	if (avx >= 2) {
+		kernel_set_t k = { "avx512", x86_avx512_copyf, x86_avx512_add2f,
+				   x86_avx512_f2i, x86_avx512_i2f,
+				   x86_avx512_mixnf, x86_avx512_scalef, 1, 0 };
+		test_set (&k);
+		tested++;
+	}
+#endif /* ARCH_X86 */
+
+#ifdef ARCH_ARM64
+	if (have_neon ()) {
+		kernel_set_t k = { "neon", arm64_neon_copyf, arm64_neon_add2f,
+				   arm64_neon_f2i, arm64_neon_i2f,
+				   arm64_neon_mixnf, arm64_neon_scalef, 1, 0 };
+		test_set (&k);
+		tested++;
+	}
+#endif /* ARCH_ARM64 */
+
+	if (!tested) {
+		printf ("no vector kernels for this CPU\n");
+		return 77;
+	}
+
+	return failures ? 1 : 0;
+}
+
+#else /* USE_DYNSIMD */
+
+int
+main ()
+{
+	printf ("built without --enable-dynsimd\n");
+	return 77;
+}
+
+#endif /* USE_DYNSIMD */
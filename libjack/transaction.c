@@ -0,0 +1,278 @@
+/* -*- mode: c; c-file-style: "bsd"; -*- */
+/*
+ *  Copyright (C) 2026 the JACK developers
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation; either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* Graph transactions: queue connects, disconnects and port
+ * (un)registrations on the client side, then hand them to the server
+ * in a single GraphTransaction request. The server applies them in
+ * order without interleaving other requests, and sorts the graph once
+ * at the end. Each operation gets its own status; a failed operation
+ * does not undo the ones before it.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jack/jack.h>
+#include <jack/uuid.h>
+
+#include "internal.h"
+#include "local.h"
+
+struct _jack_graph_txn {
+	jack_client_t *client;
+	uint32_t nops;
+	uint32_t size;
+	jack_graph_op_t *ops;
+	jack_port_t **ports;            /* registered ports, by op */
+	int committed;
+};
+
+jack_graph_txn_t *
+jack_graph_txn_begin (jack_client_t *client)
+{
+	jack_graph_txn_t *txn;
+
+	if ((txn = (jack_graph_txn_t*)calloc (1, sizeof(*txn))) == NULL) {
+		jack_error ("cannot allocate graph transaction");
+		return NULL;
+	}
+
+	txn->client = client;
+
+	return txn;
+}
+
+static jack_graph_op_t *
+jack_graph_txn_add (jack_graph_txn_t *txn, uint32_t type)
+{
+	jack_graph_op_t *op;
+
+	if (txn->committed) {
+		jack_error ("graph transaction has already been committed");
+		return NULL;
+	}
+
+	if (txn->nops == JACK_GRAPH_TXN_MAX) {
+		jack_error ("too many operations in graph transaction "
+			    "(max %d)", JACK_GRAPH_TXN_MAX);
+		return NULL;
+	}
+
+	if (txn->nops == txn->size) {
+		uint32_t size = txn->size ? txn->size * 2 : 16;
+		jack_graph_op_t *ops;
+
+		if ((ops = (jack_graph_op_t*)
+			   realloc (txn->ops, sizeof(jack_graph_op_t) * size))
+		    == NULL) {
+			jack_error ("cannot grow graph transaction");
+			return NULL;
+		}
+		txn->ops = ops;
+		txn->size = size;
+	}
+
+	op = &txn->ops[txn->nops];
+	memset (op, 0, sizeof(*op));
+	op->type = type;
+	op->status = -1;
+
+	return op;
+}
+
+static int
+jack_graph_txn_add_pair (jack_graph_txn_t *txn, uint32_t type,
+			 const char *a, const char *b)
+{
+	jack_graph_op_t *op;
+
+	if ((op = jack_graph_txn_add (txn, type)) == NULL) {
+		return -1;
+	}
+
+	snprintf (op->a, sizeof(op->a), "%s", a);
+	snprintf (op->b, sizeof(op->b), "%s", b);
+
+	return txn->nops++;
+}
+
+int
+jack_graph_txn_connect (jack_graph_txn_t *txn, const char *source_port,
+			const char *destination_port)
+{
+	return jack_graph_txn_add_pair (txn, ConnectPorts, source_port,
+					destination_port);
+}
+
+int
+jack_graph_txn_disconnect (jack_graph_txn_t *txn, const char *source_port,
+			   const char *destination_port)
+{
+	return jack_graph_txn_add_pair (txn, DisconnectPorts, source_port,
+					destination_port);
+}
+
+int
+jack_graph_txn_port_disconnect (jack_graph_txn_t *txn, jack_port_t *port)
+{
+	jack_graph_op_t *op;
+
+	if ((op = jack_graph_txn_add (txn, DisconnectPort)) == NULL) {
+		return -1;
+	}
+
+	op->port_id = port->shared->id;
+
+	return txn->nops++;
+}
+
+int
+jack_graph_txn_port_register (jack_graph_txn_t *txn, const char *port_name,
+			      const char *port_type, unsigned long flags,
+			      unsigned long buffer_size)
+{
+	jack_client_t *client = txn->client;
+	jack_graph_op_t *op;
+
+	if (strlen ((const char*)client->control->name) + 1
+	    + strlen (port_name) >= sizeof(op->a)) {
+		jack_error ("\"%s:%s\" is too long to be used as a JACK port name.\n"
+			    "Please use %lu characters or less.",
+			    client->control->name, port_name,
+			    sizeof(op->a) - 1);
+		return -1;
+	}
+
+	if ((op = jack_graph_txn_add (txn, RegisterPort)) == NULL) {
+		return -1;
+	}
+
+	snprintf (op->a, sizeof(op->a), "%s:%s",
+		  (const char*)client->control->name, port_name);
+	snprintf (op->b, sizeof(op->b), "%s", port_type);
+	op->flags = flags & ~JACK_PORT_REQUEST_CAPACITY;
+	op->buffer_size = buffer_size;
+
+	return txn->nops++;
+}
+
+int
+jack_graph_txn_port_unregister (jack_graph_txn_t *txn, jack_port_t *port)
+{
+	jack_graph_op_t *op;
+
+	if ((op = jack_graph_txn_add (txn, UnRegisterPort)) == NULL) {
+		return -1;
+	}
+
+	op->port_id = port->shared->id;
+
+	return txn->nops++;
+}
+
+/* Returns 0 if every operation succeeded, -1 otherwise. Use
+ * jack_graph_txn_status() to find out which ones failed.
+ */
+int
+jack_graph_txn_commit (jack_graph_txn_t *txn)
+{
+	jack_client_t *client = txn->client;
+	jack_request_t req;
+	jack_port_t *port;
+	uint32_t i;
+	int ret;
+
+	if (txn->committed) {
+		jack_error ("graph transaction has already been committed");
+		return -1;
+	}
+
+	txn->committed = TRUE;
+
+	if (txn->nops == 0) {
+		return 0;
+	}
+
+	VALGRIND_MEMSET (&req, 0, sizeof(req));
+
+	req.type = GraphTransaction;
+	req.x.transaction.nops = txn->nops;
+	req.x.transaction.ops = txn->ops;
+	jack_uuid_copy (&req.x.transaction.client_id, client->control->uuid);
+
+	ret = jack_client_deliver_request (client, &req);
+
+	if ((txn->ports = (jack_port_t**)
+			  calloc (txn->nops, sizeof(jack_port_t*))) == NULL) {
+		jack_error ("cannot allocate client side port structures");
+		return -1;
+	}
+
+	/* the same as jack_port_register() does after its request */
+
+	for (i = 0; i < txn->nops; i++) {
+		if (txn->ops[i].type != RegisterPort || txn->ops[i].status != 0) {
+			continue;
+		}
+		if ((port = jack_port_new (client, txn->ops[i].port_id,
+					   client->engine)) == NULL) {
+			jack_error ("cannot allocate client side port structure");
+			txn->ops[i].status = -1;
+			ret = -1;
+			continue;
+		}
+		client->ports = jack_slist_prepend (client->ports, port);
+		txn->ports[i] = port;
+	}
+
+	return ret;
+}
+
+int
+jack_graph_txn_status (jack_graph_txn_t *txn, int op)
+{
+	if (!txn->committed || op < 0 || (uint32_t)op >= txn->nops) {
+		return -1;
+	}
+
+	return txn->ops[op].status;
+}
+
+jack_port_t *
+jack_graph_txn_port (jack_graph_txn_t *txn, int op)
+{
+	if (txn->ports == NULL || op < 0 || (uint32_t)op >= txn->nops) {
+		return NULL;
+	}
+
+	return txn->ports[op];
+}
+
+void
+jack_graph_txn_free (jack_graph_txn_t *txn)
+{
+	free (txn->ops);
+	free (txn->ports);
+	free (txn);
+}